@@ -76,7 +76,12 @@
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
 /* Hook function related definitions. */
+#ifdef NDEBUG
 #define configCHECK_FOR_STACK_OVERFLOW          0
+#else
+/* Checks the stack end pattern on every switch, see vApplicationStackOverflowHook() in main.c */
+#define configCHECK_FOR_STACK_OVERFLOW          2
+#endif
 #define configUSE_MALLOC_FAILED_HOOK            0
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
@@ -0,0 +1,131 @@
+#include "clock_sync.h"
+
+#include <stddef.h>
+
+#define ROUND_TRIP_MARGIN_US 1000 // Samples slower than twice the fastest one plus this are left out of the fit
+#define MAX_DRIFT_PPB 1000000     // Far beyond any crystal, keeps the products below within 64 bits
+
+static inline int64_t abs64(int64_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+void clock_sync_reset(clock_sync *sync)
+{
+    sync->count = 0;
+    sync->next = 0;
+    sync->reference_us = 0;
+    sync->offset_us = 0;
+    sync->drift_ppb = 0;
+    sync->round_trip_us = 0;
+    sync->residual_us = 0;
+}
+
+int64_t clock_sync_offset_at(const clock_sync *sync, uint64_t local_us)
+{
+    return sync->offset_us + (int64_t)(local_us - sync->reference_us) * sync->drift_ppb / 1000000000;
+}
+
+uint64_t clock_sync_to_local(const clock_sync *sync, uint64_t remote_us)
+{
+    // The drift moves the offset by well under a microsecond over the offset itself, one step is enough
+    return remote_us + clock_sync_offset_at(sync, remote_us + sync->offset_us);
+}
+
+// Least squares line of the offset over the local time, through the samples with the shortest round trips: queued
+// requests or replies make the others asymmetric
+static void fit(clock_sync *sync)
+{
+    uint32_t fastest = UINT32_MAX;
+    for (int i = 0; i < sync->count; i++) {
+        if (sync->samples[i].round_trip_us < fastest) {
+            fastest = sync->samples[i].round_trip_us;
+        }
+    }
+    uint64_t limit = (uint64_t)fastest * 2 + ROUND_TRIP_MARGIN_US;
+
+    // Relative to a sample so that the sums stay small
+    const clock_sync_sample *base = NULL;
+    int64_t sum_x = 0, sum_y = 0;
+    int64_t min_x = 0, max_x = 0;
+    int n = 0;
+    for (int i = 0; i < sync->count; i++) {
+        const clock_sync_sample *sample = &sync->samples[i];
+        if (sample->round_trip_us > limit) {
+            continue;
+        }
+        if (!base) {
+            base = sample;
+        }
+        int64_t x = (int64_t)(sample->local_us - base->local_us);
+        sum_x += x;
+        sum_y += sample->offset_us - base->offset_us;
+        min_x = x < min_x ? x : min_x;
+        max_x = x > max_x ? x : max_x;
+        n++;
+    }
+
+    int64_t mean_x = sum_x / n, mean_y = sum_y / n;
+    sync->reference_us = base->local_us + mean_x;
+    sync->offset_us = base->offset_us + mean_y;
+    sync->round_trip_us = fastest;
+    sync->drift_ppb = 0;
+
+    if (n >= 2 && max_x - min_x >= CLOCK_SYNC_MIN_DRIFT_SPAN_US) {
+        // Milliseconds on the time axis, so that the squares hold in 64 bits for days of samples
+        int64_t sxx = 0, sxy = 0;
+        for (int i = 0; i < sync->count; i++) {
+            const clock_sync_sample *sample = &sync->samples[i];
+            if (sample->round_trip_us > limit) {
+                continue;
+            }
+            int64_t dx = ((int64_t)(sample->local_us - base->local_us) - mean_x) / 1000;
+            int64_t dy = (sample->offset_us - base->offset_us) - mean_y;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+        while (abs64(sxy) > INT64_MAX / 1000000) {
+            sxy /= 2;
+            sxx /= 2;
+        }
+        if (sxx) {
+            // Microseconds per millisecond to parts per billion
+            int64_t drift = sxy * 1000000 / sxx;
+            sync->drift_ppb = drift > MAX_DRIFT_PPB ? MAX_DRIFT_PPB : drift < -MAX_DRIFT_PPB ? -MAX_DRIFT_PPB : (int32_t)drift;
+        }
+    }
+
+    int64_t residual = 0;
+    for (int i = 0; i < sync->count; i++) {
+        const clock_sync_sample *sample = &sync->samples[i];
+        if (sample->round_trip_us <= limit) {
+            int64_t error = abs64(sample->offset_us - clock_sync_offset_at(sync, sample->local_us));
+            residual = error > residual ? error : residual;
+        }
+    }
+    sync->residual_us = residual > UINT32_MAX ? UINT32_MAX : (uint32_t)residual;
+}
+
+bool clock_sync_add(clock_sync *sync, uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+{
+    if (t3 < t0 || t2 < t1 || t2 - t1 > t3 - t0 || (t3 - t0) - (t2 - t1) > UINT32_MAX) {
+        return false;
+    }
+
+    clock_sync_sample sample = {
+        .local_us = t1 + (t2 - t1) / 2,
+        .offset_us = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2,
+        .round_trip_us = (uint32_t)((t3 - t0) - (t2 - t1)),
+    };
+    if (clock_sync_valid(sync) && abs64(sample.offset_us - clock_sync_offset_at(sync, sample.local_us)) > CLOCK_SYNC_MAX_STEP_US) {
+        clock_sync_reset(sync);
+    }
+
+    sync->samples[sync->next] = sample;
+    sync->next = (sync->next + 1) % CLOCK_SYNC_SAMPLES;
+    if (sync->count < CLOCK_SYNC_SAMPLES) {
+        sync->count++;
+    }
+    fit(sync);
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLOCK_SYNC_SAMPLES 8                // Exchanges the estimate is fitted on, the oldest ones are dropped
+#define CLOCK_SYNC_MAX_STEP_US 1000000      // A sample this far from the estimate restarts it: the remote clock was set
+#define CLOCK_SYNC_MIN_DRIFT_SPAN_US 10000000 // The drift is only estimated from samples at least this far apart
+
+/* One NTP-like exchange: the remote end sends at t0 and receives the reply at t3 on its clock, the device receives
+ * the request at t1 and replies at t2 on its own. */
+typedef struct
+{
+    uint64_t local_us;      // Middle of t1 and t2
+    int64_t offset_us;      // Local minus remote clock
+    uint32_t round_trip_us; // Network and scheduling time, the offset is uncertain by half of it
+} clock_sync_sample;
+
+/* Maps a remote clock, such as the browser's wall clock, onto the local one. It never reads a clock itself, so it can
+ * be run against simulated skewed clocks on a host. */
+typedef struct
+{
+    clock_sync_sample samples[CLOCK_SYNC_SAMPLES];
+    int count;
+    int next;
+    uint64_t reference_us;  // Local time at which 'offset_us' holds
+    int64_t offset_us;
+    int32_t drift_ppb;      // Change of the offset per local time, in parts per billion
+    uint32_t round_trip_us; // Shortest of the samples
+    uint32_t residual_us;   // Largest distance from a sample used by the estimate to the estimate
+} clock_sync;
+
+void clock_sync_reset(clock_sync *sync);
+
+/* Adds an exchange and fits the estimate again. Returns false, leaving the estimate as it was, if the timestamps are
+ * inconsistent. */
+bool clock_sync_add(clock_sync *sync, uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3);
+
+static inline bool clock_sync_valid(const clock_sync *sync)
+{
+    return sync->count > 0;
+}
+
+/* Worst error expected on a time converted by the estimate: the spread of the samples around it plus half the fastest
+ * round trip, which may be spent on either way. */
+static inline uint32_t clock_sync_uncertainty_us(const clock_sync *sync)
+{
+    return sync->residual_us + sync->round_trip_us / 2;
+}
+
+/* Local minus remote clock at 'local_us'. */
+int64_t clock_sync_offset_at(const clock_sync *sync, uint64_t local_us);
+
+/* Local time of a remote time. Only meaningful once valid. */
+uint64_t clock_sync_to_local(const clock_sync *sync, uint64_t remote_us);
+
+#endif
@@ -0,0 +1,135 @@
+#include "edge_log.h"
+
+#include <string.h>
+
+#include <hardware/sync.h>
+
+static struct
+{
+    volatile uint32_t session;
+    volatile uint32_t head;    // Records written in the session, the next one goes to head % EDGE_LOG_SIZE
+    volatile uint32_t max_us;
+    volatile uint32_t histogram[EDGE_LOG_BUCKETS];
+    edge_record ring[EDGE_LOG_SIZE];
+} s_Log;
+
+static inline int bucket_of(uint32_t error_us)
+{
+    int bucket = error_us ? 32 - __builtin_clz(error_us) : 0;
+    return bucket < EDGE_LOG_BUCKETS ? bucket : EDGE_LOG_BUCKETS - 1;
+}
+
+static inline uint32_t bucket_limit(int bucket)
+{
+    return 1u << bucket;
+}
+
+void edge_log_reset(void)
+{
+    s_Log.head = 0;
+    s_Log.max_us = 0;
+    for (int i = 0; i < EDGE_LOG_BUCKETS; i++) {
+        s_Log.histogram[i] = 0;
+    }
+    __dmb();
+    s_Log.session++;
+}
+
+void edge_log_record(uint64_t scheduled_us, uint64_t actual_us, uint16_t frame, bool open)
+{
+    int32_t late_us = (int32_t)(actual_us - scheduled_us);
+    uint32_t error_us = late_us < 0 ? -late_us : late_us;
+    uint32_t head = s_Log.head;
+
+    s_Log.ring[head % EDGE_LOG_SIZE] = (edge_record){
+        .scheduled_us = scheduled_us,
+        .late_us = late_us,
+        .frame = frame,
+        .open = open,
+    };
+    s_Log.histogram[bucket_of(error_us)]++;
+    if (error_us > s_Log.max_us) {
+        s_Log.max_us = error_us;
+    }
+
+    // Publish the record only once it is complete
+    __dmb();
+    s_Log.head = head + 1;
+}
+
+void edge_log_get_summary(edge_log_summary *summary)
+{
+    summary->session = s_Log.session;
+    summary->max_us = s_Log.max_us;
+    summary->edges = 0;
+    for (int i = 0; i < EDGE_LOG_BUCKETS; i++) {
+        summary->histogram[i] = s_Log.histogram[i];
+        summary->edges += summary->histogram[i];
+    }
+
+    // Percentiles from the copy, so they are consistent with the histogram reported along with them
+    uint32_t p50 = (summary->edges + 1) / 2, p99 = summary->edges - summary->edges / 100, seen = 0;
+    summary->p50_us = summary->p99_us = 0;
+    for (int i = 0; i < EDGE_LOG_BUCKETS && seen < p99; i++) {
+        seen += summary->histogram[i];
+        if (seen >= p50 && !summary->p50_us) {
+            summary->p50_us = bucket_limit(i);
+        }
+        if (seen >= p99) {
+            summary->p99_us = bucket_limit(i);
+        }
+    }
+
+    // The maximum is exact, bucket limits above it are not meaningful
+    if (summary->p50_us > summary->max_us) {
+        summary->p50_us = summary->max_us;
+    }
+    if (summary->p99_us > summary->max_us) {
+        summary->p99_us = summary->max_us;
+    }
+}
+
+int edge_log_read(uint32_t from, edge_record *dest, int max, uint32_t *first)
+{
+    uint32_t session = s_Log.session;
+    uint32_t head = s_Log.head;
+    __dmb();
+
+    uint32_t start = head > EDGE_LOG_SIZE ? head - EDGE_LOG_SIZE : 0;
+    if (from > start) {
+        start = from;
+    }
+    uint32_t end = head;
+    if (start >= end) {
+        *first = head;
+        return 0;
+    }
+    if (end - start > (uint32_t)max) {
+        end = start + max;
+    }
+
+    for (uint32_t i = start; i < end; i++) {
+        dest[i - start] = s_Log.ring[i % EDGE_LOG_SIZE];
+    }
+
+    // Records the interrupt overwrote while they were being copied are dropped
+    __dmb();
+    uint32_t now = s_Log.head;
+    if (s_Log.session != session || now < head) {
+        // A new session started in the meantime
+        *first = 0;
+        return 0;
+    }
+    uint32_t valid = now > EDGE_LOG_SIZE ? now - EDGE_LOG_SIZE : 0;
+    if (valid > start) {
+        if (valid >= end) {
+            *first = valid;
+            return 0;
+        }
+        memmove(dest, dest + (valid - start), (end - valid) * sizeof(*dest));
+        start = valid;
+    }
+
+    *first = start;
+    return end - start;
+}
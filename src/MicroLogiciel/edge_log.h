@@ -0,0 +1,44 @@
+#ifndef EDGE_LOG_H
+#define EDGE_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EDGE_LOG_SIZE 64 // Shutter transitions kept, a power of two
+#define EDGE_LOG_BUCKETS 24 // Bucket 0 counts errors under 1 us, bucket n errors in [2^(n-1), 2^n) us
+
+typedef struct
+{
+    uint64_t scheduled_us;  // Since boot
+    int32_t late_us;        // Actual time of the transition minus scheduled_us
+    uint16_t frame;
+    bool open;              // Shutter state after the transition
+} edge_record;
+
+typedef struct
+{
+    uint32_t session;       // Incremented by every edge_log_reset()
+    uint32_t edges;         // Transitions recorded in the session
+    uint32_t p50_us;        // Percentiles are upper bounds of the histogram bucket they fall in
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t histogram[EDGE_LOG_BUCKETS];
+} edge_log_summary;
+
+/* Records the timing error of every shutter transition, for the whole session and for the last EDGE_LOG_SIZE ones.
+ * There is a single writer, the shutter interrupt, and any number of lock-free readers: recording costs a store and
+ * a couple of increments, so it stays enabled. */
+
+/* Starts a new session. Must not race with edge_log_record(). */
+void edge_log_reset(void);
+
+void edge_log_record(uint64_t scheduled_us, uint64_t actual_us, uint16_t frame, bool open);
+
+void edge_log_get_summary(edge_log_summary *summary);
+
+/* Copies up to 'max' of the transitions still in the ring, starting with transition 'from' of the session or the oldest
+ * one kept, and returns how many were copied. 'first' receives the index of the first one copied, so the next call
+ * can continue from 'first' plus the count returned. */
+int edge_log_read(uint32_t from, edge_record *dest, int max, uint32_t *first);
+
+#endif
@@ -0,0 +1,242 @@
+#include "http_parser.h"
+
+#include <string.h>
+
+enum
+{
+    STATE_METHOD,
+    STATE_PATH,
+    STATE_QUERY,
+    STATE_VERSION,
+    STATE_REQUEST_LINE_LF,
+    STATE_HEADER_LINE_START,
+    STATE_HEADER_NAME,
+    STATE_HEADER_VALUE_START,
+    STATE_HEADER_VALUE,
+    STATE_HEADER_LF,
+    STATE_HEADERS_END_LF,
+    STATE_DONE,
+};
+
+#define HTTP_MAX_METHOD_LEN 7
+
+// Lower case, indexed by enum http_header_id
+static const struct
+{
+    const char *name;
+    uint8_t len;
+} s_Headers[HTTP_HEADER_COUNT] = {
+    { "host", 4 },
+    { "content-length", 14 },
+    { "connection", 10 },
+    { "accept-encoding", 15 },
+    { "if-none-match", 13 },
+    { "range", 5 },
+    { "upgrade", 7 },
+    { "sec-websocket-key", 17 },
+    { "transfer-encoding", 17 },
+};
+
+#define ALL_HEADERS ((1u << HTTP_HEADER_COUNT) - 1)
+
+// RFC 9110 token characters, as allowed in methods and header names
+static bool is_token_char(char c)
+{
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+
+    return c && strchr("!#$%&'*+-.^_`|~", c);
+}
+
+static bool is_control_char(char c)
+{
+    return (unsigned char)c < 0x20 || c == 0x7F;
+}
+
+void http_parser_init(http_parser *parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = STATE_METHOD;
+}
+
+http_parse_status http_parser_execute(http_parser *parser, char *buffer, int len)
+{
+    static const char version[] = "HTTP/1.";
+
+    for (; parser->pos < len && parser->state != STATE_DONE; parser->pos++) {
+        char c = buffer[parser->pos];
+        switch (parser->state) {
+        case STATE_METHOD:
+            if ((c == '\r' || c == '\n') && !parser->method_len) {
+                break; // Stray line breaks before a request are ignored (RFC 9112, 2.2)
+            }
+            if (c == ' ' && parser->method_len) {
+                buffer[parser->pos] = 0;
+                parser->method = buffer + parser->token_start;
+                parser->token_start = parser->pos + 1;
+                parser->state = STATE_PATH;
+                break;
+            }
+            if (!is_token_char(c) || parser->method_len == HTTP_MAX_METHOD_LEN) {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            if (!parser->method_len) {
+                parser->token_start = parser->pos;
+            }
+            parser->method_len++;
+            break;
+
+        case STATE_PATH:
+        case STATE_QUERY:
+            if (c == ' ' && parser->pos > parser->token_start) {
+                buffer[parser->pos] = 0;
+                if (parser->state == STATE_PATH) {
+                    parser->path = buffer + parser->token_start;
+                }
+                parser->token_start = parser->pos + 1;
+                parser->name_len = 0;
+                parser->state = STATE_VERSION;
+            } else if (c == '?' && parser->state == STATE_PATH && parser->pos > parser->token_start) {
+                buffer[parser->pos] = 0;
+                parser->path = buffer + parser->token_start;
+                parser->query = buffer + parser->pos + 1;
+                parser->state = STATE_QUERY;
+            } else if (c == ' ' || is_control_char(c)) {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            break;
+
+        case STATE_VERSION:
+            if (c == '\r' || c == '\n') {
+                if (parser->name_len != sizeof(version)) {
+                    return HTTP_PARSE_BAD_REQUEST;
+                }
+                parser->state = (c == '\r') ? STATE_REQUEST_LINE_LF : STATE_HEADER_LINE_START;
+                break;
+            }
+            if (parser->name_len < sizeof(version) - 1) {
+                if (c != version[parser->name_len]) {
+                    return HTTP_PARSE_BAD_REQUEST;
+                }
+            } else if (parser->name_len == sizeof(version) - 1 && c >= '0' && c <= '9') {
+                parser->http11 = (c == '1');
+            } else {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            parser->name_len++;
+            break;
+
+        case STATE_REQUEST_LINE_LF:
+        case STATE_HEADER_LF:
+            if (c != '\n') {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            parser->state = STATE_HEADER_LINE_START;
+            break;
+
+        case STATE_HEADERS_END_LF:
+            if (c != '\n') {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            parser->state = STATE_DONE;
+            break;
+
+        case STATE_HEADER_LINE_START:
+            if (c == '\r') {
+                parser->state = STATE_HEADERS_END_LF;
+                break;
+            }
+            if (c == '\n') {
+                parser->state = STATE_DONE;
+                break;
+            }
+            // Obsolete line folding (leading whitespace) is rejected along with other invalid characters
+            parser->candidates = ALL_HEADERS;
+            parser->name_len = 0;
+            parser->state = STATE_HEADER_NAME;
+            // fall through
+
+        case STATE_HEADER_NAME:
+            if (c == ':' && parser->name_len) {
+                parser->header = -1;
+                for (int i = 0; i < HTTP_HEADER_COUNT; i++) {
+                    if ((parser->candidates & (1u << i)) && s_Headers[i].len == parser->name_len) {
+                        parser->header = i;
+                    }
+                }
+                if (parser->header == HTTP_HEADER_CONTENT_LENGTH && parser->headers[HTTP_HEADER_CONTENT_LENGTH]) {
+                    return HTTP_PARSE_BAD_REQUEST; // Repeated Content-Length, the body boundary would be ambiguous
+                }
+                parser->state = STATE_HEADER_VALUE_START;
+                break;
+            }
+            if (!is_token_char(c)) {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            if (parser->candidates) {
+                char lower = (c >= 'A' && c <= 'Z') ? (c | 0x20) : c;
+                for (int i = 0; i < HTTP_HEADER_COUNT; i++) {
+                    if (parser->name_len >= s_Headers[i].len || s_Headers[i].name[parser->name_len] != lower) {
+                        parser->candidates &= ~(1u << i);
+                    }
+                }
+            }
+            if (parser->name_len < UINT8_MAX) {
+                parser->name_len++;
+            }
+            break;
+
+        case STATE_HEADER_VALUE_START:
+            if (c == ' ' || c == '\t') {
+                break;
+            }
+            parser->token_start = parser->value_end = parser->pos;
+            parser->state = STATE_HEADER_VALUE;
+            // fall through
+
+        case STATE_HEADER_VALUE:
+            if (c == '\r' || c == '\n') {
+                if (parser->header >= 0) {
+                    if (parser->header == HTTP_HEADER_CONTENT_LENGTH && parser->value_end == parser->token_start) {
+                        return HTTP_PARSE_BAD_REQUEST;
+                    }
+                    buffer[parser->value_end] = 0;
+                    parser->headers[parser->header] = buffer + parser->token_start;
+                }
+                parser->state = (c == '\r') ? STATE_HEADER_LF : STATE_HEADER_LINE_START;
+                break;
+            }
+            if (is_control_char(c) && c != '\t') {
+                return HTTP_PARSE_BAD_REQUEST;
+            }
+            if (c == ' ' || c == '\t') {
+                break; // Trailing whitespace is trimmed, value_end stays on the last visible character
+            }
+            if (parser->header == HTTP_HEADER_CONTENT_LENGTH) {
+                // Digits only, without inner spaces, and small enough to fit an int
+                if (c < '0' || c > '9' || parser->value_end != parser->pos || parser->content_length >= 100000000) {
+                    return HTTP_PARSE_BAD_REQUEST;
+                }
+                parser->content_length = parser->content_length * 10 + (c - '0');
+            }
+            parser->value_end = parser->pos + 1;
+            break;
+        }
+    }
+
+    if (parser->state != STATE_DONE) {
+        return HTTP_PARSE_INCOMPLETE;
+    }
+
+    // A chunked body would only be framed by Content-Length, if at all: the rest of it would be taken for the next request
+    if (parser->headers[HTTP_HEADER_TRANSFER_ENCODING]) {
+        return parser->headers[HTTP_HEADER_CONTENT_LENGTH] ? HTTP_PARSE_BAD_REQUEST : HTTP_PARSE_NOT_IMPLEMENTED;
+    }
+    return HTTP_PARSE_DONE;
+}
+
+http_parse_status http_parser_overflow_status(const http_parser *parser)
+{
+    return (parser->state <= STATE_VERSION) ? HTTP_PARSE_URI_TOO_LONG : HTTP_PARSE_HEADERS_TOO_LARGE;
+}
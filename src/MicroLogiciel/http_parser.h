@@ -0,0 +1,60 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum http_header_id
+{
+    HTTP_HEADER_HOST,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_RANGE,
+    HTTP_HEADER_UPGRADE,
+    HTTP_HEADER_SEC_WEBSOCKET_KEY,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_COUNT
+};
+
+typedef enum
+{
+    HTTP_PARSE_INCOMPLETE,          // Feed more data
+    HTTP_PARSE_DONE,                // Headers complete, the body (if any) starts at 'pos'
+    HTTP_PARSE_BAD_REQUEST,         // 400
+    HTTP_PARSE_URI_TOO_LONG,        // 414
+    HTTP_PARSE_HEADERS_TOO_LARGE,   // 431
+    HTTP_PARSE_NOT_IMPLEMENTED,     // 501, request bodies with a transfer coding are not supported
+} http_parse_status;
+
+/* Resumable request parser. The request is parsed in place: method, path, query and header values are
+ * null-terminated inside the caller's buffer, which must therefore stay untouched until the request is served.
+ * Each byte is examined once, so feeding the data in small segments costs no more than feeding it at once. */
+typedef struct
+{
+    uint8_t state;
+    bool http11;
+    uint8_t method_len;
+    uint16_t candidates;            // Headers of the table still matching the name being parsed
+    uint8_t name_len;
+    int8_t header;                  // Header whose value is being parsed, -1 for ignored ones
+    int pos;                        // Bytes consumed so far
+    int token_start;
+    int value_end;
+    uint32_t content_length;
+    char *method;                   // As sent, case-sensitive
+    char *path;
+    char *query;                    // NULL if the request has no query string
+    char *headers[HTTP_HEADER_COUNT]; // Trimmed values, NULL for missing headers
+} http_parser;
+
+void http_parser_init(http_parser *parser);
+
+/* Parses buffer[parser->pos .. len). 'buffer' must be the same on every call, with new data appended. */
+http_parse_status http_parser_execute(http_parser *parser, char *buffer, int len);
+
+/* Status to report when the buffer filled up before the headers were complete. */
+http_parse_status http_parser_overflow_status(const http_parser *parser);
+
+#endif
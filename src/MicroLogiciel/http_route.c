@@ -0,0 +1,25 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "httpserver.h"
+
+const http_route *http_route_find(const http_route *routes, int count, const char *path)
+{
+    int low = 0, high = count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(path, routes[mid].path);
+        if (!cmp) {
+            return &routes[mid];
+        }
+        
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    
+    return NULL;
+}
@@ -1,16 +1,75 @@
 #include <pico/cyw43_arch.h>
 #include <pico/stdlib.h>
 
+#include <lwip/api.h>
 #include <lwip/ip4_addr.h>
 #include <lwip/netif.h>
 #include <lwip/sockets.h>
+#include <lwip/priv/sockets_priv.h>
 
 #include <FreeRTOS.h>
+#include <queue.h>
 #include <semphr.h>
 #include <task.h>
 
 #include "debug_printf.h"
+#include "http_parser.h"
 #include "httpserver.h"
+#include "websocket.h"
+
+#ifndef HTTP_SERVER_PORT
+#define HTTP_SERVER_PORT 80 // Other ports are only used by the host tests
+#endif
+#define HTTP_KEEP_ALIVE_MAX_REQUESTS 100 // Requests served on a single connection before closing it
+// Connection and phase budgets, shortened by the host tests
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT_MS
+#define HTTP_KEEP_ALIVE_TIMEOUT_MS 3000 // Idle time after which a persistent connection gets closed
+#endif
+#ifndef HTTP_HEADER_TIMEOUT_MS
+#define HTTP_HEADER_TIMEOUT_MS 5000 // Budget for receiving the request line and headers, from their first byte
+#endif
+#ifndef HTTP_BODY_TIMEOUT_MS
+#define HTTP_BODY_TIMEOUT_MS 10000 // Budget for receiving the request body
+#endif
+#ifndef HTTP_SEND_TIMEOUT_MS
+#define HTTP_SEND_TIMEOUT_MS 5000 // Longest time a send may make no progress (client not reading, or out of range)
+#endif
+#define HTTP_WORKER_PRIORITY (tskIDLE_PRIORITY + 2)
+#define HTTP_PRIORITY_LANE_PRIORITY (tskIDLE_PRIORITY + 3) // Reserved worker, and priority routes served by any worker
+#define HTTP_WORKER_STACK_SIZE (configMINIMAL_STACK_SIZE * 2) // In words: the route handlers run on the worker stacks
+#define HTTP_CONNECTIONS_PER_WORKER 2 // Size of the connection context pool, relative to the worker count
+#ifndef HTTP_QUEUE_DEADLINE_MS
+#define HTTP_QUEUE_DEADLINE_MS 4000 // Accepted connections waiting longer than this for a worker get a 503
+#endif
+#define HTTP_IDLE_POLL_MS 50 // How often an idle persistent connection checks whether other connections wait for its worker
+
+#if HTTP_QUEUE_DEADLINE_MS <= HTTP_KEEP_ALIVE_TIMEOUT_MS
+#error Queued connections must be able to outlast an idle persistent connection holding their worker
+#endif
+#define HTTP_RETRY_AFTER "2" // Seconds, sent along with 503 replies
+
+#define HTTP_COUNT(counter) do { portENTER_CRITICAL(); (counter)++; portEXIT_CRITICAL(); } while (0)
+
+static const char s_ServiceUnavailable[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: " HTTP_RETRY_AFTER "\r\n"
+    "Content-Type: text/plain\r\nContent-Length: 5\r\nConnection: close\r\n\r\nBusy\n";
+
+#define HTTP_STATIC_COPY_LIMIT 1024 // Static files up to this size are copied, so that the reply fits a single segment
+#ifndef HTTP_STATIC_NOCOPY
+#define HTTP_STATIC_NOCOPY 1 // 0 copies the larger static files too, to compare the lwIP memory use of both paths
+#endif
+
+#define HTTP_CHUNK_HEADER_SIZE 6 // "%04x\r\n", enough for buffers up to 64 KB
+#define HTTP_REPLY_RESERVE 7 // Chunk trailer "\r\n" and last chunk "0\r\n\r\n"
+
+#define HTTP_WEBSOCKET_PING_INTERVAL_MS 10000 // Idle WebSockets get pinged, and closed if the ping stays unanswered
+
+// Phases of a request, each with its own receive deadline
+enum
+{
+    HTTP_PHASE_IDLE, // Waiting for the next request on a persistent connection
+    HTTP_PHASE_HEADER,
+    HTTP_PHASE_BODY,
+};
 
 struct _http_server_instance
 {
@@ -18,15 +77,47 @@ struct _http_server_instance
     int buffer_size;
     const char *hostname;
     const char *domain_name;
-    xSemaphoreHandle semaphore;
-    http_zone *first_zone;
+    QueueHandle_t connection_queue; // Accepted connections waiting for a worker
+    QueueHandle_t free_connections; // Connection contexts available to the accept loop
+    QueueHandle_t priority_queue; // Connection handed to the reserved worker, which only serves priority routes
+    int worker_count;
+    volatile int busy_workers; // Regular workers serving a connection
+    volatile http_server_stats stats;
+    const http_route *routes; // Sorted by path
+    int route_count;
+    http_request_handler fallback;
+    void *fallback_context;
 };
 
+struct _http_event_source
+{
+    xSemaphoreHandle mutex;
+    int max_subscribers;
+    int buffer_size;
+    char *buffer; // Last serialized event, shared by all subscribers
+    int sockets[1]; // Subscribed connections, or one of the HTTP_EVENT_SLOT_ values
+};
+
+#define HTTP_EVENT_SLOT_FREE -1
+#define HTTP_EVENT_SLOT_RESERVED -2 // Subscriber being sent the stream header, not published to yet
+
 struct _http_connection
 {
     http_server_instance server;
     int socket;
-    size_t buffered_size;
+    int request_count;
+    TickType_t accepted_at;
+    TickType_t deadline; // End of the receive budget of the current phase
+    int phase;
+    bool priority_lane; // Served by the reserved worker
+    int pending_request; // Size of a request already received and parsed into the buffer by the reserved worker, 0 if none
+    bool http11;
+    bool keep_alive;
+    bool head; // HEAD request: replies are sent without their body
+    http_parser request; // Points into the buffer, valid until the reply is written
+    bool chunked;
+    int chunk_start; // Offset of the current chunk's size line in the buffer
+    int buffered_size;
     struct {
         int buffer_used, buffer_pos;
         int remaining_input_len;
@@ -36,29 +127,36 @@ struct _http_connection
     char buffer[1];
 };
 
-// Receive at least one line into the buffer. Return the total size of received data.
-static int recv_line(int socket, char *buffer, int buffer_size)
+/* recv() bounded by the deadline of the current phase. A client trickling data in cannot extend it,
+ * as every call only gets the time left. Expired budgets are counted, except for idle persistent connections. */
+static int recv_before_deadline(http_connection ctx, void *buf, int len)
 {
-    int buffer_done = 0;
-    while (buffer_done < buffer_size) {
-        int done = recv(socket, buffer, buffer_size - buffer_done, 0);
-        if (done <= 0) {
-            return 0;
-        }
+    TickType_t now = xTaskGetTickCount();
+    int remaining_ms = (int)(ctx->deadline - now) * portTICK_PERIOD_MS;
+    if (remaining_ms > 0) {
+        struct timeval timeout = {
+            .tv_sec = remaining_ms / 1000,
+            .tv_usec = (remaining_ms % 1000) * 1000,
+        };
+        setsockopt(ctx->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
         
-        buffer_done += done;
-        char *p = strnstr(buffer, "\r\n", buffer_done);
-        if (p) {
-            return buffer_done;
+        int done = recv(ctx->socket, buf, len, 0);
+        if (done >= 0 || (errno != EWOULDBLOCK && errno != EAGAIN)) {
+            return done;
         }
     }
     
-    return 0;
+    if (ctx->phase == HTTP_PHASE_HEADER) {
+        HTTP_COUNT(ctx->server->stats.header_timeouts);
+    } else if (ctx->phase == HTTP_PHASE_BODY) {
+        HTTP_COUNT(ctx->server->stats.body_timeouts);
+    }
+    return -1;
 }
 
 // Read next line using the buffer (multiple lines can be buffered at once).
 // If the line was too long to fit into the buffer, returned length will be negative, but the next line will still get found correctly.
-static char *recv_next_line_buffered(int socket, char *buffer, int buffer_size, int *buffer_used, int *offset, int *len, int *recv_limit)
+static char *recv_next_line_buffered(http_connection ctx, char *buffer, int buffer_size, int *buffer_used, int *offset, int *len, int *recv_limit)
 {
     int skipped_len = 0;
     if (*offset > *buffer_used) {
@@ -103,7 +201,7 @@ static char *recv_next_line_buffered(int socket, char *buffer, int buffer_size,
             return NULL;
         }
         
-        int done = recv(socket, buffer + *buffer_used, buffer_avail, 0);
+        int done = recv_before_deadline(ctx, buffer + *buffer_used, buffer_avail);
         if (done <= 0) {
             return NULL;
         }
@@ -116,7 +214,7 @@ static char *recv_next_line_buffered(int socket, char *buffer, int buffer_size,
     }
 }
 
-static bool host_name_matches(http_connection ctx, char *host)
+static bool host_name_matches(http_connection ctx, const char *host)
 {
     int len = strlen(ctx->server->hostname);
     if (strncasecmp(host, ctx->server->hostname, len)) {
@@ -134,7 +232,46 @@ static bool host_name_matches(http_connection ctx, char *host)
     return false;
 }
 
-static bool send_all(int socket, const char *buf, int size)
+// Check whether a comma-separated header value (Accept-Encoding, Connection...) lists the given token.
+// A '*' entry matches any token and a zero q-value refuses it.
+static bool header_has_token(const char *list, const char *coding)
+{
+    int coding_len = strlen(coding);
+    while (*list) {
+        while (*list == ' ' || *list == ',') {
+            list++;
+        }
+        
+        const char *token = list;
+        while (*list && *list != ',' && *list != ';' && *list != ' ') {
+            list++;
+        }
+        
+        int len = list - token;
+        bool matches = (len == coding_len && !strncasecmp(token, coding, len)) || (len == 1 && *token == '*');
+        bool refused = false;
+        for (; *list && *list != ','; list++) {
+            if ((*list == 'q' || *list == 'Q') && list[1] == '=') {
+                const char *q = list + 2;
+                refused = (*q == '0');
+                while (*q == '0' || *q == '.') {
+                    q++;
+                }
+                if (*q >= '1' && *q <= '9') {
+                    refused = false;
+                }
+            }
+        }
+        
+        if (matches && !refused) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+static bool send_all(http_connection conn, const char *buf, int size)
 {
     while (size > 0) {
 #if MEM_SIZE < 16384
@@ -157,8 +294,11 @@ static bool send_all(int socket, const char *buf, int size)
          */
 #error Too little memory allocated for lwIP buffers.
 #endif
-        int done = send(socket, buf, size, 0);
+        int done = send(conn->socket, buf, size, 0);
         if (done <= 0) {
+            if (done < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+                HTTP_COUNT(conn->server->stats.send_timeouts);
+            }
             return false;
         }
         
@@ -169,85 +309,252 @@ static bool send_all(int socket, const char *buf, int size)
     return true;
 }
 
+/* Send data that stays in place for the lifetime of the firmware, such as the memory-mapped file system.
+ * lwIP queues references to it instead of copying it into MEM_SIZE buffers, and the netconn
+ * resumes the write from its sent callback as the client acknowledges data.
+ *
+ * The references outlive the call: they sit in the unsent and unacked queues of the TCP pcb until the client
+ * acknowledges them, are read again by retransmissions, and stay queued after the socket is closed, as the pcb
+ * lingers in FIN_WAIT/LAST_ACK until the peer acknowledges or the pcb is aborted. The data must therefore never be
+ * modified or freed, which only holds for the file system image: the flash writes of the settings erase their own
+ * sectors, never those of the image. The lwip_sock returned by the debug accessor is not reference counted; it stays
+ * valid because the socket is only closed by the worker calling this. */
+static bool send_all_nocopy(http_connection conn, const void *buf, int size)
+{
+    struct lwip_sock *sock = HTTP_STATIC_NOCOPY ? lwip_socket_dbg_get_socket(conn->socket) : NULL;
+    if (!sock || !sock->conn) {
+        return send_all(conn, buf, size);
+    }
+    
+    const char *p = buf;
+    while (size > 0) {
+        size_t done = 0;
+        err_t err = netconn_write_partly(sock->conn, p, size, NETCONN_NOCOPY, &done);
+        if (err != ERR_OK || !done) {
+            if (err == ERR_WOULDBLOCK) {
+                HTTP_COUNT(conn->server->stats.send_timeouts); // SO_SNDTIMEO also applies to the netconn
+            }
+            return false;
+        }
+        
+        p += done;
+        size -= done;
+    }
+    
+    return true;
+}
+
 static inline void append(char *buf, int *offset, const char *data, int len)
 {
     memcpy(buf + *offset, data, len);
     *offset += len;
 }
 
-static void parse_and_handle_http_request(http_connection ctx)
+static const char *connection_header(http_connection conn)
 {
-    int len = recv_line(ctx->socket, ctx->buffer, ctx->server->buffer_size);
-    char *path = NULL;
-    char *header_buf = NULL;
-    int header_buf_size = 0, header_buf_pos = 0, header_buf_used = 0;
-    char host[32];
-    host[0] = 0;
-    enum http_request_type reqtype = HTTP_GET;
-    ctx->post.remaining_input_len = ctx->post.buffer_used = ctx->post.buffer_pos = 0;
-    
-    if (len) {
-        // Expected request format: GET <path> HTTP/1.0
-        char *p1 = strchr(ctx->buffer, ' '), *p2 = NULL, *p3 = NULL;
-        if (p1) {
-            p2 = strchr(++p1, ' ');
+    return conn->keep_alive ? "keep-alive" : "close";
+}
+
+// Read and discard the part of the request body that the handler did not consume.
+static bool discard_request_body(http_connection ctx)
+{
+    while (ctx->post.remaining_input_len > 0) {
+        int done = recv_before_deadline(ctx, ctx->buffer, MIN(ctx->post.remaining_input_len, ctx->server->buffer_size));
+        if (done <= 0) {
+            return false;
         }
         
-        if (!strncasecmp(ctx->buffer, "POST ", 5)) {
-            reqtype = HTTP_POST;
+        ctx->post.remaining_input_len -= done;
+    }
+    
+    return true;
+}
+
+// Methods defined by RFC 9110 that no handler serves, answered with a 405 rather than a 501
+static bool is_standard_method(const char *method)
+{
+    static const char *const methods[] = { "PUT", "DELETE", "OPTIONS", "PATCH", "TRACE", "CONNECT" };
+    for (int i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++) {
+        if (!strcmp(method, methods[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 'route' is NULL for the fallback, which serves files
+static void send_method_not_allowed(http_connection ctx, const http_route *route)
+{
+    static const char *const names[HTTP_REQUEST_TYPE_COUNT] = { [HTTP_GET] = "GET, HEAD", [HTTP_POST] = "POST" };
+    char allow[32] = "Allow: ";
+    for (int i = 0; i < HTTP_REQUEST_TYPE_COUNT; i++) {
+        if (route ? route->handlers[i] != NULL : i == HTTP_GET) {
+            if (allow[7]) {
+                strcat(allow, ", ");
+            }
+            strcat(allow, names[i]);
+        }
+    }
+    strcat(allow, "\r\n");
+    
+    http_server_send_reply_with_headers(ctx, "405 Method Not Allowed", "text/plain", allow, "Method not allowed", -1);
+}
+
+/* Waits for the next request on a persistent connection. Returns false if the client stays idle past the keep-alive
+ * timeout, or as soon as other connections are waiting for a worker: an idle client is cheaper to reconnect than
+ * a queued one is to turn away. */
+static bool wait_next_request(http_connection ctx)
+{
+    for (;;) {
+        if (uxQueueMessagesWaiting(ctx->server->connection_queue)) {
+            return false;
         }
         
-        if (p2) {
-            p3 = strstr(p2, "\r\n");
+        int remaining_ms = (int)(ctx->deadline - xTaskGetTickCount()) * portTICK_PERIOD_MS;
+        if (remaining_ms <= 0) {
+            return false;
         }
         
-        if (p3) {
-            path = p1;
-            *p2 = 0;
-            
-            int off = p3 + 2 - ctx->buffer;
-            header_buf = ctx->buffer + off;
-            header_buf_size = ctx->server->buffer_size - off;
-            header_buf_used = len - off;
+        remaining_ms = MIN(remaining_ms, HTTP_IDLE_POLL_MS);
+        struct timeval timeout = {
+            .tv_sec = remaining_ms / 1000,
+            .tv_usec = (remaining_ms % 1000) * 1000,
+        };
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(ctx->socket, &readable);
+        int ready = select(ctx->socket + 1, &readable, NULL, NULL, &timeout);
+        if (ready != 0) {
+            return ready > 0; // Data, or the client closed the connection: recv() tells which
         }
     }
-    
-    if (!header_buf || header_buf_size < 32) {
-        debug_printf("HTTP: invalid first line");
-        return;
-    }
-    
+}
+
+// Receive the request line and headers into the buffer, feeding the parser with each segment as it arrives.
+static http_parse_status recv_request_head(http_connection ctx, int *buffer_used)
+{
+    http_parser_init(&ctx->request);
+    *buffer_used = 0;
+    ctx->phase = HTTP_PHASE_IDLE;
+    ctx->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(HTTP_KEEP_ALIVE_TIMEOUT_MS);
     for (;;) {
-        char *line = recv_next_line_buffered(ctx->socket, header_buf, header_buf_size, &header_buf_used, &header_buf_pos, &len, NULL);
-        if (!line) {
-            debug_printf("HTTP: unexpected end of headers");
-            return;
+        if (*buffer_used == ctx->server->buffer_size) {
+            return http_parser_overflow_status(&ctx->request);
         }
         
-        if (!line[0]) {
-            break; // Proper end of headers
+        if (ctx->phase == HTTP_PHASE_IDLE && ctx->request_count && !wait_next_request(ctx)) {
+            return HTTP_PARSE_INCOMPLETE;
         }
         
-        if (len > 0 && !strncasecmp(line, "Host: ", 6) && (len - 6) < (sizeof(host) - 1)) {
-            memcpy(host, line + 6, len - 6);
-            host[len - 6] = 0;
-        } else if (!strncasecmp(line, "Content-length: ", 16)) {
-            ctx->post.remaining_input_len = atoi(line + 16);
+        int done = recv_before_deadline(ctx, ctx->buffer + *buffer_used, ctx->server->buffer_size - *buffer_used);
+        if (done <= 0) {
+            return HTTP_PARSE_INCOMPLETE;
+        }
+        
+        if (ctx->phase == HTTP_PHASE_IDLE) {
+            // The header budget starts with the first byte, so slow clients cannot hold the worker with a trickle
+            ctx->phase = HTTP_PHASE_HEADER;
+            ctx->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(HTTP_HEADER_TIMEOUT_MS);
+        }
+        
+        *buffer_used += done;
+        http_parse_status status = http_parser_execute(&ctx->request, ctx->buffer, *buffer_used);
+        if (status != HTTP_PARSE_INCOMPLETE) {
+            return status;
         }
     }
+}
+
+// Handle a single request. Returns true if the connection can be reused for the next one.
+static bool parse_and_handle_http_request(http_connection ctx)
+{
+    int buffer_used;
+    ctx->http11 = false;
+    ctx->keep_alive = false;
+    ctx->head = false;
+    ctx->post.remaining_input_len = ctx->post.buffer_used = ctx->post.buffer_pos = 0;
+    
+    http_parse_status status;
+    if (ctx->pending_request) {
+        // Handed over by the reserved worker, the parser state still describes the buffer
+        buffer_used = ctx->pending_request;
+        ctx->pending_request = 0;
+        status = HTTP_PARSE_DONE;
+    } else {
+        status = recv_request_head(ctx, &buffer_used);
+    }
+    if (status == HTTP_PARSE_INCOMPLETE) {
+        return false; // Connection closed by the client, or idle for too long
+    }
+    
+    if (status != HTTP_PARSE_DONE) {
+        // The rest of the request is not read, the connection gets closed after the error
+        static const char *const codes[] = {
+            [HTTP_PARSE_BAD_REQUEST] = "400 Bad Request",
+            [HTTP_PARSE_URI_TOO_LONG] = "414 URI Too Long",
+            [HTTP_PARSE_HEADERS_TOO_LARGE] = "431 Request Header Fields Too Large",
+            [HTTP_PARSE_NOT_IMPLEMENTED] = "501 Not Implemented",
+        };
+        debug_printf("HTTP: invalid request (%s)\n", codes[status]);
+        http_server_send_reply(ctx, codes[status], "text/plain", codes[status], -1);
+        return false;
+    }
+    
+    http_parser *request = &ctx->request;
+    char *path = request->path;
+    const char *host = request->headers[HTTP_HEADER_HOST] ? request->headers[HTTP_HEADER_HOST] : "";
+    const char *connection = request->headers[HTTP_HEADER_CONNECTION];
+    int content_length = request->content_length;
+    
+    // HTTP/1.1 connections are persistent by default, HTTP/1.0 ones need "Connection: keep-alive"
+    ctx->http11 = request->http11;
+    ctx->keep_alive = ctx->http11;
+    if (connection && header_has_token(connection, "close")) {
+        ctx->keep_alive = false;
+    } else if (connection && header_has_token(connection, "keep-alive")) {
+        ctx->keep_alive = true;
+    }
+    
+    int buffered_body = buffer_used - request->pos;
+    if (buffered_body > content_length) {
+        ctx->keep_alive = false; // Pipelined requests are not supported, serve this one and close
+    }
+    
+    if (++ctx->request_count >= HTTP_KEEP_ALIVE_MAX_REQUESTS) {
+        ctx->keep_alive = false;
+    }
     
-    if (reqtype == HTTP_POST && ctx->post.remaining_input_len) {
-        ctx->post.buffer_pos = header_buf_pos;
-        ctx->post.buffer_used = header_buf_used;
-        ctx->post.remaining_input_len -= (header_buf_used - header_buf_pos);
-        ctx->post.offset_from_main_buffer = header_buf - ctx->buffer;
+    if (uxQueueMessagesWaiting(ctx->server->connection_queue)) {
+        ctx->keep_alive = false; // Other clients are waiting for a worker, do not hold this one for an idle connection
+    }
+    if (ctx->priority_lane) {
+        ctx->keep_alive = false; // The reserved worker waits for the next control request, not for this client
+    }
+    
+    ctx->phase = HTTP_PHASE_BODY;
+    ctx->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(HTTP_BODY_TIMEOUT_MS);
+    if (content_length) {
+        // The body is read past the headers, which stay available to the handler
+        ctx->post.offset_from_main_buffer = request->pos;
+        ctx->post.buffer_pos = 0;
+        ctx->post.buffer_used = MIN(buffered_body, content_length);
+        ctx->post.remaining_input_len = content_length - ctx->post.buffer_used;
     }
     
-    debug_printf("HTTP: %s%s\n", host, path);
+    // HEAD is served by the GET handlers, the body of their reply is left out. Other methods have no handler.
+    enum http_request_type reqtype = HTTP_REQUEST_TYPE_COUNT;
+    ctx->head = !strcmp(request->method, "HEAD");
+    if (ctx->head || !strcmp(request->method, "GET")) {
+        reqtype = HTTP_GET;
+    } else if (!strcmp(request->method, "POST")) {
+        reqtype = HTTP_POST;
+    }
+    
+    debug_printf("HTTP: %s %s%s\n", request->method, host, path);
     
     if (!host_name_matches(ctx, host)) {
-        static const char header[] = "HTTP/1.0 302 Found\r\nLocation: http://";
-        static const char footer[] = "\r\nConnection: Close\r\n\r\n";
+        static const char header[] = "HTTP/1.1 302 Found\r\nLocation: http://";
+        static const char footer[] = "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
         int host_len = strlen(ctx->server->hostname), domain_len = strlen(ctx->server->domain_name);
         
         int len = sizeof(header) + sizeof(footer) + host_len + domain_len + 2;
@@ -260,37 +567,135 @@ static void parse_and_handle_http_request(http_connection ctx)
                 append(ctx->buffer, &off, ctx->server->domain_name, domain_len);
             }
             append(ctx->buffer, &off, footer, sizeof(footer) - 1);
-            send_all(ctx->socket, ctx->buffer, off);
+            send_all(ctx, ctx->buffer, off);
         }
-    } else {
-        for (http_zone *zone = ctx->server->first_zone; zone; zone = zone->next) {
-            if (strncasecmp(path, zone->prefix, zone->prefix_len))
-                continue;
-            
-            int off = zone->prefix_len;
-            if (path[off] == 0 || path[off] == '/') {
-                while (path[off] == '/') {
-                    off++;
-                }
-                
-                if (zone->handler(ctx, reqtype, path + off, zone->context)) {
-                    return;
-                }
-            }
+        return false;
+    }
+    
+    bool handled = false;
+    const http_route *route = http_route_find(ctx->server->routes, ctx->server->route_count, path);
+    if (ctx->priority_lane && !(route && route->priority)) {
+        // The reserved worker must stay available, everything else waits for a regular one, see serve_connection()
+        ctx->pending_request = buffer_used;
+        ctx->request_count--;
+        return false;
+    }
+    
+    if (reqtype == HTTP_REQUEST_TYPE_COUNT) {
+        if (is_standard_method(request->method)) {
+            send_method_not_allowed(ctx, route);
+        } else {
+            http_server_send_reply(ctx, "501 Not Implemented", "text/plain", "Method not implemented", -1);
+        }
+        return ctx->keep_alive && discard_request_body(ctx);
+    }
+    
+    if (route && route->handlers[reqtype] && route->priority && !ctx->priority_lane) {
+        // Runs ahead of the workers busy with static downloads
+        vTaskPrioritySet(NULL, HTTP_PRIORITY_LANE_PRIORITY);
+        handled = route->handlers[reqtype](ctx, reqtype, path, route->context);
+        vTaskPrioritySet(NULL, HTTP_WORKER_PRIORITY);
+    } else if (route && route->handlers[reqtype]) {
+        handled = route->handlers[reqtype](ctx, reqtype, path, route->context);
+    } else if (route) {
+        send_method_not_allowed(ctx, route);
+        handled = true;
+    } else if (ctx->server->fallback) {
+        char *file = path;
+        while (*file == '/') {
+            file++;
         }
         
-        http_server_send_reply(ctx, "404 Not Found", "text/plain", "File not found", "close", -1);
+        handled = ctx->server->fallback(ctx, reqtype, file, ctx->server->fallback_context);
+    }
+    
+    if (!handled) {
+        http_server_send_reply(ctx, "404 Not Found", "text/plain", "File not found", -1);
+    }
+    
+    return ctx->keep_alive && discard_request_body(ctx);
+}
+
+// Turn a connection away without reading its request. Nothing here may block the caller.
+static void reject_connection(int socket)
+{
+    send(socket, s_ServiceUnavailable, sizeof(s_ServiceUnavailable) - 1, MSG_DONTWAIT);
+    
+    // Unread data would make the close reset the connection, possibly before the client reads the reply
+    char discard[64];
+    while (recv(socket, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+    closesocket(socket);
+}
+
+static void serve_connection(http_server_instance server, http_connection ctx)
+{
+    if (xTaskGetTickCount() - ctx->accepted_at > pdMS_TO_TICKS(HTTP_QUEUE_DEADLINE_MS)) {
+        // The client has most likely given up or retried already
+        HTTP_COUNT(server->stats.queue_expired);
+        reject_connection(ctx->socket);
+        ctx->socket = -1;
+        ctx->pending_request = 0; // A request handed over by the reserved worker dies with its connection
+    } else {
+        // Receive timeouts follow the phase deadlines, see recv_before_deadline()
+        struct timeval timeout = {
+            .tv_sec = HTTP_SEND_TIMEOUT_MS / 1000,
+            .tv_usec = (HTTP_SEND_TIMEOUT_MS % 1000) * 1000,
+        };
+        setsockopt(ctx->socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        if (!ctx->pending_request) {
+            ctx->request_count = 0;
+        }
+        while (parse_and_handle_http_request(ctx)) {
+        }
+    }
+    
+    if (ctx->pending_request && ctx->socket >= 0) {
+        // A regular request that reached the reserved worker goes back to the regular workers along with its parsed head
+        ctx->priority_lane = false;
+        HTTP_COUNT(server->stats.queued);
+        if (xQueueSend(server->connection_queue, &ctx, 0) == pdTRUE) {
+            return;
+        }
+        ctx->pending_request = 0;
+        send_all(ctx, s_ServiceUnavailable, sizeof(s_ServiceUnavailable) - 1);
+    }
+    
+    if (ctx->socket >= 0) {
+        closesocket(ctx->socket); // Otherwise the socket was handed over, e.g. to an event source
+    }
+    
+    ctx->socket = -1;
+    xQueueSend(server->free_connections, &ctx, portMAX_DELAY);
+}
+
+static void http_worker_thread(void *arg)
+{
+    http_server_instance server = (http_server_instance)arg;
+    
+    while (true) {
+        http_connection ctx;
+        if (xQueueReceive(server->connection_queue, &ctx, portMAX_DELAY) == pdTRUE) {
+            HTTP_COUNT(server->busy_workers);
+            serve_connection(server, ctx);
+            portENTER_CRITICAL();
+            server->busy_workers--;
+            portEXIT_CRITICAL();
+        }
     }
 }
 
-static void do_handle_connection(void *arg)
+static void http_priority_worker_thread(void *arg)
 {
-    http_connection ctx = (http_connection)arg;
-    parse_and_handle_http_request(ctx);
-    closesocket(ctx->socket);
-    vPortFree(ctx);
-    xSemaphoreGive(ctx->server->semaphore);
-    vTaskDelete(NULL);
+    http_server_instance server = (http_server_instance)arg;
+    
+    while (true) {
+        http_connection ctx;
+        if (xQueueReceive(server->priority_queue, &ctx, portMAX_DELAY) == pdTRUE) {
+            serve_connection(server, ctx);
+        }
+    }
 }
 
 static void http_server_thread(void *arg)
@@ -301,24 +706,37 @@ static void http_server_thread(void *arg)
         struct sockaddr_storage remote_addr;
         socklen_t len = sizeof(remote_addr);
         int conn_sock = accept(sctx->socket, (struct sockaddr *)&remote_addr, &len);
-        if (conn_sock >= 0) {
-            http_connection cctx = pvPortMalloc(sizeof(struct _http_connection) + sctx->buffer_size);
-            if (cctx) {
-                cctx->server = sctx;
-                cctx->socket = conn_sock;
-                TaskHandle_t task;
-                xSemaphoreTake(sctx->semaphore, portMAX_DELAY);
-                if (xTaskCreate(do_handle_connection, "HTTP Connection", configMINIMAL_STACK_SIZE, cctx, tskIDLE_PRIORITY + 2, &task) != pdTRUE) {
-                    vPortFree(cctx);
-                    xSemaphoreGive(sctx->semaphore);
-                    cctx = NULL;
-                }
-            }
-            
-            if (!cctx) {
-                closesocket(conn_sock);
+        if (conn_sock < 0) {
+            continue;
+        }
+        
+        // Admission control: the accept loop never blocks, so that every client gets an answer quickly
+        http_connection conn;
+        if (xQueueReceive(sctx->free_connections, &conn, 0) != pdTRUE) {
+            sctx->stats.pool_exhausted++;
+            reject_connection(conn_sock);
+            continue;
+        }
+        
+        sctx->stats.pool_hits++;
+        conn->socket = conn_sock;
+        conn->accepted_at = xTaskGetTickCount();
+        conn->priority_lane = false;
+        conn->pending_request = 0;
+        
+        /* With all regular workers busy (e.g. with static downloads), the connection goes to the reserved worker if it is free.
+         * The request is only known once parsed: if it is not for a priority route, the reserved worker queues it for a regular one. */
+        bool workers_busy = sctx->busy_workers + (int)uxQueueMessagesWaiting(sctx->connection_queue) >= sctx->worker_count;
+        if (workers_busy) {
+            conn->priority_lane = true;
+            if (xQueueSend(sctx->priority_queue, &conn, 0) == pdTRUE) {
+                continue;
             }
+            conn->priority_lane = false;
+            HTTP_COUNT(sctx->stats.queued); // No worker will be free right away, and the workers count re-queued connections too
         }
+        
+        xQueueSend(sctx->connection_queue, &conn, portMAX_DELAY);
     }
 }
 
@@ -328,8 +746,8 @@ http_server_instance http_server_create(const char *main_host, const char *main_
     struct sockaddr_in listen_addr = {
         .sin_len = sizeof(struct sockaddr_in),
         .sin_family = AF_INET,
-        .sin_port = htons(80),
-        .sin_addr = 0,
+        .sin_port = htons(HTTP_SERVER_PORT),
+        .sin_addr = { 0 },
     };
     
     if (server_sock < 0) {
@@ -337,6 +755,12 @@ http_server_instance http_server_create(const char *main_host, const char *main_
         return NULL;
     }
     
+    if (buffer_size > 0xFFFF) {
+        closesocket(server_sock);
+        debug_printf("HTTP buffer too large for the chunk size lines: %d\n", buffer_size);
+        return NULL;
+    }
+    
     if (bind(server_sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0) {
         closesocket(server_sock);
         debug_printf("Unable to bind HTTP socket: error %d\n", errno);
@@ -355,82 +779,583 @@ http_server_instance http_server_create(const char *main_host, const char *main_
         return NULL;
     }
     
+    /* All connection contexts come from a single allocation made here. Contexts are recycled without being cleared:
+     * every field is set up again when a request gets parsed. Twice as many contexts as workers let accepted
+     * connections wait for a worker with their buffer ready. */
+    int pool_size = max_thread_count * HTTP_CONNECTIONS_PER_WORKER;
+    int stride = (sizeof(struct _http_connection) + buffer_size + 3) & ~3;
+    char *pool = pvPortMalloc(stride * pool_size);
+    ctx->connection_queue = xQueueCreate(pool_size, sizeof(http_connection));
+    ctx->free_connections = xQueueCreate(pool_size, sizeof(http_connection));
+    ctx->priority_queue = xQueueCreate(1, sizeof(http_connection));
+    if (!pool || !ctx->connection_queue || !ctx->free_connections || !ctx->priority_queue) {
+        debug_printf("Unable to allocate %d HTTP connections\n", pool_size);
+        if (ctx->connection_queue) {
+            vQueueDelete(ctx->connection_queue);
+        }
+        if (ctx->free_connections) {
+            vQueueDelete(ctx->free_connections);
+        }
+        if (ctx->priority_queue) {
+            vQueueDelete(ctx->priority_queue);
+        }
+        vPortFree(pool);
+        vPortFree(ctx);
+        closesocket(server_sock);
+        return NULL;
+    }
+    
     ctx->socket = server_sock;
-    ctx->semaphore = xSemaphoreCreateCounting(max_thread_count, max_thread_count);
     ctx->hostname = main_host;
     ctx->domain_name = main_domain;
     ctx->buffer_size = buffer_size;
-    ctx->first_zone = NULL;
+    ctx->routes = NULL;
+    ctx->route_count = 0;
+    ctx->fallback = NULL;
+    ctx->fallback_context = NULL;
+    memset((void *)&ctx->stats, 0, sizeof(ctx->stats));
+    
+    for (int i = 0; i < pool_size; i++) {
+        http_connection cctx = (http_connection)(pool + i * stride);
+        cctx->server = ctx;
+        cctx->socket = -1;
+        xQueueSend(ctx->free_connections, &cctx, 0);
+    }
+    
+    ctx->worker_count = 0;
+    ctx->busy_workers = 0;
     
     TaskHandle_t task;
-    xTaskCreate(http_server_thread, "HTTP Server", configMINIMAL_STACK_SIZE, ctx, tskIDLE_PRIORITY + 2, &task);
+    for (int i = 0; i < max_thread_count; i++) {
+        if (xTaskCreate(http_worker_thread, "HTTP Worker", HTTP_WORKER_STACK_SIZE, ctx, HTTP_WORKER_PRIORITY, &task) != pdTRUE) {
+            debug_printf("Unable to create HTTP worker %d\n", i);
+            break;
+        }
+        ctx->worker_count++;
+    }
+    
+    if (xTaskCreate(http_priority_worker_thread, "HTTP Priority", HTTP_WORKER_STACK_SIZE, ctx, HTTP_PRIORITY_LANE_PRIORITY, &task) != pdTRUE) {
+        debug_printf("Unable to create the HTTP priority worker\n");
+    }
+    
+    xTaskCreate(http_server_thread, "HTTP Server", configMINIMAL_STACK_SIZE, ctx, HTTP_WORKER_PRIORITY, &task);
     return ctx;
 }
 
-void http_server_add_zone(http_server_instance server, http_zone *zone, const char *prefix, http_request_handler handler, void *context)
+void http_server_get_stats(http_server_instance server, http_server_stats *stats)
+{
+    *stats = *(const http_server_stats *)&server->stats;
+}
+
+bool http_server_set_routes(http_server_instance server, const http_route *routes, int route_count, http_request_handler fallback, void *fallback_context)
+{
+    for (int i = 1; i < route_count; i++) {
+        if (strcmp(routes[i - 1].path, routes[i].path) >= 0) {
+            debug_printf("HTTP: route table is not sorted at %s\n", routes[i].path);
+            return false;
+        }
+    }
+    
+    server->fallback = fallback;
+    server->fallback_context = fallback_context;
+    server->routes = routes;
+    server->route_count = route_count;
+    return true;
+}
+
+void http_server_send_reply(http_connection conn, const char *code, const char *contentType, const char *content, int size)
+{
+    http_server_send_reply_with_headers(conn, code, contentType, NULL, content, size);
+}
+
+// Fixed parts of the reply head, sent along with the variable ones in a single vectored write
+static const char s_StatusPrefix[] = "HTTP/1.1 ";
+static const char s_ContentTypePrefix[] = "\r\nContent-Type: ";
+static const char s_ContentLengthPrefix[] = "\r\nContent-Length: ";
+static const char s_KeepAliveTail[] = "Connection: keep-alive\r\n\r\n";
+static const char s_CloseTail[] = "Connection: close\r\n\r\n";
+static const char s_NotModifiedStatus[] = "HTTP/1.1 304 Not Modified\r\n";
+
+#define IOV_CONST(str) ((struct iovec){ .iov_base = (void *)(str), .iov_len = sizeof(str) - 1 })
+#define IOV_STRING(str) ((struct iovec){ .iov_base = (void *)(str), .iov_len = (str) ? strlen(str) : 0 })
+
+#define HTTP_REPLY_HEAD_VECTORS 9
+
+static struct iovec connection_tail(http_connection conn)
+{
+    return conn->keep_alive ? IOV_CONST(s_KeepAliveTail) : IOV_CONST(s_CloseTail);
+}
+
+// Write 'value' followed by CRLF so that it ends at 'end'. Returns the first character.
+static char *format_content_length(char *end, unsigned value)
+{
+    *--end = '\n';
+    *--end = '\r';
+    do {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+// Fill 'iov' with the status line and headers of a reply. 'length_buf' holds the formatted Content-Length.
+static int build_reply_head(http_connection conn, struct iovec *iov, char *length_buf, int length_buf_size, const char *code, const char *contentType, const char *headers, int size)
+{
+    char *length = format_content_length(length_buf + length_buf_size, size);
+    int count = 0;
+    iov[count++] = IOV_CONST(s_StatusPrefix);
+    iov[count++] = IOV_STRING(code);
+    iov[count++] = IOV_CONST(s_ContentTypePrefix);
+    iov[count++] = IOV_STRING(contentType);
+    iov[count++] = IOV_CONST(s_ContentLengthPrefix);
+    iov[count++] = (struct iovec){ .iov_base = length, .iov_len = length_buf + length_buf_size - length };
+    iov[count++] = IOV_STRING(headers);
+    iov[count++] = connection_tail(conn);
+    return count;
+}
+
+// Send all vectors with as few writes (and TCP segments) as possible
+static bool send_vectors(http_connection conn, struct iovec *iov, int count)
 {
-    zone->next = server->first_zone;
-    zone->prefix = prefix;
-    zone->prefix_len = strlen(prefix);
-    zone->handler = handler;
-    zone->context = context;
-    server->first_zone = zone;
+    // Empty vectors (no extra headers, empty body) are dropped rather than handed to lwIP
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        if (iov[i].iov_len) {
+            iov[used++] = iov[i];
+        }
+    }
+    count = used;
+    
+    while (count > 0) {
+        int done = lwip_writev(conn->socket, iov, count);
+        if (done <= 0) {
+            if (done < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+                HTTP_COUNT(conn->server->stats.send_timeouts);
+            }
+            return false;
+        }
+        
+        // A partial write can stop in the middle of a vector
+        while (count > 0 && done >= (int)iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+    
+    return true;
 }
 
-void http_server_send_reply(http_connection conn, const char *code, const char *contentType, const char *content, const char *connexion, int size)
+void http_server_send_reply_with_headers(http_connection conn, const char *code, const char *contentType, const char *headers, const char *content, int size)
 {
     if (size < 0) {
         size = strlen(content);
     }
     
-    int done = snprintf(conn->buffer, conn->server->buffer_size, "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n", code, contentType, size, connexion);
-    send_all(conn->socket, conn->buffer, done);
-    send_all(conn->socket, content, size);
+    char length[16];
+    struct iovec iov[HTTP_REPLY_HEAD_VECTORS];
+    int count = build_reply_head(conn, iov, length, sizeof(length), code, contentType, headers, size);
+    if (!conn->head) {
+        iov[count++] = (struct iovec){ .iov_base = (void *)content, .iov_len = size };
+    }
+    send_vectors(conn, iov, count);
+}
+
+void http_server_send_static_reply(http_connection conn, const char *code, const char *contentType, const char *headers, const void *content, int size)
+{
+    if (size <= HTTP_STATIC_COPY_LIMIT) {
+        // Small enough to share a segment with the headers, which a separate no-copy write would not
+        http_server_send_reply_with_headers(conn, code, contentType, headers, content, size);
+        return;
+    }
+    
+    char length[16];
+    struct iovec iov[HTTP_REPLY_HEAD_VECTORS];
+    int count = build_reply_head(conn, iov, length, sizeof(length), code, contentType, headers, size);
+    if (send_vectors(conn, iov, count) && !conn->head) {
+        send_all_nocopy(conn, content, size);
+    }
+}
+
+void http_server_send_not_modified(http_connection conn, const char *headers)
+{
+    struct iovec iov[] = {
+        IOV_CONST(s_NotModifiedStatus),
+        IOV_STRING(headers),
+        connection_tail(conn),
+    };
+    send_vectors(conn, iov, sizeof(iov) / sizeof(iov[0]));
+}
+
+// Send the buffered part of a streamed reply, as one chunk when the chunked encoding is used.
+static void flush_reply_buffer(http_connection conn, bool last)
+{
+    if (conn->chunked) {
+        int chunk_len = conn->buffered_size - conn->chunk_start - HTTP_CHUNK_HEADER_SIZE;
+        if (chunk_len > 0) {
+            // Four hex digits, chunks are smaller than the buffer, see http_server_create()
+            static const char hex[] = "0123456789abcdef";
+            char *size_line = conn->buffer + conn->chunk_start;
+            for (int i = 0; i < 4; i++) {
+                size_line[i] = hex[(chunk_len >> (12 - 4 * i)) & 0xF];
+            }
+            size_line[4] = '\r';
+            size_line[5] = '\n';
+            append(conn->buffer, &conn->buffered_size, "\r\n", 2);
+        } else {
+            conn->buffered_size = conn->chunk_start; // Nothing to send in this chunk, drop its size line
+        }
+        
+        if (last) {
+            append(conn->buffer, &conn->buffered_size, "0\r\n\r\n", 5);
+        }
+    }
+    
+    if (conn->buffered_size) {
+        send_all(conn, conn->buffer, conn->buffered_size);
+    }
+    
+    conn->chunk_start = 0;
+    conn->buffered_size = conn->chunked ? HTTP_CHUNK_HEADER_SIZE : 0;
 }
 
 http_write_handle http_server_begin_write_reply(http_connection conn, const char *code, const char *contentType)
 {
-    conn->buffered_size = snprintf(conn->buffer, conn->server->buffer_size, "HTTP/1.0 %s\r\nContent-Type: %s\r\nConnection: close\r\n\r\n", code, contentType);
+    // HTTP/1.0 clients do not know the chunked encoding, the end of the body is then marked by closing the connection
+    conn->chunked = conn->http11;
+    if (!conn->chunked) {
+        conn->keep_alive = false;
+    }
+    
+    conn->buffered_size = snprintf(conn->buffer, conn->server->buffer_size, "HTTP/1.1 %s\r\nContent-Type: %s\r\n%sConnection: %s\r\n\r\n",
+        code, contentType, conn->chunked ? "Transfer-Encoding: chunked\r\n" : "", connection_header(conn));
+    conn->chunk_start = conn->buffered_size;
+    if (conn->chunked) {
+        conn->buffered_size += HTTP_CHUNK_HEADER_SIZE;
+    }
+    
     return (http_write_handle)conn;
 }
 
 void http_server_write_reply(http_write_handle handle, const char *format, ...)
 {
     http_connection conn = (http_connection)handle;
+    if (conn->head) {
+        return; // Only the head gets sent, by http_server_end_write_reply()
+    }
+    
+    int limit = conn->server->buffer_size - HTTP_REPLY_RESERVE;
     va_list args;
     va_start(args, format);
-    int written = vsnprintf(conn->buffer + conn->buffered_size, conn->server->buffer_size - conn->buffered_size, format, args);
+    int written = vsnprintf(conn->buffer + conn->buffered_size, limit - conn->buffered_size, format, args);
     va_end(args);
-    if ((conn->buffered_size + written) < (conn->server->buffer_size - 16)) {
+    if (written < limit - conn->buffered_size) {
         conn->buffered_size += written;
         return;
     }
     
-    send_all(conn->socket, conn->buffer, conn->buffered_size);
+    /* Only a fragment that did not fit in what was left gets here: send what was buffered before it and format it
+     * again into the empty buffer. One that exceeds even the empty buffer stays truncated as formatted. */
+    if (conn->buffered_size == (conn->chunked ? HTTP_CHUNK_HEADER_SIZE : 0)) {
+        conn->buffered_size = limit - 1;
+        return;
+    }
+    
+    flush_reply_buffer(conn, false);
     va_start(args, format);
-    conn->buffered_size = vsnprintf(conn->buffer, conn->server->buffer_size, format, args);
+    written = vsnprintf(conn->buffer + conn->buffered_size, limit - conn->buffered_size, format, args);
     va_end(args);
+    conn->buffered_size += MIN(written, limit - conn->buffered_size - 1);
 }
 
 void http_server_end_write_reply(http_write_handle handle, const char *footer)
 {
     http_connection conn = (http_connection)handle;
+    if (conn->head) {
+        send_all(conn, conn->buffer, conn->chunk_start);
+        conn->chunked = false;
+        conn->buffered_size = 0;
+        return;
+    }
+    
+    int limit = conn->server->buffer_size - HTTP_REPLY_RESERVE;
     int len = footer ? strlen(footer) : 0;
-    if (len && len < (conn->server->buffer_size - conn->buffered_size)) {
-        memcpy(conn->buffer + conn->buffered_size, footer, len);
-        conn->buffered_size += len;
-        len = 0;
+    while (len) {
+        if (conn->buffered_size == limit) {
+            flush_reply_buffer(conn, false);
+        }
+        
+        int done = MIN(len, limit - conn->buffered_size);
+        append(conn->buffer, &conn->buffered_size, footer, done);
+        footer += done;
+        len -= done;
     }
     
-    if (conn->buffered_size) {
-        send_all(conn->socket, conn->buffer, conn->buffered_size);
+    flush_reply_buffer(conn, true);
+    conn->chunked = false;
+    conn->buffered_size = 0;
+}
+
+http_event_source http_server_create_event_source(int max_subscribers, int buffer_size)
+{
+    http_event_source source = pvPortMalloc(sizeof(struct _http_event_source) + buffer_size + max_subscribers * sizeof(int));
+    if (!source) {
+        return NULL;
     }
     
-    if (len) {
-        send_all(conn->socket, footer, len);
+    source->mutex = xSemaphoreCreateMutex();
+    source->max_subscribers = max_subscribers;
+    source->buffer_size = buffer_size;
+    source->buffer = (char *)(source->sockets + max_subscribers);
+    for (int i = 0; i < max_subscribers; i++) {
+        source->sockets[i] = HTTP_EVENT_SLOT_FREE;
     }
     
-    conn->buffered_size = 0;
+    return source;
+}
+
+bool http_server_subscribe_events(http_connection conn, http_event_source source)
+{
+    static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+    static const char retry[] = "retry: 2000\n\n";
+    
+    if (conn->head) {
+        send_all(conn, header, sizeof(header) - 1);
+        return false;
+    }
+    
+    // The slot is reserved under the lock, the header is sent without it: a slow client must not block the publishers
+    xSemaphoreTake(source->mutex, portMAX_DELAY);
+    int slot = 0;
+    while (slot < source->max_subscribers && source->sockets[slot] != HTTP_EVENT_SLOT_FREE) {
+        slot++;
+    }
+    if (slot < source->max_subscribers) {
+        source->sockets[slot] = HTTP_EVENT_SLOT_RESERVED;
+    }
+    xSemaphoreGive(source->mutex);
+    
+    if (slot == source->max_subscribers) {
+        http_server_send_reply_with_headers(conn, "503 Service Unavailable", "text/plain", "Retry-After: 5\r\n", "Too many subscribers", -1);
+        return false;
+    }
+    
+    struct iovec iov[] = { IOV_CONST(header), IOV_CONST(retry) };
+    bool subscribed = send_vectors(conn, iov, 2);
+    
+    xSemaphoreTake(source->mutex, portMAX_DELAY);
+    source->sockets[slot] = subscribed ? conn->socket : HTTP_EVENT_SLOT_FREE;
+    xSemaphoreGive(source->mutex);
+    
+    if (subscribed) {
+        // The event source owns the socket from now on, the worker moves on to the next connection
+        conn->socket = -1;
+        conn->keep_alive = false;
+    }
+    
+    return subscribed;
+}
+
+void http_server_publish_event(http_event_source source, const char *event, const char *format, ...)
+{
+    if (!source) {
+        return;
+    }
+    
+    // Each part is only appended if it fits the space left, a truncated event is dropped rather than sent
+    xSemaphoreTake(source->mutex, portMAX_DELAY);
+    int len = snprintf(source->buffer, source->buffer_size, "event: %s\ndata: ", event);
+    if (len >= 0 && len < source->buffer_size) {
+        va_list args;
+        va_start(args, format);
+        int data_len = vsnprintf(source->buffer + len, source->buffer_size - len, format, args);
+        va_end(args);
+        len = (data_len >= 0 && data_len < source->buffer_size - len) ? len + data_len : source->buffer_size;
+    }
+    if (len < source->buffer_size - 2) {
+        append(source->buffer, &len, "\n\n", 2);
+    } else {
+        len = source->buffer_size;
+    }
+    
+    if (len < source->buffer_size) {
+        for (int i = 0; i < source->max_subscribers; i++) {
+            if (source->sockets[i] < 0) {
+                continue;
+            }
+            
+            // Never block the publisher: a subscriber that cannot take the whole event is dropped (the browser reconnects)
+            if (send(source->sockets[i], source->buffer, len, MSG_DONTWAIT) != len) {
+                closesocket(source->sockets[i]);
+                source->sockets[i] = HTTP_EVENT_SLOT_FREE;
+            }
+        }
+    } else {
+        debug_printf("HTTP: event '%s' too long\n", event);
+    }
+    xSemaphoreGive(source->mutex);
+}
+
+// Receive exactly 'len' bytes. Returns 0 if the receive timeout expired before the first byte when 'idle_ok' is set, -1 on errors.
+static int recv_exact(int socket, void *buf, int len, bool idle_ok)
+{
+    char *p = buf;
+    while (len > 0) {
+        int done = recv(socket, p, len, 0);
+        if (done <= 0) {
+            bool timeout = done < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
+            return (timeout && idle_ok && p == buf) ? 0 : -1;
+        }
+        
+        p += done;
+        len -= done;
+    }
+    
+    return 1;
+}
+
+static bool send_websocket_frame(int socket, websocket_opcode opcode, const void *data, int len)
+{
+    uint8_t header[WEBSOCKET_HEADER_MAX_SIZE];
+    int header_len = websocket_encode_header(header, opcode, len, NULL);
+    
+    // A single write, so that small frames go out in a single segment
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = (void *)data, .iov_len = len },
+    };
+    return lwip_writev(socket, iov, len ? 2 : 1) == header_len + len;
+}
+
+bool http_server_accept_websocket(http_connection conn, http_websocket_handler handler, void *context)
+{
+    conn->keep_alive = false; // The connection ends with the WebSocket
+    const char *upgrade = conn->request.headers[HTTP_HEADER_UPGRADE];
+    const char *client_key = conn->request.headers[HTTP_HEADER_SEC_WEBSOCKET_KEY];
+    char accept[WEBSOCKET_ACCEPT_SIZE];
+    if (conn->head || !upgrade || !header_has_token(upgrade, "websocket") || !client_key || !websocket_accept_key(client_key, accept)) {
+        http_server_send_reply(conn, "400 Bad Request", "text/plain", "WebSocket upgrade expected", -1);
+        return false;
+    }
+    
+    int done = snprintf(conn->buffer, conn->server->buffer_size, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if (!send_all(conn, conn->buffer, done)) {
+        return false;
+    }
+    
+    struct timeval timeout = {
+        .tv_sec = HTTP_WEBSOCKET_PING_INTERVAL_MS / 1000,
+        .tv_usec = (HTTP_WEBSOCKET_PING_INTERVAL_MS % 1000) * 1000,
+    };
+    setsockopt(conn->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    bool ping_pending = false;
+    int message_len = 0;
+    for (;;) {
+        uint8_t header[8];
+        int status = recv_exact(conn->socket, header, 2, true);
+        if (status == 0 && !ping_pending) {
+            ping_pending = true;
+            if (send_websocket_frame(conn->socket, WEBSOCKET_PING, NULL, 0)) {
+                continue;
+            }
+        }
+        if (status <= 0) {
+            break;
+        }
+        
+        ping_pending = false;
+        int opcode = header[0] & 0x0F;
+        bool final = (header[0] & 0x80) != 0;
+        bool masked = (header[1] & 0x80) != 0;
+        uint64_t len = header[1] & 0x7F;
+        if (len == 126) {
+            if (recv_exact(conn->socket, header, 2, false) <= 0) {
+                break;
+            }
+            len = (header[0] << 8) | header[1];
+        } else if (len == 127) {
+            if (recv_exact(conn->socket, header, 8, false) <= 0) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = (len << 8) | header[i];
+            }
+        }
+        
+        uint8_t mask[4];
+        if (!masked) {
+            break; // Clients must mask their frames
+        }
+        if (recv_exact(conn->socket, mask, sizeof(mask), false) <= 0) {
+            break;
+        }
+        
+        // Data frames are accumulated at the start of the buffer, control frames go right after them
+        if (len >= (uint64_t)(conn->server->buffer_size - message_len)) {
+            static const uint8_t too_big[] = { 0x03, 0xF1 }; // 1009: message too big
+            send_websocket_frame(conn->socket, WEBSOCKET_CLOSE, too_big, sizeof(too_big));
+            break;
+        }
+        
+        char *payload = conn->buffer + message_len;
+        if (len && recv_exact(conn->socket, payload, (int)len, false) <= 0) {
+            break;
+        }
+        websocket_mask(payload, len, mask, 0);
+        
+        if (opcode == WEBSOCKET_CONTINUATION || opcode == WEBSOCKET_TEXT || opcode == WEBSOCKET_BINARY) {
+            message_len += len;
+            if (final) {
+                conn->buffer[message_len] = 0;
+                handler(conn, conn->buffer, message_len, context);
+                message_len = 0;
+            }
+        } else if (opcode == WEBSOCKET_PING) {
+            send_websocket_frame(conn->socket, WEBSOCKET_PONG, payload, (int)len);
+        } else if (opcode == WEBSOCKET_CLOSE) {
+            send_websocket_frame(conn->socket, WEBSOCKET_CLOSE, payload, MIN((int)len, 2));
+            break;
+        } else if (opcode != WEBSOCKET_PONG) {
+            static const uint8_t protocol_error[] = { 0x03, 0xEA }; // 1002: protocol error
+            send_websocket_frame(conn->socket, WEBSOCKET_CLOSE, protocol_error, sizeof(protocol_error));
+            break;
+        }
+    }
+    
+    return true;
+}
+
+bool http_server_send_websocket_text(http_websocket ws, const char *text, int len)
+{
+    if (len < 0) {
+        len = strlen(text);
+    }
+    
+    return send_websocket_frame(ws->socket, WEBSOCKET_TEXT, text, len);
+}
+
+bool http_server_accepts_gzip(http_connection conn)
+{
+    const char *accept_encoding = conn->request.headers[HTTP_HEADER_ACCEPT_ENCODING];
+    return accept_encoding && header_has_token(accept_encoding, "gzip");
+}
+
+const char *http_server_get_query(http_connection conn)
+{
+    return conn->request.query;
+}
+
+bool http_server_etag_matches(http_connection conn, const char *etag)
+{
+    // The entity tags are quoted, so a substring match cannot hit the middle of another tag
+    const char *if_none_match = conn->request.headers[HTTP_HEADER_IF_NONE_MATCH];
+    return if_none_match && (!strcmp(if_none_match, "*") || strstr(if_none_match, etag));
 }
 
 char *http_server_read_post_line(http_connection conn)
@@ -440,7 +1365,7 @@ char *http_server_read_post_line(http_connection conn)
     }
     
     int len = 0;
-    char *result = recv_next_line_buffered(conn->socket, 
+    char *result = recv_next_line_buffered(conn, 
         conn->buffer + conn->post.offset_from_main_buffer,
         conn->server->buffer_size - conn->post.offset_from_main_buffer,
         &conn->post.buffer_used,
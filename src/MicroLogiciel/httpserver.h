@@ -3,35 +3,102 @@
 
 typedef struct _http_server_instance *http_server_instance;
 typedef struct _http_connection *http_connection, *http_write_handle;
+typedef struct _http_event_source *http_event_source;
+typedef struct _http_connection *http_websocket;
 
 enum http_request_type
 {
     HTTP_GET  = 0,
     HTTP_POST = 1,
+    HTTP_REQUEST_TYPE_COUNT
 };
 
 typedef bool(*http_request_handler)(http_connection conn, enum http_request_type type, char *path, void *context);
+typedef void(*http_websocket_handler)(http_websocket ws, char *message, int len, void *context);
 
-typedef struct http_zone
+/* One entry per endpoint, with a handler for each accepted method. The handlers receive the full path.
+ * A route table must be sorted by path (strcmp order): it is searched with a single binary search per request,
+ * requests for a known path with an unhandled method get a 405. HEAD requests run the GET handler and their reply is sent
+ * without its body; methods other than GET, HEAD and POST get a 405, or a 501 if they are not standard ones. */
+typedef struct
 {
-    const char *prefix;
-    http_request_handler handler;
+    const char *path;
+    http_request_handler handlers[HTTP_REQUEST_TYPE_COUNT];
     void *context;
-    struct http_zone *next;
-    int prefix_len;
-} http_zone;
+    /* Short control requests. They run at a raised task priority, and a reserved worker serves them
+     * when the regular ones are all busy. Must not be set on long-lived endpoints (event streams, WebSockets). */
+    bool priority;
+} http_route;
+
+/* Counters maintained by the server since its creation */
+typedef struct
+{
+    uint32_t pool_hits;         // Connections admitted with a context from the pool
+    uint32_t pool_exhausted;    // Connections rejected with a 503 because the pool was empty
+    uint32_t queued;            // Admitted connections that had to wait for a worker
+    uint32_t queue_expired;     // Queued connections rejected with a 503 after waiting past the deadline
+    uint32_t header_timeouts;   // Connections closed for not sending their request headers in time
+    uint32_t body_timeouts;     // Same for the request body
+    uint32_t send_timeouts;     // Connections closed because the client stopped reading the reply
+} http_server_stats;
 
 
 http_server_instance http_server_create(const char *main_host, const char *main_domain, int max_thread_count, int buffer_size);
-void http_server_add_zone(http_server_instance server, http_zone *instance, const char *prefix, http_request_handler handler, void *context);
-void http_server_send_reply(http_connection conn, const char *code, const char *contentType, const char *content, const char *connexion, int size);
+void http_server_get_stats(http_server_instance server, http_server_stats *stats);
+
+/* Installs the route table. Requests matching no route go to 'fallback' with the leading '/' removed from their path,
+ * and get a 404 if it returns false. Returns false if the table is not sorted. */
+bool http_server_set_routes(http_server_instance server, const http_route *routes, int route_count, http_request_handler fallback, void *fallback_context);
+/* Binary search of a sorted route table, NULL if 'path' has no route. Used by the server for every request. */
+const http_route *http_route_find(const http_route *routes, int count, const char *path);
+/* Sends a complete reply. The connection is kept open for further requests if the client allows it. */
+void http_server_send_reply(http_connection conn, const char *code, const char *contentType, const char *content, int size);
+
+/* Same as http_server_send_reply(), with extra header lines (each one terminated by "\r\n") inserted before the content. */
+void http_server_send_reply_with_headers(http_connection conn, const char *code, const char *contentType, const char *headers, const char *content, int size);
+
+/* Same as http_server_send_reply_with_headers(), for content that is never modified or freed (flash-resident data).
+ * The content is sent without being copied into the lwIP heap, so lwIP keeps reading it after the call returns, until
+ * the client has acknowledged it, even once the connection is closed. */
+void http_server_send_static_reply(http_connection conn, const char *code, const char *contentType, const char *headers, const void *content, int size);
+
+/* Sends a body-less 304 reply. 'headers' should repeat the validators (ETag, Cache-Control, Vary) of the full reply. */
+void http_server_send_not_modified(http_connection conn, const char *headers);
+
+/* Returns true if the request's Accept-Encoding header allows a gzip-encoded reply. */
+bool http_server_accepts_gzip(http_connection conn);
+
+/* Returns true if the request's If-None-Match header matches the given (quoted) entity tag. */
+bool http_server_etag_matches(http_connection conn, const char *etag);
+
+/* Returns the part of the request target after '?', or NULL. The path given to the handlers never includes it. */
+const char *http_server_get_query(http_connection conn);
 
 /* Reads a single line from the POST request using the internal connection buffer. Returns NULL when the entire request has been read. */
 char *http_server_read_post_line(http_connection conn);
 
 
+/* Streams a reply of unknown length. The reply buffer is sent as a chunk each time it fills up (Transfer-Encoding: chunked),
+ * so the connection can stay open afterwards. HTTP/1.0 clients get the body delimited by closing the connection instead. */
 http_write_handle http_server_begin_write_reply(http_connection conn, const char *code, const char *contentType);
 void http_server_write_reply(http_write_handle handle, const char *format, ...);
 void http_server_end_write_reply(http_write_handle handle, const char *footer);
 
+
+/* Server-Sent Events: every event published to a source is formatted once and sent to all its subscribers. */
+http_event_source http_server_create_event_source(int max_subscribers, int buffer_size);
+
+/* Replies with an event stream and hands the connection over to the source. Replies 503 if all subscriber slots are taken. */
+bool http_server_subscribe_events(http_connection conn, http_event_source source);
+
+/* 'format' produces the data line of the event, it must not contain line breaks. */
+void http_server_publish_event(http_event_source source, const char *event, const char *format, ...);
+
+
+/* Completes a WebSocket handshake and runs the connection until the client leaves, calling 'handler' from the worker
+ * for every complete text or binary message (null-terminated). Idle connections are pinged and closed when they stop answering.
+ * Replies 400 if the request is not a WebSocket upgrade. */
+bool http_server_accept_websocket(http_connection conn, http_websocket_handler handler, void *context);
+bool http_server_send_websocket_text(http_websocket ws, const char *text, int len);
+
 #endif
@@ -1,5 +1,6 @@
 #include "json_parser.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -175,7 +176,9 @@ JsonStatus getInteger(const char* json, const char* key, uint32_t* dest) {
         debug_printf("\tMissing key: %s\n", key_);
         return JSON_MISSING_KEY;
     }
-    copy_strip_quote(buffer, tmp, sizeof(tmp));
+    if (!copy_strip_quote(buffer, tmp, sizeof(tmp))) { // Numbers may come quoted or not
+        strcpy(tmp, buffer);
+    }
     if (!is_strict_integer(tmp)) { // Check if it's an interger
         debug_printf("\tNot an interger: %s -> %s\n", key_, tmp);
         return JSON_INVALID_INTEGER;
@@ -186,9 +189,43 @@ JsonStatus getInteger(const char* json, const char* key, uint32_t* dest) {
     return JSON_OK;
 }
 
-JsonStatus getFloatInt(const char* json, const char* key, uint32_t* dest) {
-    char buffer[16];
-    char tmp[16];
+JsonStatus parseMicroseconds(const char* value, uint64_t* dest) {
+    if (!is_strict_float(value) || value[0] == '-') { // Check if it's a positive float
+        debug_printf("\tNot a float: %s\n", value);
+        return JSON_INVALID_FLOAT;
+    }
+    
+    // Exact decimal conversion: the seconds and up to 6 decimals, no rounding through a float
+    uint64_t seconds = 0, micros = 0;
+    int integer_digits = 0, decimals = 0;
+    const char *c = value;
+    for (; isdigit(*c); c++) {
+        seconds = seconds * 10 + (*c - '0');
+        integer_digits++;
+    }
+    if (*c == '.') {
+        for (c++; isdigit(*c); c++) {
+            if (++decimals > 6) {
+                debug_printf("\tMore than 6 decimals: %s\n", value);
+                return JSON_INVALID_FLOAT;
+            }
+            micros = micros * 10 + (*c - '0');
+        }
+    }
+    if (integer_digits > 12) { // Well below the 64-bit limit
+        debug_printf("\tOut of range: %s\n", value);
+        return JSON_INVALID_FLOAT;
+    }
+    for (; decimals < 6; decimals++) {
+        micros *= 10;
+    }
+    *dest = seconds * 1000000 + micros;
+    return JSON_OK;
+}
+
+JsonStatus getMicroseconds(const char* json, const char* key, uint64_t* dest) {
+    char buffer[24];
+    char tmp[24];
     char key_[strlen(key)+2];
     if (!to_quoted_string(key, key_)) { // Ensure 'key' is a qouted string
         return JSON_KO;
@@ -198,17 +235,28 @@ JsonStatus getFloatInt(const char* json, const char* key, uint32_t* dest) {
         debug_printf("\tMissing key: %s\n", key_);
         return JSON_MISSING_KEY;
     }
-    copy_strip_quote(buffer, tmp, sizeof(tmp));
-    if (!is_strict_float(tmp)) { // Check if it's an float
-        debug_printf("\tNot a float: %s -> %s\n", key_, tmp);
-        return JSON_INVALID_FLOAT;
+    if (!copy_strip_quote(buffer, tmp, sizeof(tmp))) { // Numbers may come quoted or not
+        strcpy(tmp, buffer);
+    }
+    JsonStatus status = parseMicroseconds(tmp, dest);
+    if (status != JSON_OK) {
+        return status;
     }
-    *dest = (uint32_t)(atof(tmp)*1000); // Caste the value to the output
     
-    debug_printf("\t-> %s: %d\n", key_, *dest);
+    debug_printf("\t-> %s: %llu us\n", key_, (unsigned long long)*dest);
     return JSON_OK;
 }
 
+int formatMicroseconds(char* dest, size_t dest_size, uint64_t us) {
+    char decimals[7];
+    snprintf(decimals, sizeof(decimals), "%06lu", (unsigned long)(us % 1000000));
+    int len = 6;
+    while (len > 2 && decimals[len - 1] == '0') { // Keep at least 2 decimals, as the web page always did
+        len--;
+    }
+    return snprintf(dest, dest_size, "%llu.%.*s", (unsigned long long)(us / 1000000), len, decimals);
+}
+
 JsonStatus getString(const char* json, const char* key, char* dest, size_t dest_size) {
     char buffer[dest_size];
     char key_[strlen(key)+2];
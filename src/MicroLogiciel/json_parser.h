@@ -31,8 +31,12 @@ int to_quoted_string(const char* src, char* dest);
 
 JsonStatus getBoolean(const char* json, const char* key, bool* dest);
 JsonStatus getInteger(const char* json, const char* key, uint32_t* dest);
-JsonStatus getFloatInt(const char* json, const char* key, uint32_t* dest);
+JsonStatus getMicroseconds(const char* json, const char* key, uint64_t* dest); // A duration in seconds, as exact microseconds
+JsonStatus parseMicroseconds(const char* value, uint64_t* dest); // Same, for a bare value such as a query parameter
 JsonStatus getString(const char* json, const char* key, char* buffer, size_t buffer_size);
 JsonStatus getIPAddress(const char* json, const char* key, uint32_t* dest);
 
+/* Seconds with 2 to 6 decimals, without going through a float. Returns the length, as snprintf(). */
+int formatMicroseconds(char* dest, size_t dest_size, uint64_t us);
+
 #endif
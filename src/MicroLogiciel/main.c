@@ -3,41 +3,25 @@
 
 #include <lwip/ip4_addr.h>
 #include <lwip/netif.h>
+#include <lwip/stats.h>
 
 #include <FreeRTOS.h>
 #include <semphr.h>
 #include <task.h>
 
-#include "../Tools/SimpleFSBuilder/SimpleFS.h"
-
 #include "dhcpserver/dhcpserver.h"
 #include "dnsserver/dnsserver.h"
 #include "httpserver.h"
 #include "server_settings.h"
+#include "simplefs.h"
+#include "static_files.h"
 #include "debug_printf.h"
 #include "json_parser.h"
 #include "timer.h"
 
 #define TEST_TASK_PRIORITY (tskIDLE_PRIORITY + 2UL)
 
-struct SimpleFSContext
-{
-    GlobalFSHeader *header;
-    StoredFileEntry *entries;
-    char *names, *data;
-} s_SimpleFS;
-
-bool simplefs_init(struct SimpleFSContext *ctx, void *data)
-{
-    ctx->header = (GlobalFSHeader *)data;
-    if (ctx->header->Magic != kSimpleFSHeaderMagic) {
-        return false;
-    }
-    ctx->entries = (StoredFileEntry *)(ctx->header + 1);
-    ctx->names = (char *)(ctx->entries + ctx->header->EntryCount);
-    ctx->data = (char *)(ctx->names + ctx->header->NameBlockSize);
-    return true;
-}
+static struct SimpleFSContext s_SimpleFS;
 
 static void set_secondary_ip_address(int address)
 {
@@ -45,21 +29,46 @@ static void set_secondary_ip_address(int address)
     ip4_secondary_ip_address = address;
 }
 
-static bool do_retrieve_file(http_connection conn, enum http_request_type type, char *path, void *context)
+static http_server_instance s_HttpServer;
+
+static bool do_handle_server_stats(http_connection conn, enum http_request_type type, char *path, void *context)
 {
-    for (int i = 0; i < s_SimpleFS.header->EntryCount; i++) {
-        if (!strcmp(s_SimpleFS.names + s_SimpleFS.entries[i].NameOffset, path)) {
-            http_server_send_reply(conn,
-                "200 OK",
-                s_SimpleFS.names + s_SimpleFS.entries[i].ContentTypeOffset,
-                s_SimpleFS.data + s_SimpleFS.entries[i].DataOffset,
-                "close",
-                s_SimpleFS.entries[i].FileSize);
-            return true;
-        }
-    }
+    http_server_stats stats;
+    http_server_get_stats(s_HttpServer, &stats);
     
-    return false;
+    // The largest free block and the number of free blocks show how fragmented heap_4 is, next to what is free
+    HeapStats_t heap;
+    vPortGetHeapStats(&heap);
+    
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", "application/json");
+    http_server_write_reply(reply, "{\"pool_hits\":%lu,\"pool_exhausted\":%lu,\"queued\":%lu,\"queue_expired\":%lu,"
+        "\"header_timeouts\":%lu,\"body_timeouts\":%lu,\"send_timeouts\":%lu,",
+        (unsigned long)stats.pool_hits,
+        (unsigned long)stats.pool_exhausted,
+        (unsigned long)stats.queued,
+        (unsigned long)stats.queue_expired,
+        (unsigned long)stats.header_timeouts,
+        (unsigned long)stats.body_timeouts,
+        (unsigned long)stats.send_timeouts);
+    http_server_write_reply(reply, "\"heap_free\":%lu,\"heap_min_free\":%lu,\"heap_largest_block\":%lu,\"heap_free_blocks\":%lu",
+        (unsigned long)heap.xAvailableHeapSpaceInBytes,
+        (unsigned long)heap.xMinimumEverFreeBytesRemaining,
+        (unsigned long)heap.xSizeOfLargestFreeBlockInBytes,
+        (unsigned long)heap.xNumberOfFreeBlocks);
+#if LWIP_STATS && MEM_STATS && MEMP_STATS
+    /* High-water marks since boot of the lwIP heap, where copied sends are buffered, and of the segments and the pbufs
+     * referencing data sent without copying it. Compared after the same load with HTTP_STATIC_NOCOPY set and cleared. */
+    http_server_write_reply(reply, ",\"lwip_mem_used\":%lu,\"lwip_mem_max\":%lu,\"lwip_mem_err\":%lu,"
+        "\"lwip_tcp_seg_max\":%lu,\"lwip_pbuf_ref_max\":%lu,\"lwip_tcp_memerr\":%lu",
+        (unsigned long)lwip_stats.mem.used,
+        (unsigned long)lwip_stats.mem.max,
+        (unsigned long)lwip_stats.mem.err,
+        (unsigned long)lwip_stats.memp[MEMP_TCP_SEG]->max,
+        (unsigned long)lwip_stats.memp[MEMP_PBUF]->max,
+        (unsigned long)lwip_stats.tcp.memerr);
+#endif
+    http_server_end_write_reply(reply, "}");
+    return true;
 }
 
 static void main_task(__unused void *params)
@@ -75,13 +84,7 @@ static void main_task(__unused void *params)
         printf("missing/corrupt FS image");
         return;
     }
-    extern SemaphoreHandle_t s_StartTimerSemaphore;
-    extern SemaphoreHandle_t s_StopTimerSemaphore;
-    extern SemaphoreHandle_t s_UpdateTimerSemaphore;
-    
-    xSemaphoreGive(s_StartTimerSemaphore);
-    xSemaphoreGive(s_StopTimerSemaphore);
-    xSemaphoreGive(s_UpdateTimerSemaphore);
+    timer_init();
     
     const pico_server_settings *settings = get_pico_server_settings();
 
@@ -97,13 +100,28 @@ static void main_task(__unused void *params)
     dhcp_server_init(&dhcp_server, &netif->ip_addr, &netif->netmask, settings->domain_name);
     dns_server_init(netif->ip_addr.addr, settings->secondary_address, settings->hostname, settings->domain_name, settings->dns_ignores_network_suffix);
     set_secondary_ip_address(settings->secondary_address);
-    http_server_instance server = http_server_create(settings->hostname, settings->domain_name, 4, 4096);
-    // TODO: simplify http server zone with one master API zone and callback function
-    static http_zone zone1, zone2, zone3;
-    http_server_add_zone(server, &zone1, "", do_retrieve_file, NULL);
-    http_server_add_zone(server, &zone2, "/api/timer", do_handle_timer_api_call, NULL);
-    // TODO: handle server and timer settings separatly from a common API settings function
-    http_server_add_zone(server, &zone3, "/api/settings", do_handle_settings_api_call, NULL);
+    http_server_instance server = s_HttpServer = http_server_create(settings->hostname, settings->domain_name, 4, 4096);
+    
+    // Sorted by path. Timer commands are flagged as priority, so that a stop is not held up by page downloads, and so is
+    // the clock synchronisation, whose samples are only as good as the request is quick
+    static const http_route routes[] = {
+        { "/api/clock/sync", { [HTTP_GET] = do_handle_clock_sync_get, [HTTP_POST] = do_handle_clock_sync_post }, NULL, true },
+        { "/api/server/stats", { [HTTP_GET] = do_handle_server_stats } },
+        { "/api/settings", { [HTTP_GET] = do_handle_settings_get, [HTTP_POST] = do_handle_settings_post } },
+        { "/api/timer/events", { [HTTP_GET] = do_handle_timer_events } },
+        { "/api/timer/extend", { [HTTP_POST] = do_handle_timer_extend }, NULL, true },
+        { "/api/timer/pause", { [HTTP_POST] = do_handle_timer_pause }, NULL, true },
+        { "/api/timer/resume", { [HTTP_POST] = do_handle_timer_resume }, NULL, true },
+        { "/api/timer/sequence", { [HTTP_POST] = do_handle_timer_sequence } },
+        { "/api/timer/settings", { [HTTP_GET] = do_handle_timer_settings_get, [HTTP_POST] = do_handle_timer_settings_post } },
+        { "/api/timer/skip", { [HTTP_POST] = do_handle_timer_skip }, NULL, true },
+        { "/api/timer/start", { [HTTP_POST] = do_handle_timer_start }, NULL, true },
+        { "/api/timer/stats", { [HTTP_GET] = do_handle_timer_stats } },
+        { "/api/timer/stop", { [HTTP_POST] = do_handle_timer_stop }, NULL, true },
+        { "/api/timer/update", { [HTTP_GET] = do_handle_timer_update }, NULL, true },
+        { "/api/timer/ws", { [HTTP_GET] = do_handle_timer_websocket } },
+    };
+    http_server_set_routes(server, routes, sizeof(routes) / sizeof(routes[0]), do_retrieve_file, &s_SimpleFS);
     vTaskDelete(NULL);
 }
 
@@ -130,8 +148,8 @@ void increase_timer_settings(timer_settings *timer_data)
 {
     debug_printf("\tincrease_timer_settings\n");
     timer_data->picture_number = (timer_data->picture_number % 5) + 1;
-    timer_data->exposure_time = timer_data->exposure_time + 500;
-    timer_data->delay_time = timer_data->delay_time + 250;
+    timer_data->exposure_us = timer_data->exposure_us + 500000;
+    timer_data->delay_us = timer_data->delay_us + 250000;
 }
 
 void key_pressed_func() {
@@ -142,21 +160,19 @@ void key_pressed_func() {
     increase_timer_settings(&timer_data); // MARK: only for test purposes
 }
 
+#if configCHECK_FOR_STACK_OVERFLOW
+void vApplicationStackOverflowHook(TaskHandle_t task, char *name)
+{
+    panic("Stack overflow in task '%s'\n", name);
+}
+#endif
+
 int main(void)
 {
     stdio_init_all();
     
     TaskHandle_t task;
     
-    // Semaphore declaration
-    extern SemaphoreHandle_t s_StartTimerSemaphore;
-    extern SemaphoreHandle_t s_StopTimerSemaphore;
-    extern SemaphoreHandle_t s_UpdateTimerSemaphore;
-    
-    s_StartTimerSemaphore = xSemaphoreCreateBinary();
-    s_StopTimerSemaphore = xSemaphoreCreateBinary();
-    s_UpdateTimerSemaphore = xSemaphoreCreateBinary();
-    
     s_PrintfSemaphore = xSemaphoreCreateMutex();
     
     // Get notified if the user presses a key
@@ -0,0 +1,279 @@
+#include "sequence.h"
+
+void sequence_begin(sequence_program *program, sequence_event *events, int capacity)
+{
+    program->events = events;
+    program->capacity = capacity;
+    program->count = 0;
+    program->frames = 0;
+    program->duration_us = 0;
+    program->cursor_us = 0;
+    program->pins = 0;
+}
+
+static bool emit(sequence_program *program, uint64_t at_us, uint8_t pins, uint16_t frame, uint8_t flags)
+{
+    uint64_t delta = at_us - program->duration_us;
+    while (delta > UINT32_MAX) {
+        // Waits beyond ~71 minutes are chained through events that keep the outputs as they are
+        if (program->count == program->capacity) {
+            return false;
+        }
+        program->events[program->count++] = (sequence_event){ .delay_us = UINT32_MAX, .pins = program->pins };
+        delta -= UINT32_MAX;
+    }
+
+    if (program->count == program->capacity) {
+        return false;
+    }
+
+    program->events[program->count++] = (sequence_event){
+        .delay_us = (uint32_t)delta,
+        .frame = frame,
+        .pins = pins,
+        .flags = flags,
+    };
+    program->pins = pins;
+    program->duration_us = at_us;
+    return true;
+}
+
+static bool emit_exposure(sequence_program *program, const sequence_step *step, uint64_t exposure_us, uint64_t gap_us, uint8_t flags)
+{
+    uint64_t t = program->cursor_us;
+    uint16_t frame = ++program->frames;
+    uint8_t pins = 0;
+
+    uint8_t start = SEQUENCE_EVENT_FRAME; // On whichever event comes first
+
+    if (step->focus_us) {
+        pins |= SEQUENCE_PIN_FOCUS;
+        if (!emit(program, t, pins, 0, start)) {
+            return false;
+        }
+        start = 0;
+        t += step->focus_us;
+    }
+
+    if (step->lockup_us) {
+        if (!emit(program, t, pins | SEQUENCE_PIN_SHUTTER, 0, start) ||
+            !emit(program, t + SEQUENCE_LOCKUP_PULSE_US, pins, 0, 0)) {
+            return false;
+        }
+        start = 0;
+        t += SEQUENCE_LOCKUP_PULSE_US + step->lockup_us;
+    }
+
+    if (!emit(program, t, pins | SEQUENCE_PIN_SHUTTER, frame, SEQUENCE_EVENT_OPENED | start | flags) ||
+        !emit(program, t + exposure_us, 0, frame, SEQUENCE_EVENT_CLOSED | flags)) {
+        return false;
+    }
+
+    program->cursor_us = t + exposure_us + gap_us;
+    return true;
+}
+
+// 2^(1/2^n) for n = 1 to 16, in Q30
+static const uint32_t s_Pow2Fractions[16] = {
+    1518500250, 1276901417, 1170923762, 1121280436, 1097253708, 1085434106, 1079572136, 1076653033,
+    1075196443, 1074468888, 1074105294, 1073923544, 1073832680, 1073787251, 1073764537, 1073753181,
+};
+
+// log2(x) in Q16, x > 0
+static int64_t log2_q16(uint64_t x)
+{
+    int msb = 63 - __builtin_clzll(x);
+    int64_t result = (int64_t)msb << 16;
+
+    // Mantissa in [1, 2) as Q31: each squaring yields the next bit of the fractional part
+    uint64_t m = msb > 31 ? x >> (msb - 31) : x << (31 - msb);
+    for (int bit = 1 << 15; bit; bit >>= 1) {
+        m = (m * m) >> 31;
+        if (m >= (2ULL << 31)) {
+            m >>= 1;
+            result += bit;
+        }
+    }
+    return result;
+}
+
+// x * 2^(exponent / 2^16)
+static uint64_t scale_pow2(uint64_t x, int64_t exponent)
+{
+    int64_t shift = exponent >> 16; // Rounds towards minus infinity, the fraction stays positive
+    uint32_t fraction = exponent & 0xFFFF;
+
+    uint64_t factor = 1ULL << 30;
+    for (int n = 0; n < 16; n++) {
+        if (fraction & (0x8000 >> n)) {
+            factor = (factor * s_Pow2Fractions[n]) >> 30;
+        }
+    }
+
+    // Apply as much of the shift as possible before the product, so that small values keep their precision
+    if (shift > 0) {
+        int headroom = __builtin_clzll(x) - 2;
+        int early = shift < headroom ? shift : headroom;
+        x <<= early;
+        shift -= early;
+    }
+
+    // x * factor >> 30 without overflowing 64 bits
+    uint64_t scaled = (x >> 30) * factor + (((x & ((1ULL << 30) - 1)) * factor) >> 30);
+    return shift >= 0 ? scaled << shift : scaled >> -shift;
+}
+
+// Value of frame 'index' out of 'count' going from 'from' to 'to', with integer arithmetic only
+static uint64_t ramp_value(uint64_t from, uint64_t to, uint32_t index, uint32_t count, sequence_ramp_curve curve)
+{
+    if (count < 2 || index == 0) {
+        return from;
+    }
+    if (index == count - 1) {
+        return to;
+    }
+
+    if (curve == SEQUENCE_RAMP_LOG && from && to) {
+        int64_t span = log2_q16(to) - log2_q16(from);
+        return scale_pow2(from, span * index / (count - 1));
+    }
+
+    if (to >= from) {
+        return from + (to - from) * index / (count - 1);
+    }
+    return from - (from - to) * index / (count - 1);
+}
+
+bool sequence_add_step(sequence_program *program, const sequence_step *step)
+{
+    if (step->type == SEQUENCE_STEP_PAUSE) {
+        program->cursor_us += step->exposure_us;
+        return true;
+    }
+
+    if (!step->exposure_us || program->frames + step->count > UINT16_MAX ||
+        (step->type == SEQUENCE_STEP_BRACKET && !step->factor)) {
+        return false;
+    }
+
+    uint64_t exposure_us = step->exposure_us;
+    uint64_t gap_us = step->gap_us;
+    uint8_t flags = (step->type == SEQUENCE_STEP_DARK) ? SEQUENCE_EVENT_DARK : 0;
+    for (uint32_t i = 0; i < step->count; i++) {
+        if (step->type == SEQUENCE_STEP_RAMP) {
+            exposure_us = ramp_value(step->exposure_us, step->exposure_end_us, i, step->count, step->curve);
+            gap_us = ramp_value(step->gap_us, step->gap_end_us, i, step->count, step->curve);
+            if (!exposure_us) {
+                return false;
+            }
+        }
+
+        if (!emit_exposure(program, step, exposure_us, gap_us, flags)) {
+            return false;
+        }
+
+        if (step->type == SEQUENCE_STEP_BRACKET && i + 1 < step->count) {
+            if (exposure_us > UINT64_MAX / step->factor) {
+                return false;
+            }
+            exposure_us *= step->factor;
+        }
+    }
+
+    return true;
+}
+
+void sequence_cursor_start(sequence_cursor *cursor, const sequence_event *events, int count, uint64_t start_us)
+{
+    cursor->events = events;
+    cursor->count = count;
+    cursor->next = 0;
+    cursor->frame_start = -1;
+    cursor->exposing = false;
+    cursor->frame = 0;
+    cursor->pins = 0;
+    cursor->paused = false;
+    cursor->extend_us = 0;
+    cursor->next_edge_us = start_us + events[0].delay_us;
+}
+
+const sequence_event *sequence_cursor_advance(sequence_cursor *cursor)
+{
+    const sequence_event *event = &cursor->events[cursor->next++];
+    cursor->pins = event->pins;
+    if (event->flags & SEQUENCE_EVENT_FRAME) {
+        cursor->frame_start = cursor->next - 1;
+    }
+    if (event->flags & SEQUENCE_EVENT_OPENED) {
+        cursor->frame = event->frame;
+        cursor->exposing = true;
+    }
+    if (event->flags & SEQUENCE_EVENT_CLOSED) {
+        cursor->frame_start = -1;
+        cursor->exposing = false;
+    }
+
+    if (!sequence_cursor_done(cursor)) {
+        cursor->next_edge_us += cursor->events[cursor->next].delay_us;
+    }
+    if (event->flags & SEQUENCE_EVENT_CLOSED) {
+        cursor->next_edge_us += cursor->extend_us;
+        cursor->extend_us = 0;
+    }
+    return event;
+}
+
+const sequence_event *sequence_cursor_skip(sequence_cursor *cursor)
+{
+    const sequence_event *event;
+    do {
+        event = &cursor->events[cursor->next++];
+        if (!sequence_cursor_done(cursor)) {
+            cursor->next_edge_us += cursor->events[cursor->next].delay_us;
+        }
+    } while (!(event->flags & SEQUENCE_EVENT_CLOSED) && !sequence_cursor_done(cursor));
+
+    cursor->next_edge_us += cursor->extend_us;
+    cursor->extend_us = 0;
+    cursor->pins = event->pins;
+    cursor->frame_start = -1;
+    cursor->exposing = false;
+    return event;
+}
+
+void sequence_cursor_pause(sequence_cursor *cursor, uint64_t now_us, uint64_t restart_us)
+{
+    if (cursor->frame_start >= 0) {
+        // The outputs are all released between exposures
+        cursor->next = cursor->frame_start;
+        cursor->frame_start = -1;
+        cursor->exposing = false;
+        cursor->remaining_us = restart_us;
+        cursor->paused_pins = 0;
+    } else {
+        cursor->remaining_us = cursor->next_edge_us > now_us ? cursor->next_edge_us - now_us : 0;
+        cursor->paused_pins = cursor->pins;
+    }
+    cursor->pins = 0;
+    cursor->paused = true;
+}
+
+void sequence_cursor_resume(sequence_cursor *cursor, uint64_t now_us)
+{
+    cursor->pins = cursor->paused_pins;
+    cursor->next_edge_us = now_us + cursor->remaining_us;
+    cursor->paused = false;
+}
+
+bool sequence_cursor_extend(sequence_cursor *cursor, uint64_t delay_us)
+{
+    if (cursor->paused) {
+        cursor->remaining_us += delay_us;
+    } else if (cursor->frame_start >= 0) {
+        cursor->extend_us += delay_us;
+    } else {
+        cursor->next_edge_us += delay_us;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,122 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Outputs driven by a sequence */
+enum
+{
+    SEQUENCE_PIN_SHUTTER = 0x01,
+    SEQUENCE_PIN_FOCUS = 0x02,
+};
+
+/* What an event is reported as to the supervision */
+enum
+{
+    SEQUENCE_EVENT_OPENED = 0x01, // Start of an exposure
+    SEQUENCE_EVENT_CLOSED = 0x02, // End of an exposure
+    SEQUENCE_EVENT_DARK = 0x04,   // The exposure is a dark frame
+    SEQUENCE_EVENT_FRAME = 0x08,  // First event of an exposure, its focus or mirror lock-up when used
+};
+
+#define SEQUENCE_LOCKUP_PULSE_US 200000 // Shutter press that flips the mirror up when mirror lock-up is used
+
+/* A compiled sequence is a flat array of these, walked by the shutter engine without any further computation.
+ * Times are delta-encoded so that events stay 8 bytes; longer waits are split with events that change nothing. */
+typedef struct
+{
+    uint32_t delay_us;  // Since the previous event (since the start for the first one)
+    uint16_t frame;     // Exposure reported by SEQUENCE_EVENT_OPENED/CLOSED, 1-based
+    uint8_t pins;       // SEQUENCE_PIN_* outputs set from this event on
+    uint8_t flags;      // SEQUENCE_EVENT_*
+} sequence_event;
+
+typedef enum
+{
+    SEQUENCE_STEP_EXPOSE,
+    SEQUENCE_STEP_BRACKET,  // Exposures multiplied by 'factor' from one frame to the next
+    SEQUENCE_STEP_DARK,     // Exposures reported as dark frames
+    SEQUENCE_STEP_PAUSE,    // Wait 'exposure_us', e.g. for dithering
+    SEQUENCE_STEP_RAMP,     // Exposure and gap going from their value to their '_end' value over the frames
+} sequence_step_type;
+
+typedef enum
+{
+    SEQUENCE_RAMP_LINEAR,
+    SEQUENCE_RAMP_LOG,      // Constant ratio from one frame to the next, linear if either end is 0
+} sequence_ramp_curve;
+
+typedef struct
+{
+    sequence_step_type type;
+    uint32_t count;
+    uint32_t factor;        // SEQUENCE_STEP_BRACKET only, at least 1
+    sequence_ramp_curve curve; // SEQUENCE_STEP_RAMP only
+    uint64_t exposure_us;
+    uint64_t exposure_end_us; // SEQUENCE_STEP_RAMP only: exposure of the last frame
+    uint64_t gap_us;        // Wait after each exposure
+    uint64_t gap_end_us;    // SEQUENCE_STEP_RAMP only: wait after the last frame
+    uint64_t lockup_us;     // Mirror lock-up: the mirror is flipped this long before each exposure, 0 for none
+    uint64_t focus_us;      // Focus pre-trigger held this long before each exposure (and during it), 0 for none
+} sequence_step;
+
+typedef struct
+{
+    sequence_event *events; // Preallocated by the owner
+    int capacity;
+    int count;
+    uint32_t frames;        // Exposures in the sequence
+    uint64_t duration_us;   // Up to the last event
+    uint64_t cursor_us;     // Where the next step starts
+    uint8_t pins;
+} sequence_program;
+
+void sequence_begin(sequence_program *program, sequence_event *events, int capacity);
+
+/* Appends a step. Returns false, leaving the program unusable, if the event array is full or the step is invalid. */
+bool sequence_add_step(sequence_program *program, const sequence_step *step);
+
+/* Walks a compiled sequence. It neither reads a clock nor touches the outputs: the caller passes the time in and applies
+ * 'pins', so the same code runs from the shutter interrupt and against a virtual clock on a host. */
+typedef struct
+{
+    const sequence_event *events;
+    int count;
+    int next;              // Index of the next event to produce
+    int frame_start;       // Index of the SEQUENCE_EVENT_FRAME event of the exposure under way, -1 between exposures
+    bool exposing;         // Between SEQUENCE_EVENT_OPENED and SEQUENCE_EVENT_CLOSED
+    uint32_t frame;        // Last exposure opened
+    uint8_t pins;          // SEQUENCE_PIN_* outputs to set
+    bool paused;
+    uint8_t paused_pins;   // Outputs to restore on resume
+    uint64_t next_edge_us; // Time of the next event, on the caller's clock
+    uint64_t remaining_us; // While paused: time left until the next event
+    uint64_t extend_us;    // Added to the wait that follows the current exposure
+} sequence_cursor;
+
+void sequence_cursor_start(sequence_cursor *cursor, const sequence_event *events, int count, uint64_t start_us);
+
+static inline bool sequence_cursor_done(const sequence_cursor *cursor)
+{
+    return cursor->next == cursor->count;
+}
+
+/* Produces the event due at 'next_edge_us' and schedules the following one. Must not be called once done. */
+const sequence_event *sequence_cursor_advance(sequence_cursor *cursor);
+
+/* Drops every event up to the end of the current exposure, or of the next one between exposures, and returns the
+ * event that closes it. The events after it keep their schedule. */
+const sequence_event *sequence_cursor_skip(sequence_cursor *cursor);
+
+/* Releases the outputs and freezes the schedule at 'now_us'. An exposure cut short, or still in its focus or mirror
+ * lock-up, is taken again in full from its first event on resume, 'restart_us' after it. */
+void sequence_cursor_pause(sequence_cursor *cursor, uint64_t now_us, uint64_t restart_us);
+
+/* Shifts the rest of the schedule by the time spent paused. */
+void sequence_cursor_resume(sequence_cursor *cursor, uint64_t now_us);
+
+/* Lengthens the current wait, or the one that follows the current exposure. Returns true if 'next_edge_us' moved. */
+bool sequence_cursor_extend(sequence_cursor *cursor, uint64_t delay_us);
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "json_parser.h"
 #include "debug_printf.h"
+#include "timer.h"
 
 static char buffer_server_settings[405]; // set to the maximal size of the server settings string
 
@@ -176,33 +177,43 @@ void write_pico_server_settings(const pico_server_settings *new_settings)
     portEXIT_CRITICAL();
 }
 
-bool do_handle_settings_api_call(http_connection conn, enum http_request_type type, char *path, void *context)
+static void write_flash(const void *data)
 {
-    if (type == HTTP_POST) {
-        static pico_server_settings settings;
-        settings = *get_pico_server_settings();
-        
-        JsonStatus status = parse_server_settings(conn, &settings);
-        if (status != JSON_OK) {
-            char *err = JSON_status_message(status);
-            debug_printf("Error: %s\n", err);
-            http_server_send_reply(conn, "200 OK", "text/plain", err, "close", -1);
-            return true;
-        }
-        
-        debug_printf("/!\\--- write_pico_server_settings() ---/!\\... ");
-        write_pico_server_settings(&settings);
-        debug_printf("Done\n");
-        http_server_send_reply(conn, "200 OK", "text/plain", "OK", "close", -1);
-        watchdog_reboot(0, SRAM_END, 500);
-         
+    write_pico_server_settings(data);
+}
+
+bool do_handle_settings_post(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    static pico_server_settings settings;
+    settings = *get_pico_server_settings();
+    
+    JsonStatus status = parse_server_settings(conn, &settings);
+    if (status != JSON_OK) {
+        char *err = JSON_status_message(status);
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
         return true;
-    } else {
-        const pico_server_settings *settings = get_pico_server_settings();
-        format_server_settings(buffer_server_settings, settings);
-        http_server_send_reply(conn, "200 OK", "text/json", buffer_server_settings, "close", -1);
-        
+    }
+    
+    debug_printf("/!\\--- write_pico_server_settings() ---/!\\... ");
+    const char *err = timer_write_flash(write_flash, &settings);
+    if (err) {
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
         return true;
     }
-    return false;
+    debug_printf("Done\n");
+    http_server_send_reply(conn, "200 OK", "text/plain", "OK", -1);
+    watchdog_reboot(0, SRAM_END, 500);
+    
+    return true;
+}
+
+bool do_handle_settings_get(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    const pico_server_settings *settings = get_pico_server_settings();
+    format_server_settings(buffer_server_settings, settings);
+    http_server_send_reply(conn, "200 OK", "text/json", buffer_server_settings, -1);
+    
+    return true;
 }
@@ -35,6 +35,7 @@ const pico_server_settings *get_pico_server_settings();
 
 void write_pico_server_settings(const pico_server_settings *new_settings);
 
-bool do_handle_settings_api_call(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_settings_get(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_settings_post(http_connection conn, enum http_request_type type, char *path, void *context);
 
 #endif
@@ -0,0 +1,228 @@
+#include "shutter.h"
+
+#include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+#include "debug_printf.h"
+#include "edge_log.h"
+
+static QueueHandle_t s_Events;
+static int s_Alarm = -1;
+static spin_lock_t *s_Lock;
+
+// Sequence state, shared between the alarm interrupt and the tasks under s_Lock
+static bool s_Running;
+static sequence_cursor s_Cursor;
+
+#define SHUTTER_GPIO_MASK ((1u << SHUTTER_GPIO) | (1u << FOCUS_GPIO))
+
+static inline uint32_t pins_to_gpio(uint8_t pins)
+{
+    return ((pins & SEQUENCE_PIN_SHUTTER) ? (1u << SHUTTER_GPIO) : 0) |
+           ((pins & SEQUENCE_PIN_FOCUS) ? (1u << FOCUS_GPIO) : 0);
+}
+
+static inline void apply_pins(void)
+{
+    gpio_put_masked(SHUTTER_GPIO_MASK, pins_to_gpio(s_Cursor.pins));
+}
+
+static inline shutter_event make_event(shutter_event_type type, uint32_t frame, int32_t late_us, uint64_t next_us, bool dark)
+{
+    return (shutter_event){
+        .type = type,
+        .frame = frame,
+        .late_us = late_us,
+        .next_us = next_us,
+        .dark = dark,
+    };
+}
+
+static void post_event(shutter_event_type type, uint32_t frame, int32_t late_us, uint64_t next_us, bool dark, BaseType_t *woken)
+{
+    shutter_event event = make_event(type, frame, late_us, next_us, dark);
+
+    // Events only feed the supervision, a full queue must never hold up the edges. Always posted under s_Lock, with
+    // the interrupts off, so that they reach the queue in the order the outputs changed.
+    xQueueSendFromISR(s_Events, &event, woken);
+}
+
+// Called from the tasks, under s_Lock: a target already in the past produces the event right away
+static void arm_alarm(void)
+{
+    if (hardware_alarm_set_target(s_Alarm, from_us_since_boot(s_Cursor.next_edge_us))) {
+        hardware_alarm_force_irq(s_Alarm);
+    }
+}
+
+static void shutter_alarm_callback(uint alarm)
+{
+    BaseType_t woken = pdFALSE;
+    uint32_t save = spin_lock_blocking(s_Lock);
+
+    while (s_Running && !s_Cursor.paused) {
+        uint64_t scheduled_us = s_Cursor.next_edge_us;
+        uint64_t now_us = time_us_64();
+        int32_t late_us = (int32_t)(now_us - scheduled_us);
+        uint8_t previous = s_Cursor.pins;
+        const sequence_event *event = sequence_cursor_advance(&s_Cursor);
+        apply_pins();
+        if ((event->pins ^ previous) & SEQUENCE_PIN_SHUTTER) {
+            edge_log_record(scheduled_us, now_us, event->frame, event->pins & SEQUENCE_PIN_SHUTTER);
+        }
+
+        bool last = sequence_cursor_done(&s_Cursor);
+        uint64_t next_us = last ? 0 : s_Cursor.next_edge_us;
+        if (event->flags & SEQUENCE_EVENT_OPENED) {
+            post_event(SHUTTER_EVENT_OPENED, event->frame, late_us, next_us, event->flags & SEQUENCE_EVENT_DARK, &woken);
+        } else if (event->flags & SEQUENCE_EVENT_CLOSED) {
+            post_event(SHUTTER_EVENT_CLOSED, event->frame, late_us, next_us, event->flags & SEQUENCE_EVENT_DARK, &woken);
+        }
+
+        if (last) {
+            s_Running = false;
+            post_event(SHUTTER_EVENT_DONE, s_Cursor.frame, 0, 0, false, &woken);
+            break;
+        }
+
+        // A target already in the past is reported as missed: produce that event right away
+        if (!hardware_alarm_set_target(alarm, from_us_since_boot(s_Cursor.next_edge_us))) {
+            break;
+        }
+    }
+
+    spin_unlock(s_Lock, save);
+    portYIELD_FROM_ISR(woken);
+}
+
+bool shutter_init(QueueHandle_t events)
+{
+    s_Events = events;
+    s_Lock = spin_lock_init(spin_lock_claim_unused(true));
+    s_Alarm = hardware_alarm_claim_unused(false);
+    if (s_Alarm < 0) {
+        debug_printf("No hardware alarm left for the shutter\n");
+        return false;
+    }
+
+    hardware_alarm_set_callback(s_Alarm, shutter_alarm_callback);
+    gpio_init_mask(SHUTTER_GPIO_MASK);
+    gpio_clr_mask(SHUTTER_GPIO_MASK);
+    gpio_set_dir_out_masked(SHUTTER_GPIO_MASK);
+    return true;
+}
+
+bool shutter_start(const sequence_event *events, int count, uint64_t start_us)
+{
+    if (s_Alarm < 0 || count <= 0) {
+        return false;
+    }
+
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool started = !s_Running;
+    if (started) {
+        s_Running = true;
+        edge_log_reset();
+        sequence_cursor_start(&s_Cursor, events, count, start_us);
+        arm_alarm();
+    }
+    spin_unlock(s_Lock, save);
+    return started;
+}
+
+bool shutter_stop(void)
+{
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool stopped = s_Running;
+    if (stopped) {
+        hardware_alarm_cancel(s_Alarm);
+        s_Cursor.pins = 0;
+        apply_pins();
+        s_Running = false;
+    }
+    spin_unlock(s_Lock, save);
+    return stopped;
+}
+
+bool shutter_pause(void)
+{
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool paused = s_Running && !s_Cursor.paused;
+    if (paused) {
+        hardware_alarm_cancel(s_Alarm);
+        sequence_cursor_pause(&s_Cursor, time_us_64(), SHUTTER_START_LEAD_US);
+        apply_pins();
+    }
+    spin_unlock(s_Lock, save);
+    return paused;
+}
+
+bool shutter_resume(uint64_t *next_us)
+{
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool resumed = s_Running && s_Cursor.paused;
+    if (resumed) {
+        sequence_cursor_resume(&s_Cursor, time_us_64());
+        apply_pins();
+        arm_alarm();
+        *next_us = s_Cursor.next_edge_us;
+    }
+    spin_unlock(s_Lock, save);
+    return resumed;
+}
+
+bool shutter_skip(void)
+{
+    shutter_event events[2];
+    int count = 0;
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool skipped = s_Running && !s_Cursor.paused;
+    if (skipped) {
+        hardware_alarm_cancel(s_Alarm);
+        bool open = s_Cursor.exposing;
+        const sequence_event *event = sequence_cursor_skip(&s_Cursor);
+        apply_pins();
+
+        bool last = sequence_cursor_done(&s_Cursor);
+        uint64_t next_us = last ? 0 : s_Cursor.next_edge_us;
+        events[count++] = make_event(open ? SHUTTER_EVENT_CLOSED : SHUTTER_EVENT_SKIPPED, event->frame, 0, next_us, event->flags & SEQUENCE_EVENT_DARK);
+        if (last) {
+            s_Running = false;
+            events[count++] = make_event(SHUTTER_EVENT_DONE, s_Cursor.frame, 0, 0, false);
+        }
+    }
+    spin_unlock(s_Lock, save);
+    if (!skipped) {
+        return false;
+    }
+
+    // Posted from the task outside of the lock. The alarm stays cancelled meanwhile, so that the events of the next
+    // edges cannot reach the queue before these ones.
+    for (int i = 0; i < count; i++) {
+        xQueueSend(s_Events, &events[i], 0);
+    }
+
+    save = spin_lock_blocking(s_Lock);
+    if (s_Running && !s_Cursor.paused) {
+        arm_alarm();
+    }
+    spin_unlock(s_Lock, save);
+    return true;
+}
+
+bool shutter_extend(uint64_t delay_us)
+{
+    uint32_t save = spin_lock_blocking(s_Lock);
+    bool extended = s_Running;
+    if (extended && sequence_cursor_extend(&s_Cursor, delay_us)) {
+        arm_alarm();
+    }
+    spin_unlock(s_Lock, save);
+    return extended;
+}
+
+bool shutter_is_running(void)
+{
+    return s_Running;
+}
@@ -0,0 +1,71 @@
+#ifndef SHUTTER_H
+#define SHUTTER_H
+
+#include <pico/stdlib.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include "sequence.h"
+
+#ifndef SHUTTER_GPIO
+#define SHUTTER_GPIO 15 // Shutter release output, active high
+#endif
+
+#ifndef FOCUS_GPIO
+#define FOCUS_GPIO 14 // Focus (half-press) output, active high
+#endif
+
+#define SHUTTER_START_LEAD_US 1000 // Starts are scheduled at least this far ahead, leaving time to arm the alarm
+
+typedef enum
+{
+    SHUTTER_EVENT_OPENED,
+    SHUTTER_EVENT_CLOSED,
+    SHUTTER_EVENT_SKIPPED, // An exposure dropped by shutter_skip() before it opened
+    SHUTTER_EVENT_DONE,
+} shutter_event_type;
+
+typedef struct
+{
+    shutter_event_type type;
+    uint32_t frame;     // 1-based. For SHUTTER_EVENT_DONE, the number of exposures started
+    int32_t late_us;    // Time between the scheduled edge and the moment the pin actually changed
+    uint64_t next_us;   // Scheduled time of the next output change since boot, 0 after the last one
+    bool dark;          // The exposure is a dark frame
+} shutter_event;
+
+/* The shutter edges are produced by a hardware alarm interrupt at absolute times computed from the sequence start,
+ * so they are neither quantised to the RTOS tick nor delayed by busy tasks, and errors do not accumulate.
+ * The RTOS only supervises: every edge is reported to 'events' (a queue of shutter_event), from the interrupt. */
+bool shutter_init(QueueHandle_t events);
+
+/* Runs a sequence compiled by sequence_add_step(), from 'start_us' on the time since boot. The first event is produced by
+ * the alarm, so the start does not depend on when this is called as long as it is early enough. 'events' is read from the
+ * interrupt and must stay untouched until the sequence is done. Returns false if a sequence is already running. */
+bool shutter_start(const sequence_event *events, int count, uint64_t start_us);
+
+/* The control functions below take effect on the outputs before they return, they are meant to be called from the
+ * task that consumes the events. */
+
+/* Releases the shutter and focus immediately and cancels the remaining edges. Returns false if no sequence was running
+ * (it may have just ended, its SHUTTER_EVENT_DONE is then in the queue). Nothing is reported. */
+bool shutter_stop(void);
+
+/* Releases the outputs and freezes the schedule. An exposure cut short is taken again in full on resume. */
+bool shutter_pause(void);
+
+/* Restores the outputs and shifts the rest of the schedule by the time spent paused, so the remaining intervals are
+ * unchanged. 'next_us' receives the time of the next output change. */
+bool shutter_resume(uint64_t *next_us);
+
+/* Drops the current exposure, closing the shutter at once, or the next one if the shutter is closed. The events after
+ * it keep their schedule. Reported as SHUTTER_EVENT_CLOSED or SHUTTER_EVENT_SKIPPED. */
+bool shutter_skip(void);
+
+/* Lengthens the current wait, or the one that follows the current exposure, delaying everything after it. */
+bool shutter_extend(uint64_t delay_us);
+
+bool shutter_is_running(void);
+
+#endif
@@ -0,0 +1,47 @@
+#include "simplefs.h"
+
+#include <string.h>
+
+bool simplefs_init(struct SimpleFSContext *ctx, void *data)
+{
+    ctx->header = (GlobalFSHeader *)data;
+    if (ctx->header->Magic == kSimpleFSIndexedHeaderMagic) {
+        ctx->entries = (char *)(ctx->header + 1);
+        ctx->entry_size = ctx->header->EntrySize;
+        ctx->index = ctx->header->IndexOffset ? (uint32_t *)((char *)data + ctx->header->IndexOffset) : NULL;
+    } else if (ctx->header->Magic == kSimpleFSHeaderMagic) {
+        // Old images have a shorter header, no index and entries that stop before 'Flags'
+        ctx->entries = (char *)data + offsetof(GlobalFSHeader, FormatVersion);
+        ctx->entry_size = offsetof(StoredFileEntry, Flags);
+        ctx->index = NULL;
+    } else {
+        return false;
+    }
+    ctx->names = ctx->entries + ctx->header->EntryCount * ctx->entry_size;
+    ctx->data = ctx->names + ctx->header->NameBlockSize;
+    return true;
+}
+
+static inline StoredFileEntry *simplefs_entry(struct SimpleFSContext *ctx, uint32_t i)
+{
+    return (StoredFileEntry *)(ctx->entries + i * ctx->entry_size);
+}
+
+StoredFileEntry *simplefs_find(struct SimpleFSContext *ctx, const char *path)
+{
+    uint32_t count = ctx->header->EntryCount;
+    if (ctx->index && count && ctx->header->IndexBucketCount) {
+        uint32_t seed = ctx->index[SimpleFSHash(path, 0) % ctx->header->IndexBucketCount];
+        StoredFileEntry *entry = simplefs_entry(ctx, SimpleFSHash(path, seed) % count);
+        return strcmp(ctx->names + entry->NameOffset, path) ? NULL : entry;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        StoredFileEntry *entry = simplefs_entry(ctx, i);
+        if (!strcmp(ctx->names + entry->NameOffset, path)) {
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef SIMPLEFS_H
+#define SIMPLEFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../Tools/SimpleFSBuilder/SimpleFS.h"
+
+struct SimpleFSContext
+{
+    GlobalFSHeader *header;
+    char *entries;
+    uint32_t entry_size;
+    uint32_t *index;
+    char *names, *data;
+};
+
+/* Maps an image built by SimpleFSBuilder, of any format version. Returns false if 'data' is not one. */
+bool simplefs_init(struct SimpleFSContext *ctx, void *data);
+
+/* Looks 'path' up through the index of the image, or by a linear scan for images without one. NULL if not found. */
+StoredFileEntry *simplefs_find(struct SimpleFSContext *ctx, const char *path);
+
+#endif
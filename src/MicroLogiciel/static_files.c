@@ -0,0 +1,54 @@
+#include "static_files.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "simplefs.h"
+
+#ifndef HTTP_CACHE_CONTROL
+#define HTTP_CACHE_CONTROL "no-cache"
+#endif
+
+bool do_retrieve_file(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    struct SimpleFSContext *fs = context;
+    StoredFileEntry *entry = simplefs_find(fs, path);
+    if (!entry) {
+        return false;
+    }
+    
+    // Images older than format 3 stop the entries before 'Flags', and before 'ETagOffset' for format 3
+    bool has_gzip = fs->entry_size > offsetof(StoredFileEntry, Flags) && (entry->Flags & kSimpleFSEntryHasGzip);
+    bool has_etag = fs->entry_size > offsetof(StoredFileEntry, ETagOffset);
+    bool send_gzip = has_gzip && http_server_accepts_gzip(conn);
+    
+    char etag[24] = "";
+    char headers[192];
+    int off = 0;
+    if (send_gzip) {
+        off += snprintf(headers + off, sizeof(headers) - off, "Content-Encoding: gzip\r\n");
+    }
+    if (has_gzip) {
+        off += snprintf(headers + off, sizeof(headers) - off, "Vary: Accept-Encoding\r\n");
+    }
+    if (has_etag) {
+        // The compressed copy is a different representation, so it gets its own tag
+        snprintf(etag, sizeof(etag), "\"%s%s\"", fs->names + entry->ETagOffset, send_gzip ? "-gz" : "");
+        off += snprintf(headers + off, sizeof(headers) - off, "ETag: %s\r\n", etag);
+    }
+    snprintf(headers + off, sizeof(headers) - off, "Cache-Control: %s\r\n", HTTP_CACHE_CONTROL);
+    
+    if (has_etag && http_server_etag_matches(conn, etag)) {
+        http_server_send_not_modified(conn, headers);
+        return true;
+    }
+    
+    // The image is memory-mapped flash, so the content can be handed to lwIP without copying it
+    http_server_send_static_reply(conn,
+        "200 OK",
+        fs->names + entry->ContentTypeOffset,
+        headers,
+        fs->data + (send_gzip ? entry->GzipDataOffset : entry->DataOffset),
+        send_gzip ? entry->GzipSize : entry->FileSize);
+    return true;
+}
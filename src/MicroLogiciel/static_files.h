@@ -0,0 +1,14 @@
+#ifndef STATIC_FILES_H
+#define STATIC_FILES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "httpserver.h"
+
+/* Fallback handler of the server: replies with the file of a SimpleFS image, 'context' being its struct
+ * SimpleFSContext. The gzip copy is sent to clients accepting it, and a request whose If-None-Match carries the tag of
+ * the representation it would get is answered with a 304. Returns false if the image has no such file. */
+bool do_retrieve_file(http_connection conn, enum http_request_type type, char *path, void *context);
+
+#endif
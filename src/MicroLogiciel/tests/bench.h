@@ -0,0 +1,26 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+static inline double bench_seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static inline struct timespec bench_start(void)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    return start;
+}
+
+/* Keeps the compiler from dropping computations whose results are otherwise unused */
+static inline void bench_keep(const void *value)
+{
+    __asm__ volatile("" : : "g"(value) : "memory");
+}
+
+#endif
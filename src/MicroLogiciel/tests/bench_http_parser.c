@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "http_parser.h"
+
+#define ROUNDS 200000
+
+// Headers of a browser loading the web application, the larger of the requests the server gets
+static const char s_Request[] =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: astrotimer.local\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Linux; Android 14; Pixel 7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0 Mobile Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: fr-FR,fr;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+    "If-None-Match: \"5f3c1a9e\"\r\n"
+    "\r\n";
+
+// Time per request when the request arrives in 'segment' bytes at a time, 0 for all at once
+static double parse_ns(int segment)
+{
+    char buffer[sizeof(s_Request)];
+    int len = sizeof(s_Request) - 1;
+    struct timespec start = bench_start();
+    for (int i = 0; i < ROUNDS; i++) {
+        // The parser writes terminators into the buffer, each round starts from the original
+        memcpy(buffer, s_Request, len);
+        http_parser parser;
+        http_parser_init(&parser);
+        http_parse_status status = HTTP_PARSE_INCOMPLETE;
+        for (int fed = 0; fed < len && status == HTTP_PARSE_INCOMPLETE; ) {
+            fed = (segment && fed + segment < len) ? fed + segment : len;
+            status = http_parser_execute(&parser, buffer, fed);
+        }
+        bench_keep(&parser);
+    }
+    return bench_seconds_since(&start) * 1e9 / ROUNDS;
+}
+
+/* Parser throughput on a typical browser request, whole and split as slow links deliver it. The copy of the request
+ * made before each round is included. */
+int main(void)
+{
+    static const int segments[] = { 0, 536, 64, 1 };
+    int len = sizeof(s_Request) - 1;
+    printf("%d-byte request\n", len);
+    for (int i = 0; i < (int)(sizeof(segments) / sizeof(segments[0])); i++) {
+        double ns = parse_ns(segments[i]);
+        char label[32];
+        snprintf(label, sizeof(label), segments[i] ? "%d-byte segments" : "whole", segments[i]);
+        printf("%-18s %8.1f ns/request %8.1f MB/s\n", label, ns, len / ns * 1e3);
+    }
+    return 0;
+}
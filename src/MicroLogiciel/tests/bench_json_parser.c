@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#include "bench.h"
+#include "json_parser.h"
+
+#define ROUNDS 1000000
+
+/* Cost of the exact microsecond conversions on the request path: a bare value, a key looked up in a settings line,
+ * and the formatting of the replies */
+int main(void)
+{
+    static const char *const values[] = { "30", "0.5", "1.234567", "3600.25" };
+    const char *line = "{\"picture\":300, \"exposure\":\"300.5\", \"delay\":10.25, \"ramp\":false}";
+    uint64_t us = 0;
+
+    struct timespec start = bench_start();
+    for (int i = 0; i < ROUNDS; i++) {
+        parseMicroseconds(values[i & 3], &us);
+        bench_keep(&us);
+    }
+    double parse = bench_seconds_since(&start);
+
+    start = bench_start();
+    for (int i = 0; i < ROUNDS; i++) {
+        getMicroseconds(line, "delay", &us);
+        bench_keep(&us);
+    }
+    double get = bench_seconds_since(&start);
+
+    char text[24];
+    start = bench_start();
+    for (int i = 0; i < ROUNDS; i++) {
+        formatMicroseconds(text, sizeof(text), 1234567ULL * i);
+        bench_keep(text);
+    }
+    double format = bench_seconds_since(&start);
+
+    printf("parseMicroseconds: %.1f ns\n", parse * 1e9 / ROUNDS);
+    printf("getMicroseconds from a settings line: %.1f ns\n", get * 1e9 / ROUNDS);
+    printf("formatMicroseconds: %.1f ns\n", format * 1e9 / ROUNDS);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "bench.h"
+#include "http_host.h"
+
+#define ASSET_SIZE (256 * 1024) // The size of the largest static files of the web application
+#define SAMPLES 200
+#define READ_DELAY_MS 1         // 4 KB per millisecond and download, of the order of the Wi-Fi throughput of the device
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Round trip of one-shot requests, from connect to the end of the reply. The device only replies to a stop once the
+ * shutter outputs are released, so on the device this bounds the stop-to-shutter latency. */
+static void measure(const char *label, const char *request, const char *expected)
+{
+    double ms[SAMPLES];
+    int failed = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        char reply[512];
+        struct timespec start = bench_start();
+        int len = http_host_exchange(request, reply, sizeof(reply));
+        ms[i] = bench_seconds_since(&start) * 1000;
+        failed += len <= 0 || !strstr(reply, expected);
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+
+    qsort(ms, SAMPLES, sizeof(ms[0]), compare_doubles);
+    printf("%-32s %9.2f ms %9.2f ms %9.2f ms %7d\n", label, ms[SAMPLES / 2], ms[SAMPLES * 99 / 100], ms[SAMPLES - 1], failed);
+}
+
+/* Stop requests against /ping, a regular route, while clients download static assets, by default one per regular
+ * worker. Usage: bench_priority_lane [downloads] [read delay ms] */
+int main(int argc, char **argv)
+{
+    static const char stop[] = "POST /stop HTTP/1.1\r\nHost: pico\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    static const char ping[] = "GET /ping HTTP/1.1\r\nHost: pico\r\nConnection: close\r\n\r\n";
+    int downloaders = argc > 1 ? atoi(argv[1]) : HTTP_HOST_WORKERS;
+    int read_delay_ms = argc > 2 ? atoi(argv[2]) : READ_DELAY_MS;
+
+    if (!http_host_start(ASSET_SIZE)) {
+        return 1;
+    }
+
+    printf("%-32s %12s %12s %12s %7s\n", "", "median", "p99", "max", "failed");
+    measure("stop, idle", stop, "stopped");
+    measure("ping, idle", ping, "pong");
+
+    http_host_downloads downloads = http_host_start_downloads(downloaders, read_delay_ms);
+    http_host_wait_downloads(downloads, 2000);
+    struct timespec start = bench_start();
+    char label[64];
+    snprintf(label, sizeof(label), "stop, %d downloads", downloaders);
+    measure(label, stop, "stopped");
+    snprintf(label, sizeof(label), "ping, %d downloads", downloaders);
+    measure(label, ping, "pong");
+    double seconds = bench_seconds_since(&start);
+    long long bytes = http_host_stop_downloads(downloads);
+    printf("downloads: %.1f MB/s\n", bytes / seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <strings.h>
+
+#include "bench.h"
+#include "routes.h"
+
+#define LOOKUPS 1000000
+#define MAX_ROUTES 256
+
+static http_route s_Routes[MAX_ROUTES];
+static char s_Paths[MAX_ROUTES][32];
+
+/* The dispatch the route table replaced: a list of zones, one per /api/<area> and the static files last, each matched
+ * with strncasecmp() over its prefix, then a chain of strcmp() on the rest of the path inside the zone handler */
+typedef struct
+{
+    char prefix[16];
+    int prefix_len;
+} zone;
+
+static zone s_Zones[MAX_ROUTES / ROUTES_PER_AREA + 1];
+
+static int zone_count(int count)
+{
+    return (count + ROUTES_PER_AREA - 1) / ROUTES_PER_AREA;
+}
+
+static void zones_generate(int count)
+{
+    // Added in reverse order, as http_server_add_zone() pushed them on the list
+    for (int i = 0; i < zone_count(count); i++) {
+        zone *z = &s_Zones[zone_count(count) - 1 - i];
+        snprintf(z->prefix, sizeof(z->prefix), "/api/area%03d", i);
+        z->prefix_len = strlen(z->prefix);
+    }
+    s_Zones[zone_count(count)] = (zone){ "", 0 };
+}
+
+static int zone_dispatch(int count, const char *path)
+{
+    static const char *const endpoints[ROUTES_PER_AREA] = {
+        "endpoint0", "endpoint1", "endpoint2", "endpoint3", "endpoint4", "endpoint5", "endpoint6", "endpoint7",
+    };
+
+    for (int z = 0; z <= zone_count(count); z++) {
+        const zone *zone = &s_Zones[z];
+        if (strncasecmp(path, zone->prefix, zone->prefix_len)) {
+            continue;
+        }
+        const char *rest = path + zone->prefix_len;
+        if (*rest != '/' && *rest) {
+            continue;
+        }
+        while (*rest == '/') {
+            rest++;
+        }
+        if (!zone->prefix_len) {
+            return -1; // Static files
+        }
+        for (int e = 0; e < ROUTES_PER_AREA; e++) {
+            if (!strcmp(rest, endpoints[e])) {
+                return e;
+            }
+        }
+        return -1;
+    }
+    return -1;
+}
+
+static double route_ns(int count, bool hits)
+{
+    struct timespec start = bench_start();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const char *path = hits ? s_Paths[(i * 7919u) % count] : "/style.css";
+        bench_keep(http_route_find(s_Routes, count, path));
+    }
+    return bench_seconds_since(&start) * 1e9 / LOOKUPS;
+}
+
+static double zone_ns(int count, bool hits)
+{
+    struct timespec start = bench_start();
+    int found = 0;
+    for (int i = 0; i < LOOKUPS; i++) {
+        const char *path = hits ? s_Paths[(i * 7919u) % count] : "/style.css";
+        found += zone_dispatch(count, path);
+        bench_keep(&found);
+    }
+    return bench_seconds_since(&start) * 1e9 / LOOKUPS;
+}
+
+/* Dispatch cost against the number of routes, for API requests and for static files, which match no route */
+int main(void)
+{
+    printf("%8s %14s %14s %14s %14s\n", "routes", "table hit", "table miss", "zones hit", "zones miss");
+    for (int count = 8; count <= MAX_ROUTES; count *= 2) {
+        routes_generate(s_Routes, s_Paths, count);
+        zones_generate(count);
+        printf("%8d %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", count, route_ns(count, true), route_ns(count, false),
+               zone_ns(count, true), zone_ns(count, false));
+    }
+    return 0;
+}
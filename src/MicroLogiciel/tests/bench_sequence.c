@@ -0,0 +1,44 @@
+#include <stdio.h>
+
+#include "bench.h"
+#include "sequence_sim.h"
+
+#define SESSIONS 2000
+
+/* Compiles and runs to the end, on the virtual clock, sessions of 300 frames of 5 minutes with focus and mirror
+ * lock-up: 1500 events and more than a day of simulated time each. */
+int main(void)
+{
+    static sequence_event events[2048];
+    sequence_step step = {
+        .type = SEQUENCE_STEP_EXPOSE,
+        .count = 300,
+        .exposure_us = 300000000,
+        .gap_us = 10000000,
+        .lockup_us = 2000000,
+        .focus_us = 500000,
+    };
+
+    struct timespec start = bench_start();
+    uint64_t simulated_us = 0;
+    int edges = 0;
+    for (int i = 0; i < SESSIONS; i++) {
+        sequence_program program;
+        sequence_begin(&program, events, sizeof(events) / sizeof(events[0]));
+        if (!sequence_add_step(&program, &step)) {
+            fprintf(stderr, "sequence refused\n");
+            return 1;
+        }
+
+        sim_engine sim;
+        sim_start(&sim, &program, 0, NULL, 0);
+        sim_run(&sim);
+        simulated_us += sim.now_us;
+        edges += sim.count;
+    }
+    double elapsed = bench_seconds_since(&start);
+
+    printf("%d sessions of %d events in %.3f s: %.0f sessions/s, %.1f ns per event, %.0f simulated hours per second\n",
+           SESSIONS, edges / SESSIONS, elapsed, SESSIONS / elapsed, elapsed * 1e9 / edges, simulated_us / 3600e6 / elapsed);
+    return 0;
+}
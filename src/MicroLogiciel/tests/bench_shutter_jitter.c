@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "edge_log.h"
+#include "http_parser.h"
+#include "sequence.h"
+
+#define FRAMES 2000
+#define EXPOSURE_US 1000
+#define GAP_US 1000
+
+static sequence_event s_Events[4 * FRAMES];
+static atomic_bool s_Loaded;
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+// HTTP traffic stand-in: parses requests as fast as it can, as the server workers do under load
+static void *load_thread(void *unused)
+{
+    static const char request[] =
+        "GET /api/timer/status?session=12 HTTP/1.1\r\n"
+        "Host: astrotimer.local\r\n"
+        "Connection: keep-alive\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "If-None-Match: \"5f3c1a\"\r\n"
+        "\r\n";
+    char buffer[sizeof(request)];
+    (void)unused;
+
+    while (atomic_load_explicit(&s_Loaded, memory_order_relaxed)) {
+        http_parser parser;
+        memcpy(buffer, request, sizeof(request));
+        http_parser_init(&parser);
+        http_parser_execute(&parser, buffer, sizeof(request) - 1);
+    }
+    return NULL;
+}
+
+/* The shutter interrupt on a real-time thread: sleeps until each edge, then produces every event due and logs the
+ * shutter transitions, the way shutter_alarm_callback() does */
+static void *shutter_thread(void *program)
+{
+    const sequence_program *compiled = program;
+    sequence_cursor cursor;
+
+    edge_log_reset();
+    sequence_cursor_start(&cursor, compiled->events, compiled->count, now_us() + 10000);
+    while (!sequence_cursor_done(&cursor)) {
+        uint64_t target_us = cursor.next_edge_us;
+        struct timespec target = { .tv_sec = target_us / 1000000, .tv_nsec = (target_us % 1000000) * 1000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL);
+
+        uint64_t fired_us = now_us();
+        while (!sequence_cursor_done(&cursor) && cursor.next_edge_us <= fired_us) {
+            uint64_t scheduled_us = cursor.next_edge_us;
+            uint8_t previous = cursor.pins;
+            const sequence_event *event = sequence_cursor_advance(&cursor);
+            if ((event->pins ^ previous) & SEQUENCE_PIN_SHUTTER) {
+                edge_log_record(scheduled_us, fired_us, event->frame, event->pins & SEQUENCE_PIN_SHUTTER);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void run(const sequence_program *program, int load_threads, const char *label)
+{
+    pthread_t loads[64];
+    atomic_store(&s_Loaded, true);
+    for (int i = 0; i < load_threads; i++) {
+        pthread_create(&loads[i], NULL, load_thread, NULL);
+    }
+
+    // Highest priority when allowed (root or CAP_SYS_NICE), as the alarm interrupt preempts the tasks on the device
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = sched_get_priority_max(SCHED_FIFO) };
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    pthread_t shutter;
+    bool realtime = pthread_create(&shutter, &attr, shutter_thread, (void *)program) == 0;
+    if (!realtime) {
+        pthread_create(&shutter, NULL, shutter_thread, (void *)program);
+    }
+    pthread_join(shutter, NULL);
+    pthread_attr_destroy(&attr);
+
+    atomic_store(&s_Loaded, false);
+    for (int i = 0; i < load_threads; i++) {
+        pthread_join(loads[i], NULL);
+    }
+
+    edge_log_summary summary;
+    edge_log_get_summary(&summary);
+    printf("%s (%d load threads, %s): %u edges, p50 %u us, p99 %u us, max %u us\n", label, load_threads,
+           realtime ? "SCHED_FIFO" : "normal priority", summary.edges, summary.p50_us, summary.p99_us, summary.max_us);
+    for (int i = 0; i < EDGE_LOG_BUCKETS; i++) {
+        if (summary.histogram[i]) {
+            printf("    < %8u us: %u\n", 1u << i, summary.histogram[i]);
+        }
+    }
+}
+
+/* Edge timing of a host shutter engine, idle then with HTTP parsing on every core. This measures the scheduling of the
+ * host, not the alarm interrupt of the device; it shows the engine itself adds no error and catches up after late
+ * wake-ups without drifting. Usage: bench_shutter_jitter [load threads] */
+int main(int argc, char **argv)
+{
+    int load_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (load_threads < 0 || load_threads > 64) {
+        load_threads = 64;
+    }
+
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = FRAMES, .exposure_us = EXPOSURE_US, .gap_us = GAP_US };
+    sequence_program program;
+    sequence_begin(&program, s_Events, sizeof(s_Events) / sizeof(s_Events[0]));
+    if (!sequence_add_step(&program, &step)) {
+        fprintf(stderr, "Cannot compile the sequence\n");
+        return 1;
+    }
+
+    run(&program, 0, "Idle");
+    run(&program, load_threads, "Loaded");
+    return 0;
+}
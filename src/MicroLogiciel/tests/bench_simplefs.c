@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "simplefs_image.h"
+
+#define LOOKUPS 1000000
+
+// Cost of a lookup, hits in a scattered order then misses
+static double lookup_ns(simplefs_image *image, bool hits)
+{
+    static const char *const misses[] = { "favicon.ico", "generate_204", "d3/missing.css", "hotspot-detect.html" };
+    struct timespec start = bench_start();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const char *path = hits ? image->paths[(i * 7919u) % image->count] : misses[i & 3];
+        StoredFileEntry *entry = simplefs_find(&image->fs, path);
+        bench_keep(entry);
+    }
+    return bench_seconds_since(&start) * 1e9 / LOOKUPS;
+}
+
+/* Static file lookup through the perfect hash index of the image against the linear scan of the images without one */
+int main(void)
+{
+    static const int counts[] = { 10, 100, 1000 };
+    printf("%8s %14s %14s %14s %14s\n", "files", "index hit", "index miss", "linear hit", "linear miss");
+    for (int i = 0; i < 3; i++) {
+        simplefs_image image;
+        if (!simplefs_image_build(&image, counts[i])) {
+            fprintf(stderr, "Cannot build an image of %d files\n", counts[i]);
+            return 1;
+        }
+
+        double index_hit = lookup_ns(&image, true), index_miss = lookup_ns(&image, false);
+        image.fs.index = NULL;
+        double linear_hit = lookup_ns(&image, true), linear_miss = lookup_ns(&image, false);
+        printf("%8d %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", counts[i], index_hit, index_miss, linear_hit, linear_miss);
+        simplefs_image_free(&image);
+    }
+    return 0;
+}
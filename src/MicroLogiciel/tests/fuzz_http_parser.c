@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_parser.h"
+
+/* Fuzz target of the request parser. Built with clang, it is a libFuzzer binary:
+ *   fuzz_http_parser [corpus directory]
+ * Otherwise (FUZZ_STANDALONE) it runs the inputs given as files, or random mutations of a few requests without
+ * arguments, and aborts on the first input breaking the invariants below. */
+
+#define BUFFER_SIZE 2048 // Twice the request buffer of the firmware
+
+static char s_Whole[BUFFER_SIZE], s_Split[BUFFER_SIZE];
+
+static void check(bool condition, const char *what)
+{
+    if (!condition) {
+        fprintf(stderr, "fuzz_http_parser: %s\n", what);
+        abort();
+    }
+}
+
+// Fields point inside the parsed bytes, and are terminated there
+static void check_field(const char *field, int pos, bool required)
+{
+    check(field || !required, "missing field");
+    if (field) {
+        check(field >= s_Whole && field < s_Whole + pos, "field outside the request");
+        check(memchr(field, 0, s_Whole + pos - field) != NULL, "field not terminated");
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > BUFFER_SIZE) {
+        return 0;
+    }
+
+    http_parser whole;
+    memcpy(s_Whole, data, size);
+    http_parser_init(&whole);
+    http_parse_status status = http_parser_execute(&whole, s_Whole, size);
+
+    check(whole.pos <= (int)size, "parsed past the data");
+    check(status != HTTP_PARSE_INCOMPLETE || whole.pos == (int)size, "stopped early without a result");
+    if (status == HTTP_PARSE_DONE) {
+        check_field(whole.method, whole.pos, true);
+        check_field(whole.path, whole.pos, true);
+        check_field(whole.query, whole.pos, false);
+        for (int i = 0; i < HTTP_HEADER_COUNT; i++) {
+            check_field(whole.headers[i], whole.pos, false);
+        }
+        check(whole.content_length < 1000000000, "content length out of range");
+    }
+    http_parser_overflow_status(&whole);
+
+    // Byte at a time, then in two segments split at a point taken from the data: the same result
+    for (int pass = 0; pass < 2; pass++) {
+        http_parser split;
+        memcpy(s_Split, data, size);
+        http_parser_init(&split);
+        int step = pass ? (size ? data[0] % size + 1 : 1) : 1;
+        http_parse_status split_status = HTTP_PARSE_INCOMPLETE;
+        for (int fed = 0; fed < (int)size && split_status == HTTP_PARSE_INCOMPLETE; ) {
+            fed = fed + step < (int)size ? fed + step : (int)size;
+            split_status = http_parser_execute(&split, s_Split, fed);
+        }
+        check(split_status == status, "status depends on the segments");
+        check(split.pos == whole.pos, "position depends on the segments");
+        check(split.content_length == whole.content_length, "content length depends on the segments");
+        check(!memcmp(s_Split, s_Whole, size), "buffer depends on the segments");
+    }
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+static const char *const s_Seeds[] = {
+    "GET / HTTP/1.1\r\nHost: pico\r\n\r\n",
+    "POST /api/timer/start?session=1 HTTP/1.1\r\nHost: astrotimer.local\r\nContent-Length: 12\r\n"
+    "Connection: keep-alive\r\n\r\n{\"run\":true}",
+    "GET /index.html HTTP/1.0\nAccept-Encoding: gzip\nIf-None-Match: \"1a2b\"\nRange: bytes=0-\n\n",
+    "GET /api/timer/ws HTTP/1.1\r\nUpgrade: websocket\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+};
+
+static const char s_Dictionary[] = "\r\n :?\t/0123456789\x7f";
+
+static size_t mutate(uint8_t *data, size_t size, size_t capacity)
+{
+    for (int n = rand() % 4 + 1; n > 0; n--) {
+        size_t at = size ? (size_t)rand() % size : 0;
+        switch (rand() % 5) {
+        case 0:
+            if (size) {
+                data[at] = rand();
+            }
+            break;
+        case 1:
+            if (size) {
+                data[at] = s_Dictionary[rand() % (sizeof(s_Dictionary) - 1)];
+            }
+            break;
+        case 2:
+            if (size < capacity) {
+                memmove(data + at + 1, data + at, size - at);
+                data[at] = s_Dictionary[rand() % (sizeof(s_Dictionary) - 1)];
+                size++;
+            }
+            break;
+        case 3:
+            if (size) {
+                memmove(data + at, data + at + 1, size - at - 1);
+                size--;
+            }
+            break;
+        default:
+            size = at; // Truncated
+            break;
+        }
+    }
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t data[BUFFER_SIZE];
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            FILE *file = fopen(argv[i], "rb");
+            if (!file) {
+                perror(argv[i]);
+                return 1;
+            }
+            size_t size = fread(data, 1, sizeof(data), file);
+            fclose(file);
+            LLVMFuzzerTestOneInput(data, size);
+        }
+        return 0;
+    }
+
+    const int runs = 500000;
+    srand(1);
+    for (int i = 0; i < runs; i++) {
+        const char *seed = s_Seeds[i % (sizeof(s_Seeds) / sizeof(s_Seeds[0]))];
+        size_t size = strlen(seed);
+        memcpy(data, seed, size);
+        size = mutate(data, size, sizeof(data));
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%d mutated requests parsed\n", runs);
+    return 0;
+}
+
+#endif
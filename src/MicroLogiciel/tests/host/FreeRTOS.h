@@ -0,0 +1,51 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/* Host stand-in for the FreeRTOS kernel, on POSIX threads: tasks are threads, ticks are milliseconds of the monotonic
+ * clock, and critical sections share a single mutex. Priorities are ignored. The heap keeps heap_4's accounting, so
+ * that tests can check that nothing leaks. Implemented in freertos_host.c. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMINIMAL_STACK_SIZE 512
+#define configTOTAL_HEAP_SIZE (128 * 1024)
+#define tskIDLE_PRIORITY 0
+
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+#define portENTER_CRITICAL() vPortEnterCritical()
+#define portEXIT_CRITICAL() vPortExitCritical()
+
+// Interrupts of the host (the alarms of hardware/timer.h) run on the thread that delivers them: nothing to switch to
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+void *pvPortMalloc(size_t size);
+void vPortFree(void *block);
+size_t xPortGetFreeHeapSize(void);
+
+typedef struct
+{
+    size_t xAvailableHeapSpaceInBytes;
+    size_t xSizeOfLargestFreeBlockInBytes;
+    size_t xSizeOfSmallestFreeBlockInBytes;
+    size_t xNumberOfFreeBlocks;
+    size_t xMinimumEverFreeBytesRemaining;
+    size_t xNumberOfSuccessfulAllocations;
+    size_t xNumberOfSuccessfulFrees;
+} HeapStats_t;
+
+void vPortGetHeapStats(HeapStats_t *stats);
+
+#endif
@@ -0,0 +1,25 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "debug_printf.h"
+
+/* The firmware traces go to the USB serial port, on the host they are dropped unless DEBUG_PRINTF is set */
+void debug_printf(const char *fmt, ...)
+{
+    static int enabled = -1;
+    if (enabled < 0) {
+        enabled = getenv("DEBUG_PRINTF") != NULL;
+    }
+    if (enabled) {
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+    }
+}
+
+void debug_write(const void *data, int size)
+{
+    debug_printf("%.*s", size, (const char *)data);
+}
@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static pthread_mutex_t s_Critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void vPortEnterCritical(void)
+{
+    pthread_mutex_lock(&s_Critical);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&s_Critical);
+}
+
+// Heap: the C library allocates, the accounting is done here, with the size of each block stored in front of it
+static struct
+{
+    pthread_mutex_t lock;
+    size_t in_use;
+    size_t max_in_use;
+    size_t allocations;
+    size_t frees;
+} s_Heap = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+typedef union
+{
+    size_t size;
+    max_align_t align;
+} heap_header;
+
+void *pvPortMalloc(size_t size)
+{
+    pthread_mutex_lock(&s_Heap.lock);
+    bool fits = size <= configTOTAL_HEAP_SIZE - s_Heap.in_use;
+    if (fits) {
+        s_Heap.in_use += size;
+        s_Heap.allocations++;
+        if (s_Heap.in_use > s_Heap.max_in_use) {
+            s_Heap.max_in_use = s_Heap.in_use;
+        }
+    }
+    pthread_mutex_unlock(&s_Heap.lock);
+    if (!fits) {
+        return NULL;
+    }
+
+    heap_header *header = malloc(sizeof(heap_header) + size);
+    header->size = size;
+    return header + 1;
+}
+
+void vPortFree(void *block)
+{
+    if (!block) {
+        return;
+    }
+
+    heap_header *header = (heap_header *)block - 1;
+    pthread_mutex_lock(&s_Heap.lock);
+    s_Heap.in_use -= header->size;
+    s_Heap.frees++;
+    pthread_mutex_unlock(&s_Heap.lock);
+    free(header);
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    pthread_mutex_lock(&s_Heap.lock);
+    size_t free_size = configTOTAL_HEAP_SIZE - s_Heap.in_use;
+    pthread_mutex_unlock(&s_Heap.lock);
+    return free_size;
+}
+
+// Block placement is up to the C library: the free space is reported as a single block
+void vPortGetHeapStats(HeapStats_t *stats)
+{
+    pthread_mutex_lock(&s_Heap.lock);
+    size_t free_size = configTOTAL_HEAP_SIZE - s_Heap.in_use;
+    *stats = (HeapStats_t){
+        .xAvailableHeapSpaceInBytes = free_size,
+        .xSizeOfLargestFreeBlockInBytes = free_size,
+        .xSizeOfSmallestFreeBlockInBytes = free_size,
+        .xNumberOfFreeBlocks = 1,
+        .xMinimumEverFreeBytesRemaining = configTOTAL_HEAP_SIZE - s_Heap.max_in_use,
+        .xNumberOfSuccessfulAllocations = s_Heap.allocations,
+        .xNumberOfSuccessfulFrees = s_Heap.frees,
+    };
+    pthread_mutex_unlock(&s_Heap.lock);
+}
+
+// Monotonic time 'wait' ticks from now, for the timed waits on condition variables
+static struct timespec deadline_after(TickType_t wait)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait / 1000;
+    deadline.tv_nsec += (wait % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+// Tasks, each with its notification value
+struct host_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications;
+};
+
+typedef struct
+{
+    TaskFunction_t code;
+    void *params;
+    TaskHandle_t task;
+} task_start;
+
+static __thread TaskHandle_t s_CurrentTask;
+
+static TaskHandle_t create_task(pthread_t thread)
+{
+    // From the C library: the tasks are not accounted in the heap of the tests
+    TaskHandle_t task = malloc(sizeof(*task));
+    task->thread = thread;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&task->notified, &attr);
+    pthread_condattr_destroy(&attr);
+    task->notifications = 0;
+    return task;
+}
+
+static void *task_main(void *arg)
+{
+    task_start start = *(task_start *)arg;
+    free(arg);
+    s_CurrentTask = start.task;
+    start.code(start.params);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority, TaskHandle_t *created)
+{
+    (void)name;
+    (void)priority;
+    task_start *start = malloc(sizeof(*start));
+    *start = (task_start){ code, params, create_task(0) };
+    TaskHandle_t task = start->task;
+
+    // The C library needs more stack than the device
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    size_t stack_size = stack_depth * sizeof(uint32_t);
+    pthread_attr_setstacksize(&attr, stack_size < 65536 ? 65536 : stack_size);
+
+    int err = pthread_create(&task->thread, &attr, task_main, start);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        free(start);
+        free(task);
+        return pdFAIL;
+    }
+    if (created) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_CurrentTask) {
+        s_CurrentTask = create_task(pthread_self());
+    }
+    return s_CurrentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = deadline_after(wait);
+    pthread_mutex_lock(&task->lock);
+    while (!task->notifications && wait) {
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&task->notified, &task->lock);
+        } else if (pthread_cond_timedwait(&task->notified, &task->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notifications;
+    if (value) {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = { .tv_sec = ticks / 1000, .tv_nsec = (ticks % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+// Queues, and semaphores as queues of empty items
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    QueueSetHandle_t set;   // Told about every item sent, NULL if the queue is in no set
+    UBaseType_t length, item_size, count, head;
+    char items[];
+};
+
+static QueueHandle_t create_queue(UBaseType_t length, UBaseType_t item_size, UBaseType_t count)
+{
+    QueueHandle_t queue = pvPortMalloc(sizeof(struct host_queue) + length * item_size);
+    if (!queue) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->count = count;
+    queue->head = 0;
+    queue->set = NULL;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return create_queue(length, item_size, 0);
+}
+
+QueueHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return create_queue(max_count, 0, initial_count);
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+    vPortFree(queue);
+}
+
+// Waits under the queue lock until 'ready' holds, false once 'wait' ticks have passed
+static bool wait_for(QueueHandle_t queue, bool (*ready)(QueueHandle_t), TickType_t wait)
+{
+    struct timespec deadline = deadline_after(wait);
+    while (!ready(queue)) {
+        if (!wait) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->changed, &queue->lock, &deadline) == ETIMEDOUT) {
+            return ready(queue);
+        }
+    }
+    return true;
+}
+
+static bool has_space(QueueHandle_t queue)
+{
+    return queue->count < queue->length;
+}
+
+static bool has_items(QueueHandle_t queue)
+{
+    return queue->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool sent = wait_for(queue, has_space, wait);
+    if (sent) {
+        if (queue->item_size) {
+            memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+        }
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    // After the item, so that the member selected from the set always has it
+    if (sent && queue->set) {
+        xQueueSend(queue->set, &queue, 0);
+    }
+    return sent ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool received = wait_for(queue, has_items, wait);
+    if (received) {
+        if (queue->item_size) {
+            memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        }
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length)
+{
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    pthread_mutex_lock(&member->lock);
+    bool added = !member->set && !member->count;
+    if (added) {
+        member->set = set;
+    }
+    pthread_mutex_unlock(&member->lock);
+    return added ? pdPASS : pdFAIL;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t wait)
+{
+    QueueSetMemberHandle_t member;
+    return xQueueReceive(set, &member, wait) == pdTRUE ? member : NULL;
+}
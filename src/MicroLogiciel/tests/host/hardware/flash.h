@@ -0,0 +1,24 @@
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+
+/* Host stand-in for the Pico SDK header. The settings of the firmware are constants of the program on the host, the
+ * writes are dropped. */
+#include "pico/stdlib.h"
+
+#define FLASH_SECTOR_SIZE 4096
+#define XIP_BASE 0x10000000
+
+static inline void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    (void)flash_offs;
+    (void)count;
+}
+
+static inline void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    (void)flash_offs;
+    (void)data;
+    (void)count;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_HARDWARE_GPIO_H
+#define HOST_HARDWARE_GPIO_H
+
+/* Host stand-in for the Pico SDK header: the output levels are kept for the tests to read. Implemented in
+ * pico_host.c. */
+#include "pico/stdlib.h"
+
+void gpio_init_mask(uint32_t gpio_mask);
+void gpio_set_dir_out_masked(uint32_t mask);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+void gpio_clr_mask(uint32_t mask);
+bool gpio_get_out_level(uint gpio);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+/* Host stand-in for the Pico SDK header. Spin locks are mutexes. Interrupts are disabled per thread, as they are per
+ * core on the device: an interrupt forced while they are disabled is delivered on that thread once they are restored
+ * (see hardware/timer.h). Implemented in pico_host.c. */
+#include "pico/stdlib.h"
+
+typedef struct host_spin_lock spin_lock_t;
+
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+int spin_lock_claim_unused(bool required);
+spin_lock_t *spin_lock_init(uint lock_num);
+uint32_t spin_lock_blocking(spin_lock_t *lock);
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq);
+
+#endif
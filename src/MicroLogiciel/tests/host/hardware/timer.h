@@ -0,0 +1,36 @@
+#ifndef HOST_HARDWARE_TIMER_H
+#define HOST_HARDWARE_TIMER_H
+
+/* Host stand-in for the Pico SDK header, on a virtual clock that only the tests move: a session of hours runs in
+ * microseconds and every edge lands on its exact microsecond. The alarms fire as the clock passes their target, on
+ * the thread moving it, or when forced. Implemented in pico_host.c. */
+#include "pico/stdlib.h"
+
+typedef uint64_t absolute_time_t;
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+static inline absolute_time_t from_us_since_boot(uint64_t us)
+{
+    return us;
+}
+
+uint64_t time_us_64(void);
+
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+// True, and nothing armed, if 'target' has already passed
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t target);
+void hardware_alarm_cancel(uint alarm_num);
+void hardware_alarm_force_irq(uint alarm_num);
+
+/* Host only. Moves the clock to 'until_us', firing on the way every alarm due by then, each at its target plus the
+ * latency given by host_alarm_set_latency(). A late alarm may leave the clock past 'until_us'. */
+void host_time_run_until(uint64_t until_us);
+
+/* Delay between the target of each alarm and its callback, NULL for none */
+void host_alarm_set_latency(uint32_t (*latency_us)(void *context), void *context);
+
+/* The target of 'alarm_num', false if it is not armed */
+bool host_alarm_armed(uint alarm_num, uint64_t *target_us);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HOST_HARDWARE_WATCHDOG_H
+#define HOST_HARDWARE_WATCHDOG_H
+
+/* Host stand-in for the Pico SDK header: the firmware reboots to load new settings, on the host it keeps running */
+#include "pico/stdlib.h"
+
+#define SRAM_END 0x20082000
+
+static inline void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms)
+{
+    (void)pc;
+    (void)sp;
+    (void)delay_ms;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HOST_LWIP_API_H
+#define HOST_LWIP_API_H
+
+#include <stddef.h>
+
+/* Host stand-in for the netconn API. There are no netconns behind the host sockets, so the no-copy writes of the
+ * server fall back to regular sends and these are never called. */
+typedef signed char err_t;
+struct netconn;
+
+#define ERR_OK 0
+#define ERR_WOULDBLOCK -7
+#define NETCONN_NOCOPY 0x00
+
+static inline err_t netconn_write_partly(struct netconn *conn, const void *data, size_t size, unsigned char flags, size_t *written)
+{
+    (void)conn;
+    (void)data;
+    (void)size;
+    (void)flags;
+    *written = 0;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_LWIP_IP4_ADDR_H
+#define HOST_LWIP_IP4_ADDR_H
+
+#include "pico/cyw43_arch.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_LWIP_NETIF_H
+#define HOST_LWIP_NETIF_H
+
+/* Host stand-in: nothing of the network interfaces is used by the sources built on the host */
+
+#endif
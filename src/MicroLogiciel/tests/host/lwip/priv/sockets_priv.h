@@ -0,0 +1,18 @@
+#ifndef HOST_LWIP_SOCKETS_PRIV_H
+#define HOST_LWIP_SOCKETS_PRIV_H
+
+#include "lwip/api.h"
+
+struct lwip_sock
+{
+    struct netconn *conn;
+};
+
+// Host sockets have no lwIP socket behind them
+static inline struct lwip_sock *lwip_socket_dbg_get_socket(int s)
+{
+    (void)s;
+    return NULL;
+}
+
+#endif
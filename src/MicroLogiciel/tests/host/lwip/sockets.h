@@ -0,0 +1,51 @@
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+/* Host stand-in for the lwIP socket API: the POSIX sockets it mirrors */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define MEM_SIZE 16384 // From lwipopts.h
+#define closesocket close
+
+/* Write calls of the server, counted by the tests of its reply path: on the device, each one is pushed to the network
+ * in segments of its own. Defined by http_host.c. */
+extern unsigned long host_send_calls, host_writev_calls;
+
+static inline ssize_t host_send(int s, const void *data, size_t size, int flags)
+{
+    __atomic_fetch_add(&host_send_calls, 1, __ATOMIC_SEQ_CST);
+    return send(s, data, size, flags);
+}
+#define send(s, data, size, flags) host_send(s, data, size, flags)
+
+static inline ssize_t lwip_writev(int s, const struct iovec *iov, int count)
+{
+    __atomic_fetch_add(&host_writev_calls, 1, __ATOMIC_SEQ_CST);
+    return writev(s, iov, count);
+}
+
+// lwIP addresses carry their length, POSIX ones do not: the field lands in padding
+#define sin_len sin_zero[0]
+
+/* lwIP listening sockets can be bound again right away, POSIX ones only with SO_REUSEADDR. The send buffer, inherited
+ * by accepted sockets, is cut down to the lwIP heap (Linux doubles the value given): a large reply keeps its worker busy
+ * until the client has read most of it, as on the device. */
+static inline int host_socket(int domain, int type, int protocol)
+{
+    int s = socket(domain, type, protocol);
+    int one = 1, send_buffer = MEM_SIZE / 2;
+    if (s >= 0) {
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+    }
+    return s;
+}
+#define socket(domain, type, protocol) host_socket(domain, type, protocol)
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+/* Host stand-in for the Pico SDK header: the lwIP address helpers it brings in, and the LED of the wireless chip, kept
+ * for the tests to read (pico_host.c) */
+#include <arpa/inet.h>
+
+#include "pico/stdlib.h"
+
+typedef struct
+{
+    uint32_t addr;
+} ip4_addr_t;
+
+static inline int ip4addr_aton(const char *text, ip4_addr_t *dest)
+{
+    struct in_addr addr;
+    if (!inet_aton(text, &addr)) {
+        return 0;
+    }
+    dest->addr = addr.s_addr;
+    return 1;
+}
+
+static inline uint32_t ipaddr_addr(const char *text)
+{
+    ip4_addr_t addr;
+    return ip4addr_aton(text, &addr) ? addr.addr : 0xFFFFFFFF; // IPADDR_NONE
+}
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+bool cyw43_arch_gpio_get(uint wl_gpio);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+/* Host stand-in for the Pico SDK header: the standard headers it brings along, for the sources built on the host, and
+ * the time functions */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef unsigned int uint;
+
+#include "hardware/timer.h"
+
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
+
+// From newlib, the C library of the device
+static inline char *strnstr(const char *haystack, const char *needle, size_t len)
+{
+    size_t needle_len = strlen(needle);
+    for (size_t i = 0; needle_len <= len && i <= len - needle_len && haystack[i]; i++) {
+        if (!strncmp(haystack + i, needle, needle_len)) {
+            return (char *)haystack + i;
+        }
+    }
+    return NULL;
+}
+
+#endif
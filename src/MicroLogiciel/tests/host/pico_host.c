@@ -0,0 +1,248 @@
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/cyw43_arch.h"
+
+#include <pthread.h>
+
+#define ALARM_COUNT 4
+#define SPIN_LOCK_COUNT 32
+#define SPIN_LOCK_FIRST_UNUSED 16 // Below are those the SDK reserves
+
+// Virtual clock and alarms, under s_TimerLock. Callbacks are called without it.
+static pthread_mutex_t s_TimerLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_NowUs;
+static struct
+{
+    bool claimed;
+    bool armed;
+    bool forced;            // Pending until interrupts are enabled on the forcing thread
+    uint64_t target_us;
+    hardware_alarm_callback_t callback;
+} s_Alarms[ALARM_COUNT];
+static uint32_t (*s_LatencyUs)(void *context);
+static void *s_LatencyContext;
+
+struct host_spin_lock
+{
+    pthread_mutex_t mutex;
+};
+static spin_lock_t s_SpinLocks[SPIN_LOCK_COUNT];
+static bool s_SpinLocksClaimed[SPIN_LOCK_COUNT];
+
+static __thread uint32_t s_InterruptsDisabled;
+
+static uint32_t s_GpioOut;
+static bool s_LedOn;
+
+// Runs the callbacks of the forced alarms, on the calling thread
+static void deliver_forced(void)
+{
+    for (int i = 0; i < ALARM_COUNT; i++) {
+        pthread_mutex_lock(&s_TimerLock);
+        bool forced = s_Alarms[i].forced;
+        hardware_alarm_callback_t callback = s_Alarms[i].callback;
+        s_Alarms[i].forced = false;
+        pthread_mutex_unlock(&s_TimerLock);
+        if (forced && callback) {
+            callback(i);
+        }
+    }
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    return s_InterruptsDisabled++;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    s_InterruptsDisabled = status;
+    if (!status) {
+        deliver_forced();
+    }
+}
+
+int spin_lock_claim_unused(bool required)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    int lock_num = -1;
+    for (int i = SPIN_LOCK_FIRST_UNUSED; i < SPIN_LOCK_COUNT && lock_num < 0; i++) {
+        if (!s_SpinLocksClaimed[i]) {
+            s_SpinLocksClaimed[i] = true;
+            lock_num = i;
+        }
+    }
+    pthread_mutex_unlock(&s_TimerLock);
+    if (lock_num < 0 && required) {
+        abort();
+    }
+    return lock_num;
+}
+
+spin_lock_t *spin_lock_init(uint lock_num)
+{
+    spin_lock_t *lock = &s_SpinLocks[lock_num];
+    pthread_mutex_init(&lock->mutex, NULL);
+    return lock;
+}
+
+uint32_t spin_lock_blocking(spin_lock_t *lock)
+{
+    uint32_t save = save_and_disable_interrupts();
+    pthread_mutex_lock(&lock->mutex);
+    return save;
+}
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq)
+{
+    pthread_mutex_unlock(&lock->mutex);
+    restore_interrupts(saved_irq);
+}
+
+uint64_t time_us_64(void)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    uint64_t now_us = s_NowUs;
+    pthread_mutex_unlock(&s_TimerLock);
+    return now_us;
+}
+
+int hardware_alarm_claim_unused(bool required)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    int alarm_num = -1;
+    for (int i = 0; i < ALARM_COUNT && alarm_num < 0; i++) {
+        if (!s_Alarms[i].claimed) {
+            s_Alarms[i].claimed = true;
+            alarm_num = i;
+        }
+    }
+    pthread_mutex_unlock(&s_TimerLock);
+    if (alarm_num < 0 && required) {
+        abort();
+    }
+    return alarm_num;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    s_Alarms[alarm_num].callback = callback;
+    pthread_mutex_unlock(&s_TimerLock);
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t target)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    bool missed = target <= s_NowUs;
+    s_Alarms[alarm_num].armed = !missed;
+    s_Alarms[alarm_num].target_us = target;
+    pthread_mutex_unlock(&s_TimerLock);
+    return missed;
+}
+
+void hardware_alarm_cancel(uint alarm_num)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    s_Alarms[alarm_num].armed = false;
+    s_Alarms[alarm_num].forced = false;
+    pthread_mutex_unlock(&s_TimerLock);
+}
+
+void hardware_alarm_force_irq(uint alarm_num)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    s_Alarms[alarm_num].forced = true;
+    pthread_mutex_unlock(&s_TimerLock);
+    if (!s_InterruptsDisabled) {
+        deliver_forced();
+    }
+}
+
+void host_time_run_until(uint64_t until_us)
+{
+    for (;;) {
+        pthread_mutex_lock(&s_TimerLock);
+        int due = -1;
+        for (int i = 0; i < ALARM_COUNT; i++) {
+            if (s_Alarms[i].armed && s_Alarms[i].target_us <= until_us &&
+                (due < 0 || s_Alarms[i].target_us < s_Alarms[due].target_us)) {
+                due = i;
+            }
+        }
+        if (due < 0) {
+            if (until_us > s_NowUs) {
+                s_NowUs = until_us;
+            }
+            pthread_mutex_unlock(&s_TimerLock);
+            return;
+        }
+
+        // The clock is where the interrupt would have read it
+        uint64_t fired_us = s_Alarms[due].target_us + (s_LatencyUs ? s_LatencyUs(s_LatencyContext) : 0);
+        if (fired_us > s_NowUs) {
+            s_NowUs = fired_us;
+        }
+        s_Alarms[due].armed = false;
+        hardware_alarm_callback_t callback = s_Alarms[due].callback;
+        pthread_mutex_unlock(&s_TimerLock);
+        if (callback) {
+            callback(due);
+        }
+    }
+}
+
+void host_alarm_set_latency(uint32_t (*latency_us)(void *context), void *context)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    s_LatencyUs = latency_us;
+    s_LatencyContext = context;
+    pthread_mutex_unlock(&s_TimerLock);
+}
+
+bool host_alarm_armed(uint alarm_num, uint64_t *target_us)
+{
+    pthread_mutex_lock(&s_TimerLock);
+    bool armed = s_Alarms[alarm_num].armed;
+    *target_us = s_Alarms[alarm_num].target_us;
+    pthread_mutex_unlock(&s_TimerLock);
+    return armed;
+}
+
+// The outputs are only read by the tests, from any thread
+void gpio_init_mask(uint32_t gpio_mask)
+{
+    (void)gpio_mask;
+}
+
+void gpio_set_dir_out_masked(uint32_t mask)
+{
+    (void)mask;
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    uint32_t out = __atomic_load_n(&s_GpioOut, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&s_GpioOut, (out & ~mask) | (value & mask), __ATOMIC_SEQ_CST);
+}
+
+void gpio_clr_mask(uint32_t mask)
+{
+    __atomic_fetch_and(&s_GpioOut, ~mask, __ATOMIC_SEQ_CST);
+}
+
+bool gpio_get_out_level(uint gpio)
+{
+    return (__atomic_load_n(&s_GpioOut, __ATOMIC_SEQ_CST) >> gpio) & 1;
+}
+
+void cyw43_arch_gpio_put(uint wl_gpio, bool value)
+{
+    __atomic_store_n(&s_LedOn, value, __ATOMIC_SEQ_CST);
+}
+
+bool cyw43_arch_gpio_get(uint wl_gpio)
+{
+    return __atomic_load_n(&s_LedOn, __ATOMIC_SEQ_CST);
+}
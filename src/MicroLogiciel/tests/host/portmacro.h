@@ -0,0 +1,7 @@
+#ifndef HOST_PORTMACRO_H
+#define HOST_PORTMACRO_H
+
+/* Host stand-in for the port layer of FreeRTOS, whose macros are in FreeRTOS.h */
+#include "FreeRTOS.h"
+
+#endif
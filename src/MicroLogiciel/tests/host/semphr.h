@@ -0,0 +1,18 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+#include "queue.h"
+
+/* Semaphores are queues of empty items, as in FreeRTOS. Mutexes are not recursive and have no priority inheritance. */
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef QueueHandle_t xSemaphoreHandle;
+
+QueueHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+
+#define xSemaphoreCreateMutex() xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreCreateBinary() xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreTake(semaphore, wait) xQueueReceive((semaphore), NULL, (wait))
+#define xSemaphoreGive(semaphore) xQueueSend((semaphore), NULL, 0)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif
@@ -0,0 +1,273 @@
+#include "http_host.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+unsigned long host_send_calls, host_writev_calls;
+
+static char *s_Large;
+static int s_LargeSize;
+static http_event_source s_Events;
+
+static bool do_ping(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_reply(conn, "200 OK", "text/plain", "pong", -1);
+    return true;
+}
+
+static bool do_echo(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    char *line = http_server_read_post_line(conn);
+    http_server_send_reply(conn, "200 OK", "text/plain", line ? line : "", -1);
+    return true;
+}
+
+static bool do_events(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_subscribe_events(conn, s_Events);
+    return true;
+}
+
+static bool do_large(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_reply(conn, "200 OK", "application/octet-stream", s_Large, s_LargeSize);
+    return true;
+}
+
+static bool do_stop(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_reply(conn, "200 OK", "text/plain", "stopped", -1);
+    return true;
+}
+
+static bool do_fallback(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    return false;
+}
+
+static uint32_t admitted(const http_server_stats *stats)
+{
+    return stats->pool_hits + stats->pool_exhausted;
+}
+
+http_server_instance http_host_start(int large_size)
+{
+    static const http_route routes[] = {
+        { "/echo", { [HTTP_POST] = do_echo } },
+        { "/events", { [HTTP_GET] = do_events } },
+        { "/large", { [HTTP_GET] = do_large } },
+        { "/ping", { [HTTP_GET] = do_ping } },
+        { "/stop", { [HTTP_POST] = do_stop }, NULL, true },
+    };
+
+    s_LargeSize = large_size;
+    s_Large = malloc(large_size ? large_size : 1);
+    memset(s_Large, 'x', large_size);
+
+    s_Events = http_server_create_event_source(HTTP_HOST_SUBSCRIBERS, HTTP_HOST_EVENT_SIZE);
+    return http_host_start_routes(routes, sizeof(routes) / sizeof(routes[0]), NULL, NULL);
+}
+
+http_server_instance http_host_start_routes(const http_route *routes, int count, http_request_handler fallback, void *context)
+{
+    // lwIP reports a send to a closed connection as an error, not with a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    http_server_instance server = http_server_create("pico", "local", HTTP_HOST_WORKERS, HTTP_HOST_BUFFER_SIZE);
+    if (server) {
+        http_server_set_routes(server, routes, count, fallback ? fallback : do_fallback, context);
+    }
+
+    // The accept loop runs on its own task: wait until it has taken a connection, so that tests start from quiet counters
+    for (int i = 0; server && i < 100; i++) {
+        int s = http_host_connect();
+        if (s >= 0) {
+            close(s);
+            http_host_wait_stat(server, admitted, 1, 1000);
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return server;
+}
+
+http_host_writes http_host_get_writes(void)
+{
+    return (http_host_writes){
+        .send = __atomic_load_n(&host_send_calls, __ATOMIC_SEQ_CST),
+        .writev = __atomic_load_n(&host_writev_calls, __ATOMIC_SEQ_CST),
+    };
+}
+
+http_event_source http_host_events(void)
+{
+    return s_Events;
+}
+
+int http_host_connect(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(HTTP_SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s >= 0 && connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(s);
+        s = -1;
+    }
+    return s;
+}
+
+int http_host_exchange(const char *request, char *reply, int size)
+{
+    int s = http_host_connect();
+    if (s < 0) {
+        return -1;
+    }
+
+    // A test expecting a reply that never comes fails instead of hanging
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int len = strlen(request), total = 0;
+    if (send(s, request, len, 0) != len) {
+        close(s);
+        return -1;
+    }
+
+    char discard[512];
+    for (;;) {
+        char *dest = total < size - 1 ? reply + total : discard;
+        int room = total < size - 1 ? size - 1 - total : (int)sizeof(discard);
+        int done = recv(s, dest, room, 0);
+        if (done <= 0) {
+            break;
+        }
+        total += done;
+    }
+    close(s);
+    reply[total < size - 1 ? total : size - 1] = 0;
+    return total;
+}
+
+bool http_host_wait_stat(http_server_instance server, uint32_t (*counter)(const http_server_stats *), uint32_t value, int timeout_ms)
+{
+    for (int waited = 0;; waited += 10) {
+        http_server_stats stats;
+        http_server_get_stats(server, &stats);
+        if (counter(&stats) >= value) {
+            return true;
+        }
+        if (waited >= timeout_ms) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+typedef struct
+{
+    pthread_t thread;
+    http_host_downloads downloads;
+    volatile bool receiving;
+} download_client;
+
+struct http_host_downloads
+{
+    int count;
+    int read_delay_ms;
+    volatile bool stop;
+    long long bytes;
+    download_client clients[];
+};
+
+static void *download_thread(void *arg)
+{
+    static const char request[] = "GET /large HTTP/1.1\r\nHost: pico\r\nConnection: close\r\n\r\n";
+    download_client *client = arg;
+    http_host_downloads downloads = client->downloads;
+    char buffer[4096];
+
+    while (!downloads->stop) {
+        int s = http_host_connect();
+        if (s < 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        // Short receive timeouts, so that stopping does not wait for the server
+        struct timeval timeout = { .tv_usec = 100000 };
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (send(s, request, sizeof(request) - 1, 0) == sizeof(request) - 1) {
+            while (!downloads->stop) {
+                int done = recv(s, buffer, sizeof(buffer), 0);
+                if (done == 0 || (done < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+                    break;
+                }
+                if (done > 0) {
+                    client->receiving = true;
+                    __atomic_add_fetch(&downloads->bytes, done, __ATOMIC_RELAXED);
+                }
+                if (downloads->read_delay_ms) {
+                    vTaskDelay(pdMS_TO_TICKS(downloads->read_delay_ms));
+                }
+            }
+        }
+        close(s);
+        client->receiving = false;
+    }
+    return NULL;
+}
+
+http_host_downloads http_host_start_downloads(int count, int read_delay_ms)
+{
+    http_host_downloads downloads = calloc(1, sizeof(*downloads) + count * sizeof(downloads->clients[0]));
+    downloads->count = count;
+    downloads->read_delay_ms = read_delay_ms;
+    for (int i = 0; i < count; i++) {
+        downloads->clients[i].downloads = downloads;
+        pthread_create(&downloads->clients[i].thread, NULL, download_thread, &downloads->clients[i]);
+    }
+    return downloads;
+}
+
+bool http_host_wait_downloads(http_host_downloads downloads, int timeout_ms)
+{
+    for (int waited = 0;; waited += 10) {
+        int receiving = 0;
+        for (int i = 0; i < downloads->count; i++) {
+            receiving += downloads->clients[i].receiving;
+        }
+        if (receiving == downloads->count) {
+            return true;
+        }
+        if (waited >= timeout_ms) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+long long http_host_stop_downloads(http_host_downloads downloads)
+{
+    downloads->stop = true;
+    for (int i = 0; i < downloads->count; i++) {
+        pthread_join(downloads->clients[i].thread, NULL);
+    }
+    long long bytes = downloads->bytes;
+    free(downloads);
+    return bytes;
+}
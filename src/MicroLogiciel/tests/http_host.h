@@ -0,0 +1,59 @@
+#ifndef HTTP_HOST_H
+#define HTTP_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "httpserver.h"
+
+#define HTTP_HOST_WORKERS 4         // As main.c creates the server
+#define HTTP_HOST_BUFFER_SIZE 4096
+#define HTTP_HOST_SUBSCRIBERS 2
+#define HTTP_HOST_EVENT_SIZE 1024
+
+/* The HTTP server of the firmware running on the host, over FreeRTOS and lwIP stand-ins, on HTTP_SERVER_PORT of the
+ * loopback interface. Its routes:
+ *   GET /ping      replies "pong"
+ *   POST /echo     replies with the first line of the body
+ *   GET /events    subscribes to the events published to http_host_events()
+ *   GET /large     replies 'large_size' bytes, for clients that stop reading
+ *   POST /stop     priority route, replies "stopped" */
+http_server_instance http_host_start(int large_size);
+
+/* The same server with other routes, for the handlers of the firmware. Paths none of them matches go to 'fallback'
+ * with 'context', or get a 404 if it is NULL. */
+http_server_instance http_host_start_routes(const http_route *routes, int count, http_request_handler fallback, void *context);
+
+/* Write calls made by the server on its sockets since it started, send() and lwip_writev() apart */
+typedef struct
+{
+    unsigned long send;
+    unsigned long writev;
+} http_host_writes;
+http_host_writes http_host_get_writes(void);
+
+/* The event source of the /events route */
+http_event_source http_host_events(void);
+
+/* Connects to the server, -1 on failure */
+int http_host_connect(void);
+
+/* Sends 'request' on a new connection and reads the reply until the server closes the connection. Returns the length
+ * of the reply copied into 'reply' (truncated to 'size' - 1 bytes and terminated), -1 if the connection failed. */
+int http_host_exchange(const char *request, char *reply, int size);
+
+/* Clients downloading /large over and over, each on its own thread, and holding a worker while it downloads. They read
+ * 4 KB at a time, waiting 'read_delay_ms' between reads (0 for full speed). */
+typedef struct http_host_downloads *http_host_downloads;
+http_host_downloads http_host_start_downloads(int count, int read_delay_ms);
+
+/* Waits until every download client is receiving, i.e. holds a worker, false after 'timeout_ms' */
+bool http_host_wait_downloads(http_host_downloads downloads, int timeout_ms);
+
+/* Stops the download clients, closing their connections. Returns the number of bytes they received. */
+long long http_host_stop_downloads(http_host_downloads downloads);
+
+/* Waits until the server counter read by 'counter' reaches 'value', false after 'timeout_ms' */
+bool http_host_wait_stat(http_server_instance server, uint32_t (*counter)(const http_server_stats *), uint32_t value, int timeout_ms);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef ROUTES_H
+#define ROUTES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "httpserver.h"
+
+#define ROUTES_PER_AREA 8 // Endpoints under each /api/<area>, as under /api/timer
+
+/* Generated route table of 'count' endpoints, sorted as main.c declares its own: /api/area<a>/endpoint<e> */
+static inline void routes_generate(http_route *routes, char (*paths)[32], int count)
+{
+    for (int i = 0; i < count; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/api/area%03d/endpoint%d", i / ROUTES_PER_AREA, i % ROUTES_PER_AREA);
+        routes[i] = (http_route){ .path = paths[i] };
+    }
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "sequence_sim.h"
+
+#include <stddef.h>
+
+static void trace(sim_engine *sim, const sequence_event *event)
+{
+    if (sim->count < sim->capacity) {
+        sim->trace[sim->count] = (sim_edge){
+            .at_us = sim->now_us,
+            .frame = event->frame,
+            .pins = event->pins,
+            .flags = event->flags,
+        };
+    }
+    sim->count++;
+}
+
+void sim_start(sim_engine *sim, const sequence_program *program, uint64_t start_us, sim_edge *trace, int capacity)
+{
+    sequence_cursor_start(&sim->cursor, program->events, program->count, start_us);
+    sim->now_us = start_us;
+    sim->trace = trace;
+    sim->capacity = trace ? capacity : 0;
+    sim->count = 0;
+}
+
+void sim_run_until(sim_engine *sim, uint64_t until_us)
+{
+    sequence_cursor *cursor = &sim->cursor;
+    while (!cursor->paused && !sequence_cursor_done(cursor) && cursor->next_edge_us <= until_us) {
+        sim->now_us = cursor->next_edge_us;
+        trace(sim, sequence_cursor_advance(cursor));
+    }
+    if (until_us != UINT64_MAX) {
+        sim->now_us = until_us;
+    }
+}
+
+void sim_skip(sim_engine *sim)
+{
+    trace(sim, sequence_cursor_skip(&sim->cursor));
+}
+
+int sim_count(const sim_engine *sim, uint8_t flags)
+{
+    int count = 0;
+    int traced = sim->count < sim->capacity ? sim->count : sim->capacity;
+    for (int i = 0; i < traced; i++) {
+        if ((sim->trace[i].flags & flags) == flags) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,58 @@
+#ifndef SEQUENCE_SIM_H
+#define SEQUENCE_SIM_H
+
+#include "sequence.h"
+
+#define SEQUENCE_SIM_RESTART_US 1000 // Delay before an exposure cut short by a pause is taken again, SHUTTER_START_LEAD_US on the device
+
+/* Walks a compiled sequence with its cursor alone, on a virtual clock, and keeps a trace of every event produced,
+ * including those that change no output: the schedule the sequence compiler produces, checked event by event. A
+ * session of hours runs in microseconds and its trace is exact to the microsecond. The shutter engine itself, alarm
+ * included, is run by test_shutter and test_commands on the host alarm of host/pico_host.c. */
+
+typedef struct
+{
+    uint64_t at_us;
+    uint16_t frame;
+    uint8_t pins;
+    uint8_t flags;
+} sim_edge;
+
+typedef struct
+{
+    sequence_cursor cursor;
+    uint64_t now_us;
+    sim_edge *trace;        // Provided by the caller, may be NULL
+    int capacity;
+    int count;              // Events produced, including those beyond the capacity of the trace
+} sim_engine;
+
+void sim_start(sim_engine *sim, const sequence_program *program, uint64_t start_us, sim_edge *trace, int capacity);
+
+/* Produces the events due up to 'until_us' and moves the clock there, or to the last event when 'until_us' is
+ * UINT64_MAX. Nothing is produced while paused. */
+void sim_run_until(sim_engine *sim, uint64_t until_us);
+
+static inline void sim_run(sim_engine *sim)
+{
+    sim_run_until(sim, UINT64_MAX);
+}
+
+/* The commands of the timer task, applied at the current virtual time */
+static inline void sim_pause(sim_engine *sim)
+{
+    sequence_cursor_pause(&sim->cursor, sim->now_us, SEQUENCE_SIM_RESTART_US);
+}
+
+static inline void sim_resume(sim_engine *sim)
+{
+    sequence_cursor_resume(&sim->cursor, sim->now_us);
+}
+
+/* Traces the event that closes the exposure dropped, as the engine reports it */
+void sim_skip(sim_engine *sim);
+
+/* Counts the traced events carrying all of 'flags' */
+int sim_count(const sim_engine *sim, uint8_t flags);
+
+#endif
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include "simplefs_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool write_file(const char *path, const char *contents)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fputs(contents, f) >= 0;
+    return fclose(f) == 0 && ok;
+}
+
+static void *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void *data = malloc(size);
+    if (data && fread(data, 1, size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+// Runs the builder on the files written under 'root', maps the image and removes both
+static bool pack(simplefs_image *image, const char *root, bool ok)
+{
+    char path[128], command[512];
+    snprintf(path, sizeof(path), "%s.bin", root);
+    snprintf(command, sizeof(command), "'%s' '%s' '%s' > /dev/null", SIMPLEFS_BUILDER, root, path);
+    ok = ok && system(command) == 0;
+    image->data = ok ? read_file(path) : NULL;
+    ok = image->data && simplefs_init(&image->fs, image->data);
+
+    snprintf(command, sizeof(command), "rm -rf '%s' '%s'", root, path);
+    system(command);
+    return ok;
+}
+
+bool simplefs_image_build(simplefs_image *image, int count)
+{
+    static const char *const extensions[] = { "css", "png", "svg", "txt" };
+    char root[] = "/tmp/simplefs_XXXXXX";
+    char path[128];
+
+    memset(image, 0, sizeof(*image));
+    image->paths = calloc(count, sizeof(*image->paths));
+    if (!image->paths || !mkdtemp(root)) {
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < 8 && ok; i++) {
+        snprintf(path, sizeof(path), "%s/d%d", root, i);
+        ok = mkdir(path, 0700) == 0;
+    }
+    for (int i = 0; i < count && ok; i++) {
+        snprintf(image->paths[i], sizeof(image->paths[i]), "d%d/file%d.%s", i % 8, i, extensions[i % 4]);
+        snprintf(path, sizeof(path), "%s/%s", root, image->paths[i]);
+        ok = write_file(path, image->paths[i]);
+    }
+    image->count = count;
+    return pack(image, root, ok);
+}
+
+bool simplefs_image_build_files(simplefs_image *image, const char *const *paths, const char *const *contents, int count)
+{
+    char root[] = "/tmp/simplefs_XXXXXX";
+    char path[128];
+
+    memset(image, 0, sizeof(*image));
+    image->paths = calloc(count, sizeof(*image->paths));
+    if (!image->paths || !mkdtemp(root)) {
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        snprintf(image->paths[i], sizeof(image->paths[i]), "%s", paths[i]);
+        snprintf(path, sizeof(path), "%s/%s", root, paths[i]);
+        ok = write_file(path, contents[i]);
+    }
+    image->count = count;
+    return pack(image, root, ok);
+}
+
+void simplefs_image_free(simplefs_image *image)
+{
+    free(image->data);
+    free(image->paths);
+}
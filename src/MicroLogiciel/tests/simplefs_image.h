@@ -0,0 +1,22 @@
+#ifndef SIMPLEFS_IMAGE_H
+#define SIMPLEFS_IMAGE_H
+
+#include "simplefs.h"
+
+/* Builds an image of 'count' generated files with SimpleFSBuilder, the way the www image is built, and maps it.
+ * The files are spread over a few directories, like the assets of the web app. */
+typedef struct
+{
+    struct SimpleFSContext fs;
+    void *data;
+    int count;
+    char (*paths)[32];      // Archive path of every file
+} simplefs_image;
+
+bool simplefs_image_build(simplefs_image *image, int count);
+/* Builds an image of the given files, at the root of the image, with the given contents */
+bool simplefs_image_build_files(simplefs_image *image, const char *const *paths, const char *const *contents, int count);
+
+void simplefs_image_free(simplefs_image *image);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/* Checks keep going after a failure, main() returns test_failures() so that ctest reports the executable as failed. */
+static int s_TestFailures;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            s_TestFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        uint64_t actual_ = (uint64_t)(actual), expected_ = (uint64_t)(expected); \
+        if (actual_ != expected_) { \
+            fprintf(stderr, "%s:%d: %s is %" PRIu64 ", expected %" PRIu64 "\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+            s_TestFailures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) do { \
+        int before_ = s_TestFailures; \
+        test(); \
+        printf("%s %s\n", s_TestFailures == before_ ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+static inline int test_failures(void)
+{
+    return s_TestFailures ? 1 : 0;
+}
+
+#endif
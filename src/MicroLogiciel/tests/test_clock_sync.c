@@ -0,0 +1,148 @@
+#include <stdlib.h>
+
+#include "clock_sync.h"
+#include "test.h"
+
+#define SECOND_US 1000000LL
+
+/* A remote clock running at (1 + drift_ppm / 10^6) times the local one, 'offset_us' behind it at local time 0, reached
+ * through a network whose one-way delays are drawn between 'min_delay_us' and 'max_delay_us' */
+typedef struct
+{
+    int64_t offset_us;
+    int64_t drift_ppm;
+    uint32_t min_delay_us;
+    uint32_t max_delay_us;
+} skewed_clock;
+
+static uint64_t remote_time(const skewed_clock *clock, uint64_t local_us)
+{
+    return local_us - clock->offset_us + (int64_t)local_us * clock->drift_ppm / 1000000;
+}
+
+static uint32_t delay(const skewed_clock *clock)
+{
+    return clock->min_delay_us + (uint32_t)rand() % (clock->max_delay_us - clock->min_delay_us + 1);
+}
+
+// One exchange starting at local time 'local_us', the device taking 200 us to reply
+static bool exchange(clock_sync *sync, const skewed_clock *clock, uint64_t local_us)
+{
+    uint64_t t1 = local_us + delay(clock), t2 = t1 + 200;
+    uint64_t t3_local = t2 + delay(clock);
+    return clock_sync_add(sync, remote_time(clock, local_us), t1, t2, remote_time(clock, t3_local));
+}
+
+static int64_t conversion_error(const clock_sync *sync, const skewed_clock *clock, uint64_t local_us)
+{
+    return (int64_t)(clock_sync_to_local(sync, remote_time(clock, local_us)) - local_us);
+}
+
+static int64_t abs64(int64_t x)
+{
+    return x < 0 ? -x : x;
+}
+
+// Without drift a symmetric network gives the offset to the microsecond
+static void test_offset(void)
+{
+    skewed_clock clock = { .offset_us = -1700000000 * SECOND_US, .min_delay_us = 3000, .max_delay_us = 3000 };
+    clock_sync sync;
+    clock_sync_reset(&sync);
+    CHECK(!clock_sync_valid(&sync));
+    CHECK(exchange(&sync, &clock, 10 * SECOND_US));
+    CHECK(clock_sync_valid(&sync));
+    CHECK_EQ(clock_sync_offset_at(&sync, 10 * SECOND_US), clock.offset_us);
+    CHECK_EQ(sync.round_trip_us, 6000);
+    CHECK_EQ(conversion_error(&sync, &clock, 3600 * SECOND_US), 0);
+}
+
+// A crystal 50 ppm off, over jittery Wi-Fi: the drift is found, and a start an hour ahead lands within the uncertainty
+static void test_drift(void)
+{
+    skewed_clock clock = { .offset_us = 12345678, .drift_ppm = -50, .min_delay_us = 2000, .max_delay_us = 2600 };
+    clock_sync sync;
+    clock_sync_reset(&sync);
+    srand(7);
+    uint64_t local_us = 5 * SECOND_US;
+    for (int i = 0; i < CLOCK_SYNC_SAMPLES; i++, local_us += 10 * SECOND_US) {
+        CHECK(exchange(&sync, &clock, local_us));
+    }
+
+    CHECK(abs64(sync.drift_ppb + clock.drift_ppm * 1000) < 5000); // The offset shrinks as the remote clock runs ahead
+    CHECK(abs64(conversion_error(&sync, &clock, local_us)) <= clock_sync_uncertainty_us(&sync));
+    CHECK(abs64(conversion_error(&sync, &clock, local_us + 3600 * SECOND_US)) < 20000);
+
+    // Without the drift, the same hour would be 180 ms off
+    clock_sync fixed = sync;
+    fixed.drift_ppb = 0;
+    CHECK(abs64(conversion_error(&fixed, &clock, local_us + 3600 * SECOND_US)) > 150000);
+}
+
+// Exchanges delayed by queueing are left out of the fit instead of pulling the offset
+static void test_slow_exchanges(void)
+{
+    skewed_clock clock = { .offset_us = 1000, .min_delay_us = 1500, .max_delay_us = 1500 };
+    clock_sync sync;
+    clock_sync_reset(&sync);
+    for (int i = 0; i < 4; i++) {
+        CHECK(exchange(&sync, &clock, (i + 1) * SECOND_US));
+    }
+
+    // 80 ms stuck on the way back only
+    uint64_t t0 = remote_time(&clock, 6 * SECOND_US);
+    uint64_t t1 = 6 * SECOND_US + 1500, t2 = t1 + 200;
+    CHECK(clock_sync_add(&sync, t0, t1, t2, remote_time(&clock, t2 + 80000)));
+    CHECK_EQ(sync.round_trip_us, 3000);
+    CHECK_EQ(clock_sync_offset_at(&sync, 6 * SECOND_US), clock.offset_us);
+}
+
+// The remote clock being set restarts the estimate, inconsistent timestamps are refused
+static void test_clock_set(void)
+{
+    skewed_clock clock = { .offset_us = 0, .min_delay_us = 1000, .max_delay_us = 1000 };
+    clock_sync sync;
+    clock_sync_reset(&sync);
+    for (int i = 0; i < 3; i++) {
+        CHECK(exchange(&sync, &clock, (i + 1) * SECOND_US));
+    }
+    CHECK_EQ(sync.count, 3);
+
+    clock.offset_us = -2 * CLOCK_SYNC_MAX_STEP_US;
+    CHECK(exchange(&sync, &clock, 4 * SECOND_US));
+    CHECK_EQ(sync.count, 1);
+    CHECK_EQ(clock_sync_offset_at(&sync, 4 * SECOND_US), clock.offset_us);
+
+    clock_sync before = sync;
+    CHECK(!clock_sync_add(&sync, 2000, 1000, 900, 3000));  // Replied before received
+    CHECK(!clock_sync_add(&sync, 3000, 1000, 1100, 2000)); // Answer received before sent
+    CHECK(!clock_sync_add(&sync, 1000, 1000, 2000, 1500)); // Device busier than the whole round trip
+    CHECK_EQ(sync.count, before.count);
+    CHECK_EQ(sync.offset_us, before.offset_us);
+}
+
+// Days of samples keep the sums within 64 bits. Half a day apart, the drift stays below a clock step between them.
+static void test_long_span(void)
+{
+    skewed_clock clock = { .offset_us = 42, .drift_ppm = 20, .min_delay_us = 1000, .max_delay_us = 1000 };
+    clock_sync sync;
+    clock_sync_reset(&sync);
+    uint64_t local_us = 0;
+    for (int i = 0; i < CLOCK_SYNC_SAMPLES; i++) {
+        local_us += 12 * 3600 * SECOND_US;
+        CHECK(exchange(&sync, &clock, local_us));
+    }
+    CHECK_EQ(sync.count, CLOCK_SYNC_SAMPLES);
+    CHECK(abs64(sync.drift_ppb + 20000) < 100);
+    CHECK(abs64(conversion_error(&sync, &clock, local_us)) < 100);
+}
+
+int main(void)
+{
+    RUN_TEST(test_offset);
+    RUN_TEST(test_drift);
+    RUN_TEST(test_slow_exchanges);
+    RUN_TEST(test_clock_set);
+    RUN_TEST(test_long_span);
+    return test_failures();
+}
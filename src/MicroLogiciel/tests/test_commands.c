@@ -0,0 +1,161 @@
+#include <stdlib.h>
+
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+
+#include "bench.h"
+#include "edge_log.h"
+#include "shutter.h"
+#include "test.h"
+
+#define SECOND_US 1000000ULL
+#define FRAMES 50
+#define EXPOSURE_US (30 * SECOND_US)
+#define GAP_US (10 * SECOND_US)
+
+static sequence_event s_Events[4 * FRAMES];
+static QueueHandle_t s_ShutterEvents;
+
+// Shutter transitions of the session, as the engine logged them
+static edge_record s_Edges[16 * FRAMES];
+static int s_EdgeCount;
+
+static sequence_program compile(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = FRAMES, .exposure_us = EXPOSURE_US, .gap_us = GAP_US };
+    sequence_program program;
+    sequence_begin(&program, s_Events, sizeof(s_Events) / sizeof(s_Events[0]));
+    CHECK(sequence_add_step(&program, &step));
+    return program;
+}
+
+static uint64_t start(const sequence_program *program)
+{
+    // Only the edge log is read, the events are dropped as the queue fills up
+    uint64_t start_us = time_us_64() + SHUTTER_START_LEAD_US;
+    s_EdgeCount = 0;
+    CHECK(shutter_start(program->events, program->count, start_us));
+    return start_us;
+}
+
+// Moves the clock, and copies the transitions made meanwhile: fewer than the log keeps between two commands
+static void run_until(uint64_t until_us)
+{
+    host_time_run_until(until_us);
+    uint32_t first;
+    int count = edge_log_read(s_EdgeCount, s_Edges + s_EdgeCount, sizeof(s_Edges) / sizeof(s_Edges[0]) - s_EdgeCount, &first);
+    CHECK_EQ(first, s_EdgeCount);
+    s_EdgeCount += count;
+}
+
+static uint64_t random_us(uint64_t max_us)
+{
+    return (((uint64_t)rand() << 31) ^ rand()) % max_us;
+}
+
+// The target of the alarm of the engine, the time of its next edge
+static uint64_t next_edge_us(void)
+{
+    uint64_t target_us;
+    CHECK(host_alarm_armed(0, &target_us));
+    return target_us;
+}
+
+/* Pause and resume, as the timer task runs them on the shutter engine: the outputs reach their final state within the
+ * call, before the command is acknowledged, so the effect is immediate on the virtual clock. The host time of the
+ * calls is the part of the command-to-edge latency spent in the engine, locking included. */
+static void test_pause_resume_latency(void)
+{
+    sequence_program program = compile();
+    start(&program);
+    srand(3);
+
+    double worst_ns = 0, total_ns = 0;
+    int commands = 0;
+    for (;;) {
+        // Often enough to cut exposures, not so often that one never completes
+        run_until(time_us_64() + random_us(90 * SECOND_US));
+        if (!shutter_is_running()) {
+            break;
+        }
+
+        struct timespec start = bench_start();
+        CHECK(shutter_pause());
+        double ns = bench_seconds_since(&start) * 1e9;
+        CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+        worst_ns = ns > worst_ns ? ns : worst_ns;
+        total_ns += ns;
+
+        run_until(time_us_64() + random_us(5 * SECOND_US));
+        uint64_t next_us;
+        start = bench_start();
+        CHECK(shutter_resume(&next_us));
+        ns = bench_seconds_since(&start) * 1e9;
+        worst_ns = ns > worst_ns ? ns : worst_ns;
+        total_ns += ns;
+        commands += 2;
+    }
+    printf("%d commands applied in %.0f ns on average, %.0f ns at worst\n", commands, total_ns / commands, worst_ns);
+
+    // Whatever the pauses cut, every frame got exactly one full exposure: an exposure cut short is opened again
+    int closed[FRAMES + 1] = { 0 };
+    for (int i = 0; i < s_EdgeCount; i++) {
+        if (!s_Edges[i].open) {
+            closed[s_Edges[i].frame]++;
+            CHECK(i > 0 && s_Edges[i - 1].open && s_Edges[i - 1].frame == s_Edges[i].frame);
+            CHECK_EQ(s_Edges[i].scheduled_us - s_Edges[i - 1].scheduled_us, EXPOSURE_US);
+        }
+        CHECK_EQ(s_Edges[i].late_us, 0);
+    }
+    for (int frame = 1; frame <= FRAMES; frame++) {
+        CHECK_EQ(closed[frame], 1);
+    }
+}
+
+// Pauses between exposures, and extensions, leave no drift: the schedule moves by exactly the time added
+static void test_no_drift(void)
+{
+    sequence_program program = compile();
+    uint64_t start_us = start(&program);
+    srand(5);
+
+    uint64_t added_us = 0;
+    for (int frame = 1; frame < FRAMES; frame++) {
+        // Somewhere in the gap after the frame
+        uint64_t closed_us = start_us + (frame - 1) * (EXPOSURE_US + GAP_US) + EXPOSURE_US + added_us;
+        run_until(closed_us + 1 + random_us(GAP_US - 2));
+        CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+
+        if (rand() & 1) {
+            uint64_t paused_us = 1 + random_us(600 * SECOND_US);
+            uint64_t next_us;
+            CHECK(shutter_pause());
+            run_until(time_us_64() + paused_us);
+            CHECK(shutter_resume(&next_us));
+            added_us += paused_us;
+        } else {
+            uint64_t extend_us = random_us(60 * SECOND_US);
+            CHECK(shutter_extend(extend_us));
+            added_us += extend_us;
+        }
+
+        uint64_t next_us = start_us + (uint64_t)frame * (EXPOSURE_US + GAP_US) + added_us;
+        CHECK_EQ(next_edge_us(), next_us);
+        run_until(next_us); // Opens the next frame
+        CHECK(gpio_get_out_level(SHUTTER_GPIO));
+    }
+    run_until(start_us + program.duration_us + added_us);
+    CHECK(!shutter_is_running());
+    CHECK_EQ(s_EdgeCount, 2 * FRAMES);
+    CHECK_EQ(s_Edges[s_EdgeCount - 1].scheduled_us, start_us + program.duration_us + added_us);
+}
+
+int main(void)
+{
+    s_ShutterEvents = xQueueCreate(16, sizeof(shutter_event));
+    CHECK(shutter_init(s_ShutterEvents));
+
+    RUN_TEST(test_pause_resume_latency);
+    RUN_TEST(test_no_drift);
+    return test_failures();
+}
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "bench.h"
+#include "http_host.h"
+#include "test.h"
+
+static const char s_Subscribe[] = "GET /events HTTP/1.1\r\nHost: pico\r\n\r\n";
+
+static http_server_instance s_Server;
+
+/* Receives until 'text' shows up, publishing a "tick" event every 10 ms meanwhile: the subscription is only
+ * registered once its header is sent. Returns false on close or after a second. */
+static bool recv_until(int s, const char *text, bool publish)
+{
+    char received[2048];
+    int len = 0;
+    for (int waited = 0; waited < 1000; waited += 10) {
+        if (publish) {
+            http_server_publish_event(http_host_events(), "tick", "{\"n\":%d}", waited);
+        }
+        int done = recv(s, received + len, sizeof(received) - 1 - len, MSG_DONTWAIT);
+        if (done == 0 || (done < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+            return false;
+        }
+        if (done > 0) {
+            len += done;
+            received[len] = 0;
+            if (strstr(received, text)) {
+                return true;
+            }
+            if (len == sizeof(received) - 1) {
+                len = 0;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static int subscribe(void)
+{
+    int s = http_host_connect();
+    if (s >= 0 && send(s, s_Subscribe, sizeof(s_Subscribe) - 1, 0) != sizeof(s_Subscribe) - 1) {
+        close(s);
+        s = -1;
+    }
+    return s;
+}
+
+// Closed subscribers are only noticed, and their slot freed, when publishing to them fails
+static void drop_closed_subscribers(void)
+{
+    for (int i = 0; i < 10; i++) {
+        http_server_publish_event(http_host_events(), "tick", "{}");
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static void test_subscribe_publish(void)
+{
+    int s = subscribe();
+    CHECK(s >= 0);
+    CHECK(recv_until(s, "Content-Type: text/event-stream\r\n", false));
+    CHECK(recv_until(s, "event: tick\ndata: {\"n\":", true));
+    close(s);
+    drop_closed_subscribers();
+}
+
+// Subscribers beyond the source capacity get a 503, the server worker is not kept
+static void test_too_many_subscribers(void)
+{
+    int s[HTTP_HOST_SUBSCRIBERS];
+    for (int i = 0; i < HTTP_HOST_SUBSCRIBERS; i++) {
+        s[i] = subscribe();
+        CHECK(s[i] >= 0);
+        CHECK(recv_until(s[i], "event: tick\n", true));
+    }
+
+    char reply[512];
+    CHECK(http_host_exchange(s_Subscribe, reply, sizeof(reply)) > 0);
+    CHECK(!strncmp(reply, "HTTP/1.1 503 ", 13));
+
+    for (int i = 0; i < HTTP_HOST_SUBSCRIBERS; i++) {
+        close(s[i]);
+    }
+    drop_closed_subscribers();
+}
+
+/* Publishing runs on the timer task: a subscriber that stops reading gets dropped instead of blocking it, and its
+ * slot can be taken again */
+static void test_slow_subscriber(void)
+{
+    int slow = http_host_connect();
+    CHECK(slow >= 0);
+    int size = 1024;
+    setsockopt(slow, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    CHECK_EQ(send(slow, s_Subscribe, sizeof(s_Subscribe) - 1, 0), sizeof(s_Subscribe) - 1);
+    CHECK(recv_until(slow, "event: tick\n", true));
+
+    char data[HTTP_HOST_EVENT_SIZE - 64];
+    memset(data, 'x', sizeof(data) - 1);
+    data[sizeof(data) - 1] = 0;
+    double longest = 0;
+    for (int i = 0; i < 10000; i++) {
+        struct timespec start = bench_start();
+        http_server_publish_event(http_host_events(), "big", "\"%s\"", data);
+        double seconds = bench_seconds_since(&start);
+        longest = seconds > longest ? seconds : longest;
+    }
+    CHECK(longest < 0.05);
+    printf("longest publish to a subscriber not reading: %.0f us\n", longest * 1e6);
+
+    int s[HTTP_HOST_SUBSCRIBERS];
+    for (int i = 0; i < HTTP_HOST_SUBSCRIBERS; i++) {
+        s[i] = subscribe();
+        CHECK(s[i] >= 0);
+        CHECK(recv_until(s[i], "event: tick\n", true));
+    }
+    for (int i = 0; i < HTTP_HOST_SUBSCRIBERS; i++) {
+        close(s[i]);
+    }
+    close(slow);
+    drop_closed_subscribers();
+}
+
+int main(void)
+{
+    s_Server = http_host_start(0);
+    CHECK(s_Server != NULL);
+    if (!s_Server) {
+        return test_failures();
+    }
+
+    RUN_TEST(test_subscribe_publish);
+    RUN_TEST(test_too_many_subscribers);
+    RUN_TEST(test_slow_subscriber);
+    return test_failures();
+}
@@ -0,0 +1,159 @@
+#include <string.h>
+
+#include "http_parser.h"
+#include "test.h"
+
+#define BUFFER_SIZE 1024
+
+static char s_Buffer[BUFFER_SIZE];
+
+/* Parses 'request' fed 'segment' bytes at a time, as it would arrive from the socket, 0 for all at once. The parser
+ * gets every prefix of the buffer until it stops asking for more. */
+static http_parse_status parse(http_parser *parser, const char *request, int segment)
+{
+    int len = strlen(request);
+    memcpy(s_Buffer, request, len + 1);
+    http_parser_init(parser);
+
+    http_parse_status status = HTTP_PARSE_INCOMPLETE;
+    for (int fed = 0; fed < len && status == HTTP_PARSE_INCOMPLETE; ) {
+        fed = (segment && fed + segment < len) ? fed + segment : len;
+        status = http_parser_execute(parser, s_Buffer, fed);
+    }
+    return status;
+}
+
+// Same status and fields however the request is split
+static void check_segments(const char *request, http_parse_status expected)
+{
+    http_parser whole;
+    http_parse_status status = parse(&whole, request, 0);
+    CHECK_EQ(status, expected);
+    char parsed[BUFFER_SIZE];
+    memcpy(parsed, s_Buffer, sizeof(parsed));
+
+    for (int segment = 1; segment < (int)strlen(request); segment++) {
+        http_parser split;
+        if (parse(&split, request, segment) != status || split.pos != whole.pos || split.http11 != whole.http11 ||
+            split.content_length != whole.content_length || memcmp(s_Buffer, parsed, sizeof(parsed))) {
+            fprintf(stderr, "segments of %d bytes: %s", segment, request);
+            CHECK(false);
+            return;
+        }
+    }
+}
+
+static void test_request(void)
+{
+    static const char request[] =
+        "POST /api/timer/start?session=12&mode=fast HTTP/1.1\r\n"
+        "host:  astrotimer.local \r\n"
+        "X-Requested-With: fetch\r\n"
+        "CONTENT-LENGTH: 42\r\n"
+        "Connection: keep-alive\r\n"
+        "Accept-Encoding: gzip,\tdeflate\r\n"
+        "If-None-Match: \"5f3c1a\"\r\n"
+        "\r\n"
+        "{\"body\"";
+    http_parser parser;
+    CHECK_EQ(parse(&parser, request, 0), HTTP_PARSE_DONE);
+    CHECK(!strcmp(parser.method, "POST"));
+    CHECK(!strcmp(parser.path, "/api/timer/start"));
+    CHECK(!strcmp(parser.query, "session=12&mode=fast"));
+    CHECK(parser.http11);
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_HOST], "astrotimer.local"));
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_CONNECTION], "keep-alive"));
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_ACCEPT_ENCODING], "gzip,\tdeflate"));
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_IF_NONE_MATCH], "\"5f3c1a\""));
+    CHECK(parser.headers[HTTP_HEADER_RANGE] == NULL);
+    CHECK_EQ(parser.content_length, 42);
+    CHECK_EQ(parser.pos, strstr(request, "{") - request); // The body is left for the handler
+
+    check_segments(request, HTTP_PARSE_DONE);
+}
+
+static void test_lenient_forms(void)
+{
+    http_parser parser;
+
+    // Bare LF line endings, stray line breaks before the request line, HTTP/1.0
+    CHECK_EQ(parse(&parser, "\r\n\nGET / HTTP/1.0\nHost: pico\n\n", 0), HTTP_PARSE_DONE);
+    CHECK(!strcmp(parser.method, "GET"));
+    CHECK(!strcmp(parser.path, "/"));
+    CHECK(parser.query == NULL);
+    CHECK(!parser.http11);
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_HOST], "pico"));
+    check_segments("\r\n\nGET / HTTP/1.0\nHost: pico\n\n", HTTP_PARSE_DONE);
+
+    // Names that only start like a known header are ignored, as are empty values
+    CHECK_EQ(parse(&parser, "GET /x? HTTP/1.1\r\nHosts: a\r\nContent-Lengths: b\r\nRange:\r\n\r\n", 0), HTTP_PARSE_DONE);
+    CHECK(parser.headers[HTTP_HEADER_HOST] == NULL);
+    CHECK(parser.headers[HTTP_HEADER_CONTENT_LENGTH] == NULL);
+    CHECK(!strcmp(parser.headers[HTTP_HEADER_RANGE], ""));
+    CHECK(!strcmp(parser.query, ""));
+}
+
+static void test_malformed(void)
+{
+    static const struct
+    {
+        const char *request;
+        http_parse_status status;
+    } cases[] = {
+        { "GETTINGS / HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },                 // Method too long
+        { "G(T / HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { " GET / HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET  / HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET /a b HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET /a\tb HTTP/1.1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET /\r\n\r\n", HTTP_PARSE_BAD_REQUEST },                               // HTTP/0.9
+        { "GET / HTTP/2.0\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.x\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.11\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.1\rX\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.1\r\nHost pico\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.1\r\n: pico\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.1\r\nHost: a\r\n b\r\n\r\n", HTTP_PARSE_BAD_REQUEST },     // Obsolete line folding
+        { "GET / HTTP/1.1\r\nHost: a\x01" "b\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "GET / HTTP/1.1\r\n\rX", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length: 1 2\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length:\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length: 9999999999\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n", HTTP_PARSE_BAD_REQUEST },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", HTTP_PARSE_NOT_IMPLEMENTED },
+    };
+
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        http_parser parser;
+        http_parse_status status = parse(&parser, cases[i].request, 0);
+        if (status != cases[i].status) {
+            fprintf(stderr, "%s", cases[i].request);
+            CHECK_EQ(status, cases[i].status);
+        }
+        check_segments(cases[i].request, cases[i].status);
+    }
+}
+
+// A full buffer is reported as 414 while still in the request line, as 431 once in the headers
+static void test_overflow(void)
+{
+    http_parser parser;
+    CHECK_EQ(parse(&parser, "GET /very/long/path", 0), HTTP_PARSE_INCOMPLETE);
+    CHECK_EQ(http_parser_overflow_status(&parser), HTTP_PARSE_URI_TOO_LONG);
+    CHECK_EQ(parse(&parser, "GET / HTTP/1.", 0), HTTP_PARSE_INCOMPLETE);
+    CHECK_EQ(http_parser_overflow_status(&parser), HTTP_PARSE_URI_TOO_LONG);
+    CHECK_EQ(parse(&parser, "GET / HTTP/1.1\r\nCookie: very-long", 0), HTTP_PARSE_INCOMPLETE);
+    CHECK_EQ(http_parser_overflow_status(&parser), HTTP_PARSE_HEADERS_TOO_LARGE);
+}
+
+int main(void)
+{
+    RUN_TEST(test_request);
+    RUN_TEST(test_lenient_forms);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_overflow);
+    return test_failures();
+}
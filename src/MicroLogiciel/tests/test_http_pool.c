@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "http_host.h"
+#include "test.h"
+
+#define CONNECTIONS 100000
+#define CLIENTS 8           // As many as the pool has contexts, so that some connections find it empty
+
+static http_server_instance s_Server;
+
+typedef struct
+{
+    int connections;
+    int ok;
+    int busy;
+    int failed;
+} client_result;
+
+static void *client_thread(void *arg)
+{
+    static const char request[] = "GET /ping HTTP/1.1\r\nHost: pico\r\nConnection: close\r\n\r\n";
+    client_result *result = arg;
+    char reply[256];
+
+    for (int i = 0; i < result->connections; i++) {
+        int len = http_host_exchange(request, reply, sizeof(reply));
+        if (len > 0 && !strncmp(reply, "HTTP/1.1 200 ", 13) && strstr(reply, "\r\n\r\npong")) {
+            result->ok++;
+        } else if (len > 0 && !strncmp(reply, "HTTP/1.1 503 ", 13)) {
+            result->busy++;
+        } else {
+            result->failed++;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t admitted(const http_server_stats *stats)
+{
+    return stats->pool_hits + stats->pool_exhausted;
+}
+
+/* Connections take their context from the pool preallocated by http_server_create() and give it back: the heap is
+ * neither allocated from nor freed to while they come and go, so it cannot fragment. Connections finding the pool
+ * empty get a 503, never a failure. */
+static void test_no_heap_growth(void)
+{
+    http_server_stats before_stats, after_stats;
+    HeapStats_t before, after;
+    http_server_get_stats(s_Server, &before_stats);
+    vPortGetHeapStats(&before);
+
+    pthread_t threads[CLIENTS];
+    client_result results[CLIENTS];
+    for (int i = 0; i < CLIENTS; i++) {
+        results[i] = (client_result){ .connections = CONNECTIONS / CLIENTS };
+        pthread_create(&threads[i], NULL, client_thread, &results[i]);
+    }
+
+    client_result total = { 0 };
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        total.ok += results[i].ok;
+        total.busy += results[i].busy;
+        total.failed += results[i].failed;
+    }
+
+    // The last contexts go back to the pool right after their connection is closed
+    CHECK(http_host_wait_stat(s_Server, admitted, admitted(&before_stats) + CONNECTIONS, 1000));
+    vTaskDelay(pdMS_TO_TICKS(50));
+    http_server_get_stats(s_Server, &after_stats);
+    vPortGetHeapStats(&after);
+
+    CHECK_EQ(total.ok + total.busy, CONNECTIONS);
+    CHECK_EQ(total.failed, 0);
+    // Admitted connections may still get a 503, after waiting too long for a worker
+    CHECK_EQ(admitted(&after_stats) - admitted(&before_stats), CONNECTIONS);
+    CHECK(after_stats.pool_exhausted - before_stats.pool_exhausted <= (uint32_t)total.busy);
+    CHECK(total.ok > CONNECTIONS * 9 / 10);
+
+    CHECK_EQ(after.xAvailableHeapSpaceInBytes, before.xAvailableHeapSpaceInBytes);
+    CHECK_EQ(after.xNumberOfSuccessfulAllocations, before.xNumberOfSuccessfulAllocations);
+    CHECK_EQ(after.xNumberOfSuccessfulFrees, before.xNumberOfSuccessfulFrees);
+    printf("%d connections: %d served, %d turned away with a 503, heap %zu bytes free before and %zu after\n",
+           CONNECTIONS, total.ok, total.busy, before.xAvailableHeapSpaceInBytes, after.xAvailableHeapSpaceInBytes);
+}
+
+// The pool takes a single allocation, sized from the worker count
+static void test_pool_allocation(void)
+{
+    HeapStats_t heap;
+    vPortGetHeapStats(&heap);
+    size_t used = configTOTAL_HEAP_SIZE - heap.xAvailableHeapSpaceInBytes;
+    CHECK(used >= HTTP_HOST_WORKERS * 2 * HTTP_HOST_BUFFER_SIZE);
+    CHECK(used < HTTP_HOST_WORKERS * 2 * (HTTP_HOST_BUFFER_SIZE + 1024) + 4096);
+}
+
+int main(void)
+{
+    s_Server = http_host_start(0);
+    CHECK(s_Server != NULL);
+    if (!s_Server) {
+        return test_failures();
+    }
+
+    RUN_TEST(test_pool_allocation);
+    RUN_TEST(test_no_heap_growth);
+    return test_failures();
+}
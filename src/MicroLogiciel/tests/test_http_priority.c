@@ -0,0 +1,131 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "bench.h"
+#include "http_host.h"
+#include "test.h"
+
+#define LARGE_SIZE (64 * 1024 * 1024) // Long enough for the slow downloads to hold their worker through a test
+#define READ_DELAY_MS 1
+
+static const char s_Stop[] = "POST /stop HTTP/1.1\r\nHost: pico\r\nContent-Length: 0\r\n\r\n";
+
+static http_server_instance s_Server;
+
+static uint32_t admitted(const http_server_stats *stats)
+{
+    return stats->pool_hits + stats->pool_exhausted;
+}
+
+static uint32_t queue_expired(const http_server_stats *stats)
+{
+    return stats->queue_expired;
+}
+
+// Sends 'request' on 's' and reads the reply until 'end' shows up
+static bool request_until(int s, const char *request, const char *end, char *reply, int size)
+{
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int len = strlen(request);
+    if (send(s, request, len, 0) != len) {
+        return false;
+    }
+
+    int total = 0;
+    while (total < size - 1) {
+        int done = recv(s, reply + total, size - 1 - total, 0);
+        if (done <= 0) {
+            return false;
+        }
+        total += done;
+        reply[total] = 0;
+        if (strstr(reply, end)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* A persistent connection served by the reserved worker must not keep it: the next control request, on another
+ * connection, would wait for the keep-alive timeout */
+static void test_reserved_worker_no_keep_alive(void)
+{
+    http_host_downloads downloads = http_host_start_downloads(HTTP_HOST_WORKERS, READ_DELAY_MS);
+    CHECK(http_host_wait_downloads(downloads, 2000));
+
+    char reply[512];
+    int first = http_host_connect();
+    CHECK(first >= 0);
+    CHECK(request_until(first, s_Stop, "\r\n\r\nstopped", reply, sizeof(reply)));
+    CHECK(strstr(reply, "Connection: close\r\n") != NULL);
+
+    struct timespec start = bench_start();
+    int second = http_host_connect();
+    CHECK(second >= 0);
+    CHECK(request_until(second, s_Stop, "\r\n\r\nstopped", reply, sizeof(reply)));
+    double seconds = bench_seconds_since(&start);
+    CHECK(seconds * 1000 < HTTP_KEEP_ALIVE_TIMEOUT_MS / 2);
+    printf("second stop served in %.1f ms with the regular workers busy\n", seconds * 1000);
+
+    close(first);
+    close(second);
+    http_host_stop_downloads(downloads);
+}
+
+/* A regular request handed over by the reserved worker, then expired in the queue: it gets its 503, and its context
+ * goes back to the pool instead of cycling through the queue */
+static void test_expired_handover(void)
+{
+    http_host_downloads downloads = http_host_start_downloads(HTTP_HOST_WORKERS, READ_DELAY_MS);
+    CHECK(http_host_wait_downloads(downloads, 2000));
+
+    http_server_stats before, after;
+    http_server_get_stats(s_Server, &before);
+
+    static const char ping[] = "GET /ping HTTP/1.1\r\nHost: pico\r\n\r\n";
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    CHECK_EQ(send(s, ping, sizeof(ping) - 1, 0), sizeof(ping) - 1);
+    vTaskDelay(pdMS_TO_TICKS(HTTP_QUEUE_DEADLINE_MS + 200));
+    http_host_stop_downloads(downloads);
+
+    char reply[512];
+    CHECK(request_until(s, "", "\r\n\r\n", reply, sizeof(reply)));
+    CHECK(!strncmp(reply, "HTTP/1.1 503 ", 13));
+    close(s);
+    CHECK(http_host_wait_stat(s_Server, queue_expired, before.queue_expired + 1, 1000));
+
+    // Nothing gets queued any more, and the whole pool can be taken again
+    vTaskDelay(pdMS_TO_TICKS(100));
+    http_server_get_stats(s_Server, &before);
+    int pool[HTTP_HOST_WORKERS * 2];
+    for (int i = 0; i < HTTP_HOST_WORKERS * 2; i++) {
+        pool[i] = http_host_connect();
+        CHECK(pool[i] >= 0);
+    }
+    CHECK(http_host_wait_stat(s_Server, admitted, admitted(&before) + HTTP_HOST_WORKERS * 2, 1000));
+    http_server_get_stats(s_Server, &after);
+    CHECK_EQ(after.pool_exhausted, before.pool_exhausted);
+    CHECK(after.queued - before.queued <= HTTP_HOST_WORKERS);
+    for (int i = 0; i < HTTP_HOST_WORKERS * 2; i++) {
+        close(pool[i]);
+    }
+}
+
+int main(void)
+{
+    s_Server = http_host_start(LARGE_SIZE);
+    CHECK(s_Server != NULL);
+    if (!s_Server) {
+        return test_failures();
+    }
+
+    RUN_TEST(test_reserved_worker_no_keep_alive);
+    RUN_TEST(test_expired_handover);
+    return test_failures();
+}
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "http_host.h"
+#include "test.h"
+
+#define LARGE_SIZE (64 * 1024 * 1024) // More than the socket buffers of the host can take in
+#define CLOSE_SLACK_MS 500          // Scheduling and polling delays on top of a budget
+
+static http_server_instance s_Server;
+
+static int elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int)((now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+// Reads and drops whatever the server sends, true once it has closed the connection
+static bool server_closed(int s)
+{
+    char discard[512];
+    for (;;) {
+        int done = recv(s, discard, sizeof(discard), MSG_DONTWAIT);
+        if (done == 0 || (done < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+            return true;
+        }
+        if (done < 0) {
+            return false;
+        }
+    }
+}
+
+/* Sends 'script' one byte every 'interval_ms', then waits, until the server closes the connection. Returns the time
+ * from the first byte to the close, -1 if the connection is still open after 'timeout_ms'. */
+static int run_slow_client(int s, const char *script, int interval_ms, int timeout_ms)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (const char *p = script; elapsed_ms(&start) < timeout_ms; ) {
+        if (server_closed(s)) {
+            return elapsed_ms(&start);
+        }
+        if (*p && send(s, p, 1, 0) == 1) {
+            p++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(interval_ms));
+    }
+    return -1;
+}
+
+static uint32_t header_timeouts(const http_server_stats *stats)
+{
+    return stats->header_timeouts;
+}
+
+static uint32_t body_timeouts(const http_server_stats *stats)
+{
+    return stats->body_timeouts;
+}
+
+static uint32_t send_timeouts(const http_server_stats *stats)
+{
+    return stats->send_timeouts;
+}
+
+// Headers trickled in byte by byte: every byte is on time, the whole is not, and the budget is not extended
+static void test_header_trickle(void)
+{
+    http_server_stats before, after;
+    http_server_get_stats(s_Server, &before);
+
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    int closed_ms = run_slow_client(s, "GET /ping HTTP/1.1\r\nHost: pico\r\nX-Slow: 0123456789012345678901234567890123456789\r\n\r\n",
+                                    HTTP_HEADER_TIMEOUT_MS / 10, 5000);
+    close(s);
+
+    CHECK(closed_ms >= HTTP_HEADER_TIMEOUT_MS);
+    CHECK(closed_ms < HTTP_HEADER_TIMEOUT_MS + CLOSE_SLACK_MS);
+    CHECK(http_host_wait_stat(s_Server, header_timeouts, before.header_timeouts + 1, 1000));
+    http_server_get_stats(s_Server, &after);
+    CHECK_EQ(after.body_timeouts, before.body_timeouts);
+    CHECK_EQ(after.send_timeouts, before.send_timeouts);
+    printf("header trickle closed after %d ms\n", closed_ms);
+}
+
+// Headers stalled halfway
+static void test_header_stall(void)
+{
+    http_server_stats before;
+    http_server_get_stats(s_Server, &before);
+
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    int closed_ms = run_slow_client(s, "GET /ping HTTP/1.1\r\nHo", 0, 5000);
+    close(s);
+
+    CHECK(closed_ms >= 0);
+    CHECK(closed_ms < HTTP_HEADER_TIMEOUT_MS + CLOSE_SLACK_MS);
+    CHECK(http_host_wait_stat(s_Server, header_timeouts, before.header_timeouts + 1, 1000));
+}
+
+// Complete headers announcing more body than is sent
+static void test_body_stall(void)
+{
+    static const char request[] = "POST /echo HTTP/1.1\r\nHost: pico\r\nContent-Length: 100\r\n\r\nabc";
+    http_server_stats before, after;
+    http_server_get_stats(s_Server, &before);
+
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    CHECK_EQ(send(s, request, sizeof(request) - 1, 0), sizeof(request) - 1);
+    int closed_ms = run_slow_client(s, "", 10, 5000);
+    close(s);
+
+    CHECK(closed_ms >= 0);
+    CHECK(closed_ms < HTTP_BODY_TIMEOUT_MS + CLOSE_SLACK_MS);
+    CHECK(http_host_wait_stat(s_Server, body_timeouts, before.body_timeouts + 1, 1000));
+    http_server_get_stats(s_Server, &after);
+    CHECK_EQ(after.header_timeouts, before.header_timeouts);
+}
+
+// A client that asks for a large reply and stops reading it
+static void test_send_stall(void)
+{
+    static const char request[] = "GET /large HTTP/1.1\r\nHost: pico\r\nConnection: close\r\n\r\n";
+    http_server_stats before, after;
+    http_server_get_stats(s_Server, &before);
+
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    CHECK_EQ(send(s, request, sizeof(request) - 1, 0), sizeof(request) - 1);
+
+    // Filling the socket buffers takes a while, then the send makes no progress for a whole budget
+    CHECK(http_host_wait_stat(s_Server, send_timeouts, before.send_timeouts + 1, 10000));
+    close(s);
+    http_server_get_stats(s_Server, &after);
+    CHECK_EQ(after.header_timeouts, before.header_timeouts);
+    CHECK_EQ(after.body_timeouts, before.body_timeouts);
+}
+
+// The workers held by the slow clients are back, and prompt clients do not touch the counters
+static void test_prompt_clients(void)
+{
+    static const char request[] = "POST /echo HTTP/1.1\r\nHost: pico\r\nContent-Length: 7\r\nConnection: close\r\n\r\nhello\r\n";
+    http_server_stats before, after;
+    http_server_get_stats(s_Server, &before);
+
+    for (int i = 0; i < HTTP_HOST_WORKERS * 2; i++) {
+        char reply[256];
+        CHECK(http_host_exchange(request, reply, sizeof(reply)) > 0);
+        CHECK(!strncmp(reply, "HTTP/1.1 200 ", 13));
+        CHECK(strstr(reply, "\r\n\r\nhello") != NULL);
+    }
+
+    http_server_get_stats(s_Server, &after);
+    CHECK_EQ(after.header_timeouts, before.header_timeouts);
+    CHECK_EQ(after.body_timeouts, before.body_timeouts);
+    CHECK_EQ(after.send_timeouts, before.send_timeouts);
+}
+
+int main(void)
+{
+    s_Server = http_host_start(LARGE_SIZE);
+    CHECK(s_Server != NULL);
+    if (!s_Server) {
+        return test_failures();
+    }
+
+    RUN_TEST(test_header_trickle);
+    RUN_TEST(test_header_stall);
+    RUN_TEST(test_body_stall);
+    RUN_TEST(test_send_stall);
+    RUN_TEST(test_prompt_clients);
+    return test_failures();
+}
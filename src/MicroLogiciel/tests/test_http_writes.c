@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "http_host.h"
+#include "test.h"
+
+#define REPLY_SIZE 65536
+#define STATIC_SMALL_SIZE 512
+#define STATIC_LARGE_SIZE 16384
+#define STREAM_FRAGMENT_SIZE 3000 // Three of them overflow the connection buffer twice
+
+static char s_Static[STATIC_LARGE_SIZE];
+static char s_Fragment[STREAM_FRAGMENT_SIZE + 1];
+
+static bool do_small(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_reply(conn, "200 OK", "text/plain", "pong", -1);
+    return true;
+}
+
+static bool do_headers(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_reply_with_headers(conn, "200 OK", "application/json", "Cache-Control: no-store\r\n", "{\"result\":\"OK\"}", -1);
+    return true;
+}
+
+static bool do_static_small(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_static_reply(conn, "200 OK", "text/css", "ETag: \"1\"\r\n", s_Static, STATIC_SMALL_SIZE);
+    return true;
+}
+
+static bool do_static_large(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_static_reply(conn, "200 OK", "application/javascript", "ETag: \"2\"\r\n", s_Static, STATIC_LARGE_SIZE);
+    return true;
+}
+
+static bool do_not_modified(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_server_send_not_modified(conn, "ETag: \"1\"\r\nCache-Control: no-cache\r\n");
+    return true;
+}
+
+static bool do_stream(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", "application/json");
+    http_server_write_reply(reply, "{\"frames\":%d,", 3);
+    http_server_end_write_reply(reply, "\"result\":\"OK\"}");
+    return true;
+}
+
+static bool do_stream_large(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", "text/plain");
+    for (int i = 0; i < 3; i++) {
+        http_server_write_reply(reply, "%s", s_Fragment);
+    }
+    http_server_end_write_reply(reply, NULL);
+    return true;
+}
+
+typedef struct
+{
+    const char *name;
+    const char *request;
+    int writev;             // Expected calls, -1 when only reported
+    int send;
+} reply_case;
+
+/* The write calls each kind of reply takes. Replies whose head and body fit the connection buffer, or are handed
+ * over as vectors, leave in a single call; so does a streamed reply that fits the buffer. Large static files take
+ * the head in one call and the body in others, which are no-copy writes on the device. */
+static void test_writes_per_reply(void)
+{
+    static const reply_case cases[] = {
+        { "reply", "GET /small HTTP/1.1\r\n", 1, 0 },
+        { "reply, extra headers", "GET /headers HTTP/1.1\r\n", 1, 0 },
+        { "reply, HEAD", "HEAD /small HTTP/1.1\r\n", 1, 0 },
+        { "static, 512 bytes", "GET /static-small HTTP/1.1\r\n", 1, 0 },
+        { "static, 16 KB", "GET /static-large HTTP/1.1\r\n", 1, -1 },
+        { "304 Not Modified", "GET /not-modified HTTP/1.1\r\n", 1, 0 },
+        { "streamed", "GET /stream HTTP/1.1\r\n", 0, 1 },
+        { "streamed, 9000 bytes", "GET /stream-large HTTP/1.1\r\n", 0, 3 },
+        { "streamed, HTTP/1.0", "GET /stream HTTP/1.0\r\n", 0, 1 },
+        { "404 Not Found", "GET /missing HTTP/1.1\r\n", 1, 0 },
+        { "405 Method Not Allowed", "POST /small HTTP/1.1\r\nContent-Length: 0\r\n", 1, 0 },
+    };
+
+    static char reply[REPLY_SIZE];
+    printf("%-24s %7s %5s %7s\n", "reply", "writev", "send", "bytes");
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        char request[256];
+        snprintf(request, sizeof(request), "%sHost: pico\r\nConnection: close\r\n\r\n", cases[i].request);
+        http_host_writes before = http_host_get_writes();
+        int len = http_host_exchange(request, reply, sizeof(reply));
+        http_host_writes after = http_host_get_writes();
+        int writev = after.writev - before.writev, send = after.send - before.send;
+
+        printf("%-24s %7d %5d %7d\n", cases[i].name, writev, send, len);
+        CHECK(len > 0);
+        if (cases[i].writev >= 0) {
+            CHECK_EQ(writev, cases[i].writev);
+        }
+        if (cases[i].send >= 0) {
+            CHECK_EQ(send, cases[i].send);
+        }
+    }
+}
+
+int main(void)
+{
+    static const http_route routes[] = {
+        { "/headers", { [HTTP_GET] = do_headers } },
+        { "/not-modified", { [HTTP_GET] = do_not_modified } },
+        { "/small", { [HTTP_GET] = do_small } },
+        { "/static-large", { [HTTP_GET] = do_static_large } },
+        { "/static-small", { [HTTP_GET] = do_static_small } },
+        { "/stream", { [HTTP_GET] = do_stream } },
+        { "/stream-large", { [HTTP_GET] = do_stream_large } },
+    };
+
+    memset(s_Static, 's', sizeof(s_Static));
+    memset(s_Fragment, 'f', STREAM_FRAGMENT_SIZE);
+    if (!http_host_start_routes(routes, sizeof(routes) / sizeof(routes[0]), NULL, NULL)) {
+        return 1;
+    }
+
+    RUN_TEST(test_writes_per_reply);
+    return test_failures();
+}
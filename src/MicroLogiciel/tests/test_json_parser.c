@@ -0,0 +1,105 @@
+#include <stdlib.h>
+
+#include "json_parser.h"
+#include "test.h"
+
+static uint64_t round_trip(uint64_t us)
+{
+    char text[24];
+    uint64_t parsed = UINT64_MAX;
+    formatMicroseconds(text, sizeof(text), us);
+    CHECK_EQ(parseMicroseconds(text, &parsed), JSON_OK);
+    return parsed;
+}
+
+// Every value up to the 12 integer digits accepted comes back exactly
+static void test_round_trip(void)
+{
+    static const uint64_t values[] = {
+        0, 1, 9, 10, 999999, 1000000, 1000001, 1500000, 2000000, 1234567, 59999999,
+        300000000, 4294967295ULL, 4294967296ULL, 86400000000ULL, 999999999999999999ULL,
+    };
+    for (int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        CHECK_EQ(round_trip(values[i]), values[i]);
+    }
+
+    srand(1);
+    for (int i = 0; i < 100000; i++) {
+        uint64_t us = (((uint64_t)rand() << 31) ^ rand()) % 1000000000000000000ULL;
+        uint64_t parsed = round_trip(us);
+        if (parsed != us) {
+            CHECK_EQ(parsed, us);
+            break;
+        }
+    }
+}
+
+static void test_parse(void)
+{
+    static const struct
+    {
+        const char *text;
+        uint64_t us;
+    } valid[] = {
+        { "0", 0 }, { "30", 30000000 }, { "0.1", 100000 }, { "0.000001", 1 }, { "1.5", 1500000 },
+        { "2.50", 2500000 }, { "0.333333", 333333 }, { "3600", 3600000000ULL }, { "1.", 1000000 },
+        { "999999999999.999999", 999999999999999999ULL },
+    };
+    for (int i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        uint64_t us = UINT64_MAX;
+        CHECK_EQ(parseMicroseconds(valid[i].text, &us), JSON_OK);
+        CHECK_EQ(us, valid[i].us);
+    }
+
+    // No rounding: more than 6 decimals is refused rather than cut, and so are negative or out of range values
+    static const char *const invalid[] = { "0.0000001", "-1", "1e3", "abc", "1000000000000", "" };
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        uint64_t us = 42;
+        CHECK(parseMicroseconds(invalid[i], &us) != JSON_OK);
+        CHECK_EQ(us, 42);
+    }
+}
+
+static void test_format(void)
+{
+    static const struct
+    {
+        uint64_t us;
+        const char *text;
+    } expected[] = {
+        { 0, "0.00" }, { 1, "0.000001" }, { 1500000, "1.50" }, { 2000000, "2.00" }, { 1234567, "1.234567" },
+        { 300000000, "300.00" }, { 100000, "0.10" }, { 120000, "0.12" }, { 123000, "0.123" },
+    };
+    for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        char text[24];
+        int len = formatMicroseconds(text, sizeof(text), expected[i].us);
+        if (strcmp(text, expected[i].text)) {
+            fprintf(stderr, "%s:%d: %llu formatted as '%s', expected '%s'\n", __FILE__, __LINE__,
+                    (unsigned long long)expected[i].us, text, expected[i].text);
+            s_TestFailures++;
+        }
+        CHECK_EQ(len, strlen(expected[i].text));
+    }
+}
+
+// Values as the web page sends them, quoted or not, among other keys
+static void test_get_microseconds(void)
+{
+    const char *line = "{\"picture\":3, \"exposure\":\"1.25\", \"delay\":0.5, \"bad\":\"x\"}";
+    uint64_t us;
+    CHECK_EQ(getMicroseconds(line, "exposure", &us), JSON_OK);
+    CHECK_EQ(us, 1250000);
+    CHECK_EQ(getMicroseconds(line, "delay", &us), JSON_OK);
+    CHECK_EQ(us, 500000);
+    CHECK_EQ(getMicroseconds(line, "missing", &us), JSON_MISSING_KEY);
+    CHECK(getMicroseconds(line, "bad", &us) != JSON_OK);
+}
+
+int main(void)
+{
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_parse);
+    RUN_TEST(test_format);
+    RUN_TEST(test_get_microseconds);
+    return test_failures();
+}
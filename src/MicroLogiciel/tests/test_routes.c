@@ -0,0 +1,36 @@
+#include "routes.h"
+#include "test.h"
+
+static http_route s_Routes[256];
+static char s_Paths[256][32];
+
+static void test_every_route_found(void)
+{
+    for (int count = 0; count <= 256; count = count ? count * 2 : 1) {
+        routes_generate(s_Routes, s_Paths, count);
+        for (int i = 0; i < count; i++) {
+            CHECK(http_route_find(s_Routes, count, s_Paths[i]) == &s_Routes[i]);
+        }
+    }
+}
+
+// Only exact paths match: prefixes, extensions and case variants of a route go to the fallback
+static void test_misses(void)
+{
+    static const char *const misses[] = {
+        "", "/", "/api", "/api/area000", "/api/area000/", "/api/area000/endpoint", "/api/area000/endpoint00",
+        "/api/area000/endpoint0/", "/API/area000/endpoint0", "/api/area031/endpoint8", "/api/area032/endpoint0", "index.html",
+    };
+
+    routes_generate(s_Routes, s_Paths, 256);
+    for (int i = 0; i < (int)(sizeof(misses) / sizeof(misses[0])); i++) {
+        CHECK(http_route_find(s_Routes, 256, misses[i]) == NULL);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_every_route_found);
+    RUN_TEST(test_misses);
+    return test_failures();
+}
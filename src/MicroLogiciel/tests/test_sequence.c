@@ -0,0 +1,339 @@
+#include "sequence_sim.h"
+#include "test.h"
+
+#define SECOND_US 1000000ULL
+#define MINUTE_US (60 * SECOND_US)
+#define HOUR_US (60 * MINUTE_US)
+#define START_US 5000   // Arbitrary start on the virtual clock, so that times since the start and absolute ones differ
+
+static sequence_event s_Events[2048];
+static sim_edge s_Trace[2048];
+
+static sequence_program compile(const sequence_step *steps, int count)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, sizeof(s_Events) / sizeof(s_Events[0]));
+    for (int i = 0; i < count; i++) {
+        CHECK(sequence_add_step(&program, &steps[i]));
+    }
+    return program;
+}
+
+static void start(sim_engine *sim, const sequence_program *program)
+{
+    sim_start(sim, program, START_US, s_Trace, sizeof(s_Trace) / sizeof(s_Trace[0]));
+}
+
+// Index in the trace of the n-th event carrying 'flags', -1 if there are fewer
+static int find(const sim_engine *sim, uint8_t flags, int n)
+{
+    for (int i = 0; i < sim->count; i++) {
+        if ((s_Trace[i].flags & flags) == flags && !n--) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The night this harness was written for: 300 frames of 5 minutes, about 26 hours of real time
+static void test_night_session(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 300, .exposure_us = 5 * MINUTE_US, .gap_us = 10 * SECOND_US };
+    sequence_program program = compile(&step, 1);
+    CHECK_EQ(program.frames, 300);
+    CHECK_EQ(program.count, 600);
+
+    sim_engine sim;
+    start(&sim, &program);
+    sim_run(&sim);
+    CHECK(sequence_cursor_done(&sim.cursor));
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), 300);
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_CLOSED), 300);
+
+    for (int frame = 1; frame <= 300; frame++) {
+        uint64_t opened_us = START_US + (frame - 1) * (5 * MINUTE_US + 10 * SECOND_US);
+        const sim_edge *opened = &s_Trace[2 * (frame - 1)], *closed = &s_Trace[2 * frame - 1];
+        CHECK_EQ(opened->frame, frame);
+        CHECK_EQ(opened->at_us, opened_us);
+        CHECK_EQ(opened->pins, SEQUENCE_PIN_SHUTTER);
+        CHECK_EQ(closed->frame, frame);
+        CHECK_EQ(closed->at_us, opened_us + 5 * MINUTE_US);
+        CHECK_EQ(closed->pins, 0);
+    }
+
+    // No gap after the last frame: the session ends as its last exposure closes
+    CHECK_EQ(program.duration_us, 300 * 5 * MINUTE_US + 299 * 10 * SECOND_US);
+    CHECK_EQ(sim.now_us, START_US + program.duration_us);
+}
+
+// The last frame used to be dropped, or followed by one more, depending on where the count was checked
+static void test_last_frame(void)
+{
+    for (uint32_t count = 1; count <= 3; count++) {
+        sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = count, .exposure_us = 2 * SECOND_US, .gap_us = SECOND_US };
+        sequence_program program = compile(&step, 1);
+        sim_engine sim;
+        start(&sim, &program);
+        sim_run(&sim);
+
+        CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), count);
+        CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_CLOSED), count);
+        CHECK_EQ(s_Trace[sim.count - 1].frame, count);
+        CHECK(s_Trace[sim.count - 1].flags & SEQUENCE_EVENT_CLOSED);
+        CHECK_EQ(program.duration_us, count * 2 * SECOND_US + (count - 1) * SECOND_US);
+    }
+
+    sequence_step none = { .type = SEQUENCE_STEP_EXPOSE, .count = 0, .exposure_us = SECOND_US };
+    sequence_program program = compile(&none, 1);
+    CHECK_EQ(program.count, 0);
+    CHECK_EQ(program.frames, 0);
+}
+
+// Steps follow each other without losing or adding time, frames are numbered across them
+static void test_steps_chain(void)
+{
+    sequence_step steps[] = {
+        { .type = SEQUENCE_STEP_EXPOSE, .count = 3, .exposure_us = 30 * SECOND_US, .gap_us = 2 * SECOND_US },
+        { .type = SEQUENCE_STEP_PAUSE, .exposure_us = MINUTE_US },
+        { .type = SEQUENCE_STEP_DARK, .count = 2, .exposure_us = 30 * SECOND_US, .gap_us = 2 * SECOND_US },
+    };
+    sequence_program program = compile(steps, 3);
+    CHECK_EQ(program.frames, 5);
+
+    sim_engine sim;
+    start(&sim, &program);
+    sim_run(&sim);
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), 5);
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_DARK), 2);
+
+    // The dark block starts after the gap of the third frame and the pause
+    int dark = find(&sim, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_DARK, 0);
+    CHECK_EQ(s_Trace[dark].frame, 4);
+    CHECK_EQ(s_Trace[dark].at_us, START_US + 3 * 32 * SECOND_US + MINUTE_US);
+    CHECK_EQ(program.duration_us, 3 * 32 * SECOND_US + MINUTE_US + 32 * SECOND_US + 30 * SECOND_US);
+}
+
+// Waits longer than the 32-bit delay of an event are chained through events that change nothing
+static void test_long_exposure(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 2, .exposure_us = 3 * HOUR_US, .gap_us = 2 * HOUR_US };
+    sequence_program program = compile(&step, 1);
+    CHECK(program.count > 4);
+
+    sim_engine sim;
+    start(&sim, &program);
+    sim_run(&sim);
+    int opened = find(&sim, SEQUENCE_EVENT_OPENED, 1), closed = find(&sim, SEQUENCE_EVENT_CLOSED, 1);
+    CHECK_EQ(s_Trace[opened].at_us, START_US + 5 * HOUR_US);
+    CHECK_EQ(s_Trace[closed].at_us, START_US + 8 * HOUR_US);
+    for (int i = opened + 1; i < closed; i++) {
+        CHECK_EQ(s_Trace[i].pins, SEQUENCE_PIN_SHUTTER);
+        CHECK_EQ(s_Trace[i].flags, 0);
+    }
+}
+
+// A pause between exposures shifts the rest of the schedule by exactly the time spent paused
+static void test_pause_between_exposures(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 4, .exposure_us = 10 * SECOND_US, .gap_us = 5 * SECOND_US };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+
+    sim_run_until(&sim, START_US + 12 * SECOND_US);
+    sim_pause(&sim);
+    CHECK_EQ(sim.cursor.pins, 0);
+    sim_run_until(&sim, START_US + 12 * SECOND_US + HOUR_US);
+    CHECK_EQ(sim.count, 2); // Nothing happens while paused
+    sim_resume(&sim);
+    sim_run(&sim);
+
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), 4);
+    for (int frame = 2; frame <= 4; frame++) {
+        CHECK_EQ(s_Trace[find(&sim, SEQUENCE_EVENT_OPENED, frame - 1)].at_us, START_US + (frame - 1) * 15 * SECOND_US + HOUR_US);
+    }
+    CHECK_EQ(sim.now_us, START_US + program.duration_us + HOUR_US);
+}
+
+// An exposure cut short by a pause is taken again in full once resumed
+static void test_pause_during_exposure(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 2, .exposure_us = 10 * SECOND_US, .gap_us = 5 * SECOND_US };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+
+    sim_run_until(&sim, START_US + 18 * SECOND_US); // 3 s into the second exposure
+    sim_pause(&sim);
+    CHECK_EQ(sim.cursor.pins, 0);
+    sim_run_until(&sim, START_US + MINUTE_US);
+    sim_resume(&sim);
+    sim_run(&sim);
+
+    int opened = find(&sim, SEQUENCE_EVENT_OPENED, 2);
+    CHECK(opened >= 0);
+    CHECK_EQ(s_Trace[opened].frame, 2);
+    CHECK_EQ(s_Trace[opened].at_us, START_US + MINUTE_US + SEQUENCE_SIM_RESTART_US);
+    CHECK_EQ(s_Trace[opened + 1].at_us, START_US + MINUTE_US + SEQUENCE_SIM_RESTART_US + 10 * SECOND_US);
+    CHECK(s_Trace[opened + 1].flags & SEQUENCE_EVENT_CLOSED);
+}
+
+// Pausing during the mirror lock-up pulse goes back to the focus of the same frame, not to the previous exposure
+static void test_pause_during_lockup(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 2, .exposure_us = 10 * SECOND_US, .gap_us = 5 * SECOND_US,
+                           .lockup_us = 2 * SECOND_US, .focus_us = SECOND_US };
+    sequence_program program = compile(&step, 1);
+    CHECK_EQ(program.count, 10);
+    sim_engine sim;
+    start(&sim, &program);
+
+    // Second frame: focus at 18.2 s, mirror pulse from 19.2 s
+    uint64_t frame_us = SECOND_US + SEQUENCE_LOCKUP_PULSE_US + 2 * SECOND_US + 10 * SECOND_US + 5 * SECOND_US;
+    sim_run_until(&sim, START_US + frame_us + SECOND_US + SEQUENCE_LOCKUP_PULSE_US / 2);
+    CHECK_EQ(sim.cursor.pins, SEQUENCE_PIN_SHUTTER | SEQUENCE_PIN_FOCUS);
+    CHECK(!sim.cursor.exposing);
+    int traced = sim.count;
+
+    sim_pause(&sim);
+    sim_resume(&sim);
+    sim_run(&sim);
+
+    // Focus, pulse, opening and closing of frame 2 once more, and no third opening of frame 1
+    CHECK(s_Trace[traced].flags & SEQUENCE_EVENT_FRAME);
+    CHECK_EQ(s_Trace[traced].pins, SEQUENCE_PIN_FOCUS);
+    CHECK_EQ(s_Trace[traced].at_us, START_US + frame_us + SECOND_US + SEQUENCE_LOCKUP_PULSE_US / 2 + SEQUENCE_SIM_RESTART_US);
+    CHECK_EQ(sim.count, traced + 5);
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), 2);
+    CHECK_EQ(s_Trace[find(&sim, SEQUENCE_EVENT_OPENED, 1)].frame, 2);
+}
+
+// Skipping closes the current exposure right away, the later frames keep their schedule
+static void test_skip(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 3, .exposure_us = 10 * SECOND_US, .gap_us = 5 * SECOND_US };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+
+    sim_run_until(&sim, START_US + 4 * SECOND_US);
+    sim_skip(&sim);
+    CHECK_EQ(s_Trace[1].at_us, START_US + 4 * SECOND_US);
+    CHECK_EQ(s_Trace[1].frame, 1);
+    CHECK_EQ(sim.cursor.pins, 0);
+
+    // Between exposures, the next one is dropped
+    sim_run_until(&sim, START_US + 12 * SECOND_US);
+    sim_skip(&sim);
+    CHECK_EQ(s_Trace[2].frame, 2);
+    sim_run(&sim);
+    CHECK_EQ(sim_count(&sim, SEQUENCE_EVENT_OPENED), 2);
+    CHECK_EQ(s_Trace[3].frame, 3);
+    CHECK(s_Trace[3].flags & SEQUENCE_EVENT_OPENED);
+    CHECK_EQ(s_Trace[3].at_us, START_US + 30 * SECOND_US);
+    CHECK_EQ(sim.now_us, START_US + program.duration_us);
+}
+
+// Extending during an exposure lengthens the gap after it, between exposures the current gap
+static void test_extend(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 3, .exposure_us = 10 * SECOND_US, .gap_us = 5 * SECOND_US };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+
+    sim_run_until(&sim, START_US + SECOND_US);
+    CHECK(!sequence_cursor_extend(&sim.cursor, 7 * SECOND_US));
+    sim_run_until(&sim, START_US + 12 * SECOND_US);
+    CHECK(sequence_cursor_extend(&sim.cursor, 3 * SECOND_US));
+    sim_run(&sim);
+
+    CHECK_EQ(s_Trace[1].at_us, START_US + 10 * SECOND_US);
+    CHECK_EQ(s_Trace[2].at_us, START_US + 25 * SECOND_US);
+    CHECK_EQ(sim.now_us, START_US + program.duration_us + 10 * SECOND_US);
+}
+
+static void test_bracket(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_BRACKET, .count = 4, .factor = 3, .exposure_us = SECOND_US, .gap_us = SECOND_US };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+    sim_run(&sim);
+
+    uint64_t exposure_us = SECOND_US;
+    for (int frame = 0; frame < 4; frame++, exposure_us *= 3) {
+        CHECK_EQ(s_Trace[2 * frame + 1].at_us - s_Trace[2 * frame].at_us, exposure_us);
+    }
+
+    // A factor of 0 and exposures that overflow are refused, the last frame is not multiplied any further
+    sequence_event events[16];
+    sequence_program refused;
+    sequence_begin(&refused, events, 16);
+    step.factor = 0;
+    CHECK(!sequence_add_step(&refused, &step));
+    sequence_begin(&refused, events, 16);
+    step = (sequence_step){ .type = SEQUENCE_STEP_BRACKET, .count = 2, .factor = UINT32_MAX, .exposure_us = 1ULL << 33 };
+    CHECK(!sequence_add_step(&refused, &step));
+    sequence_begin(&refused, events, 16);
+    step.count = 1;
+    CHECK(sequence_add_step(&refused, &step));
+}
+
+static void test_ramp(void)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_RAMP, .count = 5, .curve = SEQUENCE_RAMP_LINEAR,
+                           .exposure_us = SECOND_US, .exposure_end_us = 5 * SECOND_US,
+                           .gap_us = 4 * SECOND_US, .gap_end_us = 0 };
+    sequence_program program = compile(&step, 1);
+    sim_engine sim;
+    start(&sim, &program);
+    sim_run(&sim);
+
+    for (int frame = 0; frame < 5; frame++) {
+        CHECK_EQ(s_Trace[2 * frame + 1].at_us - s_Trace[2 * frame].at_us, (frame + 1) * SECOND_US);
+        if (frame < 4) {
+            CHECK_EQ(s_Trace[2 * frame + 2].at_us - s_Trace[2 * frame + 1].at_us, (4 - frame) * SECOND_US);
+        }
+    }
+
+    // Both ends are exact on a log ramp too
+    step.curve = SEQUENCE_RAMP_LOG;
+    step.exposure_end_us = 64 * SECOND_US;
+    step.count = 7;
+    program = compile(&step, 1);
+    start(&sim, &program);
+    sim_run(&sim);
+    CHECK_EQ(s_Trace[1].at_us - s_Trace[0].at_us, SECOND_US);
+    CHECK_EQ(s_Trace[13].at_us - s_Trace[12].at_us, 64 * SECOND_US);
+    CHECK_EQ(s_Trace[7].at_us - s_Trace[6].at_us, 8 * SECOND_US);
+}
+
+// A sequence that does not fit the event array is refused rather than cut short
+static void test_capacity(void)
+{
+    sequence_event events[8];
+    sequence_program program;
+    sequence_begin(&program, events, 8);
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 4, .exposure_us = SECOND_US };
+    CHECK(sequence_add_step(&program, &step));
+    step.count = 1;
+    CHECK(!sequence_add_step(&program, &step));
+}
+
+int main(void)
+{
+    RUN_TEST(test_night_session);
+    RUN_TEST(test_last_frame);
+    RUN_TEST(test_steps_chain);
+    RUN_TEST(test_long_exposure);
+    RUN_TEST(test_pause_between_exposures);
+    RUN_TEST(test_pause_during_exposure);
+    RUN_TEST(test_pause_during_lockup);
+    RUN_TEST(test_skip);
+    RUN_TEST(test_extend);
+    RUN_TEST(test_bracket);
+    RUN_TEST(test_ramp);
+    RUN_TEST(test_capacity);
+    return test_failures();
+}
@@ -0,0 +1,135 @@
+#include "sequence.h"
+#include "test.h"
+
+#define SECOND_US 1000000ULL
+
+_Static_assert(sizeof(sequence_event) == 8, "events are meant to stay 8 bytes");
+
+static sequence_event s_Events[64];
+
+static void check_event(const sequence_event *event, uint32_t delay_us, uint16_t frame, uint8_t pins, uint8_t flags)
+{
+    CHECK_EQ(event->delay_us, delay_us);
+    CHECK_EQ(event->frame, frame);
+    CHECK_EQ(event->pins, pins);
+    CHECK_EQ(event->flags, flags);
+}
+
+// A plain exposure is its opening and its closing, delta-encoded
+static void test_plain_exposure(void)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, 64);
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 2, .exposure_us = 2 * SECOND_US, .gap_us = SECOND_US };
+    CHECK(sequence_add_step(&program, &step));
+
+    CHECK_EQ(program.count, 4);
+    check_event(&s_Events[0], 0, 1, SEQUENCE_PIN_SHUTTER, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_FRAME);
+    check_event(&s_Events[1], 2 * SECOND_US, 1, 0, SEQUENCE_EVENT_CLOSED);
+    check_event(&s_Events[2], SECOND_US, 2, SEQUENCE_PIN_SHUTTER, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_FRAME);
+    check_event(&s_Events[3], 2 * SECOND_US, 2, 0, SEQUENCE_EVENT_CLOSED);
+    CHECK_EQ(program.duration_us, 5 * SECOND_US);
+    CHECK_EQ(program.cursor_us, 6 * SECOND_US); // The next step starts after the gap of the last frame
+}
+
+// Focus is held from before the mirror flips up until the exposure closes
+static void test_focus_and_lockup(void)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, 64);
+    sequence_step step = { .type = SEQUENCE_STEP_DARK, .count = 1, .exposure_us = 4 * SECOND_US,
+                           .lockup_us = 2 * SECOND_US, .focus_us = SECOND_US / 2 };
+    CHECK(sequence_add_step(&program, &step));
+
+    CHECK_EQ(program.count, 5);
+    check_event(&s_Events[0], 0, 0, SEQUENCE_PIN_FOCUS, SEQUENCE_EVENT_FRAME);
+    check_event(&s_Events[1], SECOND_US / 2, 0, SEQUENCE_PIN_FOCUS | SEQUENCE_PIN_SHUTTER, 0);
+    check_event(&s_Events[2], SEQUENCE_LOCKUP_PULSE_US, 0, SEQUENCE_PIN_FOCUS, 0);
+    check_event(&s_Events[3], 2 * SECOND_US, 1, SEQUENCE_PIN_FOCUS | SEQUENCE_PIN_SHUTTER, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_DARK);
+    check_event(&s_Events[4], 4 * SECOND_US, 1, 0, SEQUENCE_EVENT_CLOSED | SEQUENCE_EVENT_DARK);
+}
+
+// Pauses only move where the next step starts, a leading one delays the first event
+static void test_pause_step(void)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, 64);
+    sequence_step pause = { .type = SEQUENCE_STEP_PAUSE, .exposure_us = 7 * SECOND_US };
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 1, .exposure_us = SECOND_US };
+    CHECK(sequence_add_step(&program, &pause));
+    CHECK_EQ(program.count, 0);
+    CHECK(sequence_add_step(&program, &step));
+    check_event(&s_Events[0], 7 * SECOND_US, 1, SEQUENCE_PIN_SHUTTER, SEQUENCE_EVENT_OPENED | SEQUENCE_EVENT_FRAME);
+    CHECK_EQ(program.duration_us, 8 * SECOND_US);
+}
+
+// Delays beyond 32 bits go through events keeping the outputs as they are
+static void test_long_delay(void)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, 64);
+    uint64_t exposure_us = 2ULL * UINT32_MAX + 5;
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 1, .exposure_us = exposure_us };
+    CHECK(sequence_add_step(&program, &step));
+
+    CHECK_EQ(program.count, 4);
+    check_event(&s_Events[1], UINT32_MAX, 0, SEQUENCE_PIN_SHUTTER, 0);
+    check_event(&s_Events[2], UINT32_MAX, 0, SEQUENCE_PIN_SHUTTER, 0);
+    check_event(&s_Events[3], 5, 1, 0, SEQUENCE_EVENT_CLOSED);
+}
+
+static void test_invalid_steps(void)
+{
+    sequence_program program;
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 1, .exposure_us = 0 };
+    sequence_begin(&program, s_Events, 64);
+    CHECK(!sequence_add_step(&program, &step));
+
+    // Frame numbers are 16-bit
+    step = (sequence_step){ .type = SEQUENCE_STEP_EXPOSE, .count = UINT16_MAX + 1, .exposure_us = 1 };
+    sequence_begin(&program, s_Events, 64);
+    CHECK(!sequence_add_step(&program, &step));
+
+    // A ramp reaching an exposure of 0
+    step = (sequence_step){ .type = SEQUENCE_STEP_RAMP, .count = 3, .exposure_us = SECOND_US, .exposure_end_us = 0 };
+    sequence_begin(&program, s_Events, 64);
+    CHECK(!sequence_add_step(&program, &step));
+}
+
+// The cursor produces the events at their absolute times and sets the outputs they carry
+static void test_cursor(void)
+{
+    sequence_program program;
+    sequence_begin(&program, s_Events, 64);
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = 2, .exposure_us = 2 * SECOND_US, .gap_us = SECOND_US,
+                           .focus_us = SECOND_US };
+    CHECK(sequence_add_step(&program, &step));
+
+    sequence_cursor cursor;
+    sequence_cursor_start(&cursor, s_Events, program.count, 100);
+    static const uint64_t times_us[] = { 0, SECOND_US, 3 * SECOND_US, 4 * SECOND_US, 5 * SECOND_US, 7 * SECOND_US };
+    static const uint8_t pins[] = {
+        SEQUENCE_PIN_FOCUS, SEQUENCE_PIN_FOCUS | SEQUENCE_PIN_SHUTTER, 0,
+        SEQUENCE_PIN_FOCUS, SEQUENCE_PIN_FOCUS | SEQUENCE_PIN_SHUTTER, 0,
+    };
+    for (int i = 0; i < 6; i++) {
+        CHECK(!sequence_cursor_done(&cursor));
+        CHECK_EQ(cursor.next_edge_us, 100 + times_us[i]);
+        sequence_cursor_advance(&cursor);
+        CHECK_EQ(cursor.pins, pins[i]);
+        CHECK_EQ(cursor.exposing, pins[i] & SEQUENCE_PIN_SHUTTER ? 1 : 0);
+    }
+    CHECK(sequence_cursor_done(&cursor));
+    CHECK_EQ(cursor.frame, 2);
+}
+
+int main(void)
+{
+    RUN_TEST(test_plain_exposure);
+    RUN_TEST(test_focus_and_lockup);
+    RUN_TEST(test_pause_step);
+    RUN_TEST(test_long_delay);
+    RUN_TEST(test_invalid_steps);
+    RUN_TEST(test_cursor);
+    return test_failures();
+}
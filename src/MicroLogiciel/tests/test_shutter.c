@@ -0,0 +1,365 @@
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+
+#include "edge_log.h"
+#include "shutter.h"
+#include "test.h"
+
+#define SECOND_US 1000000ULL
+#define MINUTE_US (60 * SECOND_US)
+#define START_US 5000 // From the time of the start call, further than SHUTTER_START_LEAD_US
+#define EVENT_QUEUE_SIZE 64
+
+static sequence_event s_Events[2048];
+static QueueHandle_t s_ShutterEvents;
+
+/* The shutter engine of the firmware, shutter.c, run on the alarm of host/pico_host.c: the edges are produced by its
+ * alarm callback as the tests move the virtual clock, and its commands are called as the timer task calls them. */
+
+static sequence_program compile(int count, uint64_t exposure_us, uint64_t gap_us)
+{
+    sequence_step step = { .type = SEQUENCE_STEP_EXPOSE, .count = count, .exposure_us = exposure_us, .gap_us = gap_us };
+    sequence_program program;
+    sequence_begin(&program, s_Events, sizeof(s_Events) / sizeof(s_Events[0]));
+    CHECK(sequence_add_step(&program, &step));
+    return program;
+}
+
+// Drops the events of the earlier runs
+static void drop_events(void)
+{
+    shutter_event event;
+    while (xQueueReceive(s_ShutterEvents, &event, 0) == pdTRUE) {
+    }
+}
+
+// Starts 'program' START_US from now. Returns the start time.
+static uint64_t start(const sequence_program *program)
+{
+    drop_events();
+    uint64_t start_us = time_us_64() + START_US;
+    CHECK(shutter_start(program->events, program->count, start_us));
+    return start_us;
+}
+
+// Next event reported by the engine, checked against what is expected
+static void check_event(shutter_event_type type, uint32_t frame, uint64_t next_us)
+{
+    shutter_event event = { .type = -1 };
+    CHECK(xQueueReceive(s_ShutterEvents, &event, 0) == pdTRUE);
+    CHECK_EQ(event.type, type);
+    CHECK_EQ(event.frame, frame);
+    CHECK_EQ(event.next_us, next_us);
+}
+
+static void check_no_event(void)
+{
+    CHECK_EQ(uxQueueMessagesWaiting(s_ShutterEvents), 0);
+}
+
+// The target the engine armed its alarm for, 0 if none
+static uint64_t alarm_target(void)
+{
+    uint64_t target_us;
+    return host_alarm_armed(0, &target_us) ? target_us : 0;
+}
+
+// Latency model: 'base_us' for every alarm, 'spike_us' for one alarm in 'period'
+typedef struct
+{
+    uint32_t base_us;
+    uint32_t spike_us;
+    int period;
+    int alarms;
+} latency_model;
+
+static uint32_t model_latency(void *context)
+{
+    latency_model *model = context;
+    model->alarms++;
+    return (model->period && model->alarms % model->period == 0) ? model->spike_us : model->base_us;
+}
+
+// Runs 'program' to its end with alarms as late as 'model' says, returns the start time
+static uint64_t run(const sequence_program *program, latency_model *model)
+{
+    host_alarm_set_latency(model_latency, model);
+    uint64_t start_us = start(program);
+    host_time_run_until(start_us + program->duration_us + SECOND_US);
+    host_alarm_set_latency(NULL, NULL);
+    CHECK(!shutter_is_running());
+    return start_us;
+}
+
+/* A constant interrupt latency shows up as such in the log, and every edge is scheduled from the sequence rather than
+ * from the late edge before it: the errors do not add up over the session. */
+static void test_constant_latency(void)
+{
+    sequence_program program = compile(50, 30 * SECOND_US, 10 * SECOND_US);
+    latency_model model = { .base_us = 5 };
+    uint64_t start_us = run(&program, &model);
+
+    edge_log_summary summary;
+    edge_log_get_summary(&summary);
+    CHECK_EQ(summary.edges, 100);
+    CHECK_EQ(summary.histogram[3], 100);  // [4, 8) us
+    CHECK_EQ(summary.p50_us, 5);
+    CHECK_EQ(summary.p99_us, 5);
+    CHECK_EQ(summary.max_us, 5);
+
+    edge_record records[EDGE_LOG_SIZE];
+    uint32_t first;
+    int count = edge_log_read(0, records, EDGE_LOG_SIZE, &first);
+    CHECK_EQ(count, EDGE_LOG_SIZE);
+    CHECK_EQ(first, 100 - EDGE_LOG_SIZE);
+    for (int i = 0; i < count; i++) {
+        uint32_t edge = first + i;
+        uint64_t expected_us = start_us + (edge / 2) * 40 * SECOND_US + (edge % 2) * 30 * SECOND_US;
+        CHECK_EQ(records[i].scheduled_us, expected_us);
+        CHECK_EQ(records[i].late_us, 5);
+        CHECK_EQ(records[i].frame, edge / 2 + 1); // Frames are numbered from 1
+        CHECK_EQ(records[i].open, edge % 2 == 0);
+    }
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+}
+
+/* Occasional long latencies land in the tail of the histogram: 2% of them move the 99th percentile, the median stays */
+static void test_latency_tail(void)
+{
+    sequence_program program = compile(500, SECOND_US, SECOND_US);
+    latency_model model = { .base_us = 2, .spike_us = 300, .period = 50 };
+    run(&program, &model);
+
+    edge_log_summary summary;
+    edge_log_get_summary(&summary);
+    CHECK_EQ(summary.edges, 1000);
+    CHECK_EQ(summary.histogram[2], 980);  // [2, 4) us
+    CHECK_EQ(summary.histogram[9], 20);   // [256, 512) us
+    CHECK_EQ(summary.p50_us, 4);
+    CHECK_EQ(summary.p99_us, 300);
+    CHECK_EQ(summary.max_us, 300);
+
+    // Only one spike in a hundred leaves the 99th percentile in the regular bucket
+    model = (latency_model){ .base_us = 2, .spike_us = 300, .period = 100 };
+    run(&program, &model);
+    edge_log_get_summary(&summary);
+    CHECK_EQ(summary.p99_us, 4);
+    CHECK_EQ(summary.max_us, 300);
+}
+
+/* An alarm later than the exposure produces both edges in the same interrupt, the target of the second one being
+ * reported as missed, each logged with its own error. The next frame is still taken on time. */
+static void test_catch_up(void)
+{
+    sequence_program program = compile(3, 100, SECOND_US);
+    latency_model model = { .base_us = 10, .spike_us = 250, .period = 3 };
+    uint64_t start_us = run(&program, &model);
+
+    edge_record records[8];
+    uint32_t first;
+    int count = edge_log_read(0, records, 8, &first);
+    CHECK_EQ(count, 6);
+    CHECK_EQ(first, 0);
+
+    // Alarms 1 and 2 are on time, alarm 3 opens frame 2 late enough to close it too
+    static const int32_t late_us[6] = { 10, 10, 250, 150, 10, 10 };
+    for (int i = 0; i < count && i < 6; i++) {
+        CHECK_EQ(records[i].late_us, late_us[i]);
+    }
+    CHECK_EQ(records[4].scheduled_us, start_us + 2 * (SECOND_US + 100));
+    CHECK_EQ(model.alarms, 5);
+}
+
+/* Readers continue from where they stopped and skip what the ring no longer holds */
+static void test_read_continuation(void)
+{
+    sequence_program program = compile(500, SECOND_US, SECOND_US);
+    latency_model model = { .base_us = 1 };
+    run(&program, &model);
+
+    edge_record records[EDGE_LOG_SIZE];
+    uint32_t first;
+    CHECK_EQ(edge_log_read(0, records, 16, &first), 16);
+    CHECK_EQ(first, 1000 - EDGE_LOG_SIZE);
+    CHECK_EQ(edge_log_read(first + 16, records, EDGE_LOG_SIZE, &first), EDGE_LOG_SIZE - 16);
+    CHECK_EQ(first, 1000 - EDGE_LOG_SIZE + 16);
+    CHECK_EQ(records[0].frame, first / 2 + 1);
+    CHECK_EQ(edge_log_read(1000, records, EDGE_LOG_SIZE, &first), 0);
+    CHECK_EQ(first, 1000);
+
+    // A new session empties the log
+    edge_log_summary before, after;
+    edge_log_get_summary(&before);
+    run(&program, &model);
+    edge_log_get_summary(&after);
+    CHECK_EQ(after.session, before.session + 1);
+    CHECK_EQ(after.edges, 1000);
+}
+
+/* A start whose time has already passed is not lost: the alarm interrupt is forced, and runs as soon as the engine
+ * releases its lock */
+static void test_start_passed(void)
+{
+    sequence_program program = compile(1, SECOND_US, 0);
+    drop_events();
+    uint64_t now_us = time_us_64();
+    CHECK(shutter_start(program.events, program.count, now_us - 100));
+    CHECK(gpio_get_out_level(SHUTTER_GPIO));
+    shutter_event event;
+    CHECK(xQueueReceive(s_ShutterEvents, &event, 0) == pdTRUE);
+    CHECK_EQ(event.type, SHUTTER_EVENT_OPENED);
+    CHECK_EQ(event.late_us, 100);
+    CHECK_EQ(alarm_target(), now_us - 100 + SECOND_US);
+
+    // A second start is refused while the first one runs
+    CHECK(!shutter_start(program.events, program.count, now_us + SECOND_US));
+    host_time_run_until(now_us + SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 1, 0);
+    check_event(SHUTTER_EVENT_DONE, 1, 0);
+    CHECK(!shutter_is_running());
+    CHECK_EQ(alarm_target(), 0);
+}
+
+/* Skipping closes the exposure at once, or drops the next one between exposures, and arms the alarm again for the
+ * next edge as scheduled. The events are in the order of the outputs. */
+static void test_skip(void)
+{
+    sequence_program program = compile(3, 10 * SECOND_US, 5 * SECOND_US);
+    uint64_t start_us = start(&program);
+    CHECK_EQ(alarm_target(), start_us);
+
+    host_time_run_until(start_us + 4 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 1, start_us + 10 * SECOND_US);
+    CHECK(gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(shutter_skip());
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    check_event(SHUTTER_EVENT_CLOSED, 1, start_us + 15 * SECOND_US);
+    CHECK_EQ(alarm_target(), start_us + 15 * SECOND_US);
+
+    // Between exposures, the next one is dropped
+    host_time_run_until(start_us + 12 * SECOND_US);
+    check_no_event();
+    CHECK(shutter_skip());
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    check_event(SHUTTER_EVENT_SKIPPED, 2, start_us + 30 * SECOND_US);
+    CHECK_EQ(alarm_target(), start_us + 30 * SECOND_US);
+
+    host_time_run_until(start_us + 30 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 3, start_us + 40 * SECOND_US);
+    CHECK(gpio_get_out_level(SHUTTER_GPIO));
+
+    // Skipping the last exposure ends the sequence, with nothing left armed
+    CHECK(shutter_skip());
+    check_event(SHUTTER_EVENT_CLOSED, 3, 0);
+    check_event(SHUTTER_EVENT_DONE, 3, 0);
+    CHECK(!shutter_is_running());
+    CHECK_EQ(alarm_target(), 0);
+    CHECK(!shutter_skip());
+    host_time_run_until(start_us + 2 * MINUTE_US);
+    check_no_event();
+}
+
+/* A pause releases the outputs and disarms the alarm; nothing happens until the resume, which takes the exposure cut
+ * short again in full, SHUTTER_START_LEAD_US later */
+static void test_pause_resume(void)
+{
+    sequence_program program = compile(2, 10 * SECOND_US, 5 * SECOND_US);
+    uint64_t start_us = start(&program);
+
+    host_time_run_until(start_us + 3 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 1, start_us + 10 * SECOND_US);
+    CHECK(shutter_pause());
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    CHECK_EQ(alarm_target(), 0);
+    CHECK(!shutter_pause());
+    host_time_run_until(start_us + MINUTE_US);
+    check_no_event();
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+
+    uint64_t next_us = 0;
+    CHECK(shutter_resume(&next_us));
+    CHECK_EQ(next_us, start_us + MINUTE_US + SHUTTER_START_LEAD_US);
+    CHECK_EQ(alarm_target(), next_us);
+    CHECK(!shutter_resume(&next_us));
+
+    host_time_run_until(start_us + MINUTE_US + SHUTTER_START_LEAD_US + 10 * SECOND_US);
+    uint64_t opened_us = start_us + MINUTE_US + SHUTTER_START_LEAD_US;
+    check_event(SHUTTER_EVENT_OPENED, 1, opened_us + 10 * SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 1, opened_us + 15 * SECOND_US);
+
+    // Between exposures, the rest of the schedule moves by the time spent paused
+    host_time_run_until(opened_us + 12 * SECOND_US);
+    CHECK(shutter_pause());
+    host_time_run_until(opened_us + 12 * SECOND_US + MINUTE_US);
+    CHECK(shutter_resume(&next_us));
+    CHECK_EQ(next_us, opened_us + 15 * SECOND_US + MINUTE_US);
+    host_time_run_until(next_us + 10 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 2, next_us + 10 * SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 2, 0);
+    check_event(SHUTTER_EVENT_DONE, 2, 0);
+    CHECK(!shutter_is_running());
+    CHECK(!shutter_pause());
+}
+
+/* Extending during an exposure lengthens the gap after it, between exposures the current gap: the alarm is armed
+ * again for the new time */
+static void test_extend(void)
+{
+    sequence_program program = compile(3, 10 * SECOND_US, 5 * SECOND_US);
+    uint64_t start_us = start(&program);
+
+    host_time_run_until(start_us + SECOND_US);
+    CHECK(shutter_extend(7 * SECOND_US));
+    CHECK_EQ(alarm_target(), start_us + 10 * SECOND_US);
+    host_time_run_until(start_us + 12 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 1, start_us + 10 * SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 1, start_us + 22 * SECOND_US);
+    CHECK_EQ(alarm_target(), start_us + 22 * SECOND_US);
+
+    CHECK(shutter_extend(3 * SECOND_US));
+    CHECK_EQ(alarm_target(), start_us + 25 * SECOND_US);
+    host_time_run_until(start_us + 25 * SECOND_US - 1);
+    check_no_event();
+    host_time_run_until(start_us + program.duration_us + 10 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 2, start_us + 35 * SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 2, start_us + 40 * SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 3, start_us + 50 * SECOND_US);
+    check_event(SHUTTER_EVENT_CLOSED, 3, 0);
+    check_event(SHUTTER_EVENT_DONE, 3, 0);
+    CHECK(!shutter_extend(SECOND_US));
+}
+
+// A stop releases the outputs and disarms the alarm, and reports nothing
+static void test_stop(void)
+{
+    sequence_program program = compile(3, 10 * SECOND_US, 5 * SECOND_US);
+    uint64_t start_us = start(&program);
+    host_time_run_until(start_us + SECOND_US);
+    check_event(SHUTTER_EVENT_OPENED, 1, start_us + 10 * SECOND_US);
+
+    CHECK(shutter_stop());
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(!shutter_is_running());
+    CHECK_EQ(alarm_target(), 0);
+    CHECK(!shutter_stop());
+    host_time_run_until(start_us + program.duration_us);
+    check_no_event();
+}
+
+int main(void)
+{
+    s_ShutterEvents = xQueueCreate(EVENT_QUEUE_SIZE, sizeof(shutter_event));
+    CHECK(shutter_init(s_ShutterEvents));
+    host_time_run_until(SECOND_US);
+
+    RUN_TEST(test_constant_latency);
+    RUN_TEST(test_latency_tail);
+    RUN_TEST(test_catch_up);
+    RUN_TEST(test_read_continuation);
+    RUN_TEST(test_start_passed);
+    RUN_TEST(test_skip);
+    RUN_TEST(test_pause_resume);
+    RUN_TEST(test_extend);
+    RUN_TEST(test_stop);
+    return test_failures();
+}
@@ -0,0 +1,64 @@
+#include <string.h>
+
+#include "simplefs_image.h"
+#include "test.h"
+
+static const char *name_of(const simplefs_image *image, const StoredFileEntry *entry)
+{
+    return entry ? image->fs.names + entry->NameOffset : "";
+}
+
+/* Every file of an image is found through the perfect hash index, on the entry the linear scan finds, and paths that
+ * are not in the image are not */
+static void check_lookups(int count)
+{
+    simplefs_image image;
+    CHECK(simplefs_image_build(&image, count));
+    if (!image.data) {
+        simplefs_image_free(&image);
+        return;
+    }
+
+    CHECK_EQ(image.fs.header->Magic, kSimpleFSIndexedHeaderMagic);
+    CHECK_EQ(image.fs.header->EntryCount, count);
+    CHECK(image.fs.index != NULL);
+
+    uint32_t *index = image.fs.index;
+    for (int i = 0; i < count; i++) {
+        StoredFileEntry *entry = simplefs_find(&image.fs, image.paths[i]);
+        CHECK(!strcmp(name_of(&image, entry), image.paths[i]));
+        CHECK(entry && !memcmp(image.fs.data + entry->DataOffset, image.paths[i], entry->FileSize));
+
+        image.fs.index = NULL;
+        CHECK(simplefs_find(&image.fs, image.paths[i]) == entry);
+        image.fs.index = index;
+    }
+
+    static const char *const missing[] = { "", "d0", "d0/", "d0/file0.cs", "d0/file0.css2", "d9/file0.css", "index.html" };
+    for (int i = 0; i < (int)(sizeof(missing) / sizeof(missing[0])); i++) {
+        CHECK(simplefs_find(&image.fs, missing[i]) == NULL);
+        image.fs.index = NULL;
+        CHECK(simplefs_find(&image.fs, missing[i]) == NULL);
+        image.fs.index = index;
+    }
+
+    simplefs_image_free(&image);
+}
+
+static void test_small_image(void)
+{
+    check_lookups(1);
+    check_lookups(10);
+}
+
+static void test_large_image(void)
+{
+    check_lookups(1000);
+}
+
+int main(void)
+{
+    RUN_TEST(test_small_image);
+    RUN_TEST(test_large_image);
+    return test_failures();
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http_host.h"
+#include "simplefs_image.h"
+#include "static_files.h"
+#include "test.h"
+
+#define REPLY_SIZE 8192
+
+static simplefs_image s_Image;
+static char s_Script[2048];
+
+// GET of 'path' with the extra request headers 'headers', returns the reply, held until the next call
+static const char *get(const char *path, const char *headers)
+{
+    static char reply[REPLY_SIZE];
+    char request[512];
+    snprintf(request, sizeof(request), "GET /%s HTTP/1.1\r\nHost: pico\r\n%sConnection: close\r\n\r\n", path, headers);
+    return http_host_exchange(request, reply, sizeof(reply)) > 0 ? reply : "";
+}
+
+// Value of the header 'name' of 'reply', NULL if it has none, held until the next call
+static const char *header(const char *reply, const char *name)
+{
+    static char value[128];
+    const char *end = strstr(reply, "\r\n\r\n");
+    for (const char *line = strstr(reply, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+        int len = strlen(name);
+        if (!strncasecmp(line + 2, name, len) && line[2 + len] == ':') {
+            const char *start = line + 3 + len + strspn(line + 3 + len, " ");
+            snprintf(value, sizeof(value), "%.*s", (int)strcspn(start, "\r"), start);
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// True if 'reply' has the header 'name' with the value 'value'
+static bool has_header(const char *reply, const char *name, const char *value)
+{
+    const char *found = header(reply, name);
+    return found && !strcmp(found, value);
+}
+
+static bool is_status(const char *reply, const char *status)
+{
+    return !strncmp(reply, "HTTP/1.1 ", 9) && !strncmp(reply + 9, status, strlen(status));
+}
+
+static const char *body(const char *reply)
+{
+    const char *content = strstr(reply, "\r\n\r\n");
+    return content ? content + 4 : "";
+}
+
+// The tag the image stores for 'path', quoted as the replies carry it
+static const char *stored_etag(const char *path, const char *suffix)
+{
+    static char etag[32];
+    StoredFileEntry *entry = simplefs_find(&s_Image.fs, path);
+    snprintf(etag, sizeof(etag), "\"%s%s\"", entry ? s_Image.fs.names + entry->ETagOffset : "", suffix);
+    return etag;
+}
+
+static bool has_gzip(const char *path)
+{
+    StoredFileEntry *entry = simplefs_find(&s_Image.fs, path);
+    return entry && (entry->Flags & kSimpleFSEntryHasGzip);
+}
+
+/* A file without a compressed copy is sent as stored, with its tag and without Vary, whatever the client accepts */
+static void test_identity_only(void)
+{
+    const char *reply = get("logo.png", "Accept-Encoding: gzip\r\n");
+    CHECK(is_status(reply, "200"));
+    CHECK(has_header(reply, "Content-Type", "image/png"));
+    CHECK(header(reply, "Content-Encoding") == NULL);
+    CHECK(header(reply, "Vary") == NULL);
+    CHECK(has_header(reply, "ETag", stored_etag("logo.png", "")));
+    CHECK(has_header(reply, "Cache-Control", "no-cache"));
+    CHECK(!strcmp(body(reply), "not really a png"));
+}
+
+/* The compressed copy goes to the clients that accept it, under its own tag; both replies vary on Accept-Encoding */
+static void test_gzip_selection(void)
+{
+    if (!has_gzip("app.js.txt")) {
+        printf("SimpleFSBuilder built without zlib, no compressed copy to select\n");
+        return;
+    }
+    StoredFileEntry *entry = simplefs_find(&s_Image.fs, "app.js.txt");
+
+    const char *reply = get("app.js.txt", "");
+    CHECK(is_status(reply, "200"));
+    CHECK(header(reply, "Content-Encoding") == NULL);
+    CHECK(has_header(reply, "Vary", "Accept-Encoding"));
+    CHECK(has_header(reply, "ETag", stored_etag("app.js.txt", "")));
+    CHECK(!strcmp(body(reply), s_Script));
+
+    static const char *const accepting[] = { "gzip", "deflate, gzip", "gzip;q=1.0, identity" };
+    for (int i = 0; i < (int)(sizeof(accepting) / sizeof(accepting[0])); i++) {
+        char headers[64];
+        snprintf(headers, sizeof(headers), "Accept-Encoding: %s\r\n", accepting[i]);
+        reply = get("app.js.txt", headers);
+        CHECK(is_status(reply, "200"));
+        CHECK(has_header(reply, "Content-Encoding", "gzip"));
+        CHECK(has_header(reply, "Vary", "Accept-Encoding"));
+        CHECK(has_header(reply, "ETag", stored_etag("app.js.txt", "-gz")));
+        char length[16];
+        snprintf(length, sizeof(length), "%u", (unsigned)entry->GzipSize);
+        CHECK(has_header(reply, "Content-Length", length));
+        CHECK(!memcmp(body(reply), s_Image.fs.data + entry->GzipDataOffset, 2)); // The gzip magic
+    }
+
+    // Not a gzip token
+    reply = get("app.js.txt", "Accept-Encoding: deflate, br\r\n");
+    CHECK(header(reply, "Content-Encoding") == NULL);
+    CHECK(has_header(reply, "ETag", stored_etag("app.js.txt", "")));
+}
+
+/* A matching If-None-Match gets a body-less 304 repeating the validators, a stale one the full reply */
+static void test_revalidation(void)
+{
+    char headers[128];
+    snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", stored_etag("logo.png", ""));
+    const char *reply = get("logo.png", headers);
+    CHECK(is_status(reply, "304"));
+    CHECK(has_header(reply, "ETag", stored_etag("logo.png", "")));
+    CHECK(has_header(reply, "Cache-Control", "no-cache"));
+    CHECK(!strcmp(body(reply), ""));
+
+    // Among others, as browsers send them
+    snprintf(headers, sizeof(headers), "If-None-Match: \"0123456789abcdef\", %s\r\n", stored_etag("logo.png", ""));
+    CHECK(is_status(get("logo.png", headers), "304"));
+    CHECK(is_status(get("logo.png", "If-None-Match: *\r\n"), "304"));
+
+    // The tag of the previous version of the file
+    reply = get("logo.png", "If-None-Match: \"0123456789abcdef\"\r\n");
+    CHECK(is_status(reply, "200"));
+    CHECK(!strcmp(body(reply), "not really a png"));
+
+    // The tag of the other file
+    snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", stored_etag("app.js.txt", ""));
+    CHECK(is_status(get("logo.png", headers), "200"));
+}
+
+/* The tags of the two representations only match the representation they were sent with */
+static void test_revalidation_gzip(void)
+{
+    if (!has_gzip("app.js.txt")) {
+        return;
+    }
+    char headers[128];
+    char identity[32], gzip[32];
+    snprintf(identity, sizeof(identity), "%s", stored_etag("app.js.txt", ""));
+    snprintf(gzip, sizeof(gzip), "%s", stored_etag("app.js.txt", "-gz"));
+
+    snprintf(headers, sizeof(headers), "Accept-Encoding: gzip\r\nIf-None-Match: %s\r\n", gzip);
+    const char *reply = get("app.js.txt", headers);
+    CHECK(is_status(reply, "304"));
+    CHECK(has_header(reply, "ETag", gzip));
+    CHECK(has_header(reply, "Vary", "Accept-Encoding"));
+    CHECK(has_header(reply, "Content-Encoding", "gzip"));
+    CHECK(!strcmp(body(reply), ""));
+
+    snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", identity);
+    reply = get("app.js.txt", headers);
+    CHECK(is_status(reply, "304"));
+    CHECK(has_header(reply, "ETag", identity));
+    CHECK(has_header(reply, "Vary", "Accept-Encoding"));
+
+    // A cache holding the identity copy asks again once the client accepts gzip, and the other way round
+    snprintf(headers, sizeof(headers), "Accept-Encoding: gzip\r\nIf-None-Match: %s\r\n", identity);
+    reply = get("app.js.txt", headers);
+    CHECK(is_status(reply, "200"));
+    CHECK(has_header(reply, "Content-Encoding", "gzip"));
+    snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", gzip);
+    reply = get("app.js.txt", headers);
+    CHECK(is_status(reply, "200"));
+    CHECK(!strcmp(body(reply), s_Script));
+}
+
+static void test_missing(void)
+{
+    CHECK(is_status(get("missing.txt", ""), "404"));
+    CHECK(is_status(get("", ""), "404"));
+}
+
+/* The static file replies of the server, on an image made by SimpleFSBuilder: a text file large enough to be stored with
+ * a compressed copy, and an image, which never is */
+int main(void)
+{
+    for (int len = 0; len < (int)sizeof(s_Script) - 64; ) {
+        len += snprintf(s_Script + len, sizeof(s_Script) - len, "function frame%d() { return update(%d); }\n", len, len);
+    }
+    static const char *const paths[] = { "app.js.txt", "logo.png" };
+    const char *const contents[] = { s_Script, "not really a png" };
+    if (!simplefs_image_build_files(&s_Image, paths, contents, 2)) {
+        printf("cannot build the image\n");
+        return 1;
+    }
+    if (!http_host_start_routes(NULL, 0, do_retrieve_file, &s_Image.fs)) {
+        return 1;
+    }
+
+    RUN_TEST(test_identity_only);
+    RUN_TEST(test_gzip_selection);
+    RUN_TEST(test_revalidation);
+    RUN_TEST(test_revalidation_gzip);
+    RUN_TEST(test_missing);
+    simplefs_image_free(&s_Image);
+    return test_failures();
+}
@@ -0,0 +1,268 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+#include <pico/cyw43_arch.h>
+
+#include "http_host.h"
+#include "shutter.h"
+#include "test.h"
+#include "timer.h"
+#include "websocket.h"
+
+#define SECOND_US 1000000ULL
+#define STATUS_TIMEOUT_MS 2000
+#define SKIP_CLIENTS 4
+
+/* The timer task of the firmware, timer.c, over the shutter engine on the host alarm: its commands are sent through
+ * the HTTP handlers of main.c, queued to the task and run one at a time, and its status follows the edges produced as
+ * the test moves the virtual clock. */
+
+// Sends a POST to the timer and returns the body of the reply, held until the next call
+static const char *post(const char *path, const char *body)
+{
+    static char reply[1024];
+    char request[512];
+    snprintf(request, sizeof(request), "POST %s HTTP/1.1\r\nHost: pico\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s",
+             path, (int)strlen(body), body);
+    if (http_host_exchange(request, reply, sizeof(reply)) <= 0) {
+        return "";
+    }
+    const char *content = strstr(reply, "\r\n\r\n");
+    return content ? content + 4 : "";
+}
+
+// The status once the timer task has taken the shutter events into account, false after STATUS_TIMEOUT_MS
+static bool wait_phase(timer_phase phase, uint32_t frame, timer_status *status)
+{
+    for (int ms = 0; ms < STATUS_TIMEOUT_MS; ms++) {
+        timer_get_status(status);
+        if (status->phase == phase && status->frame == frame) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return false;
+}
+
+static uint64_t alarm_target(void)
+{
+    uint64_t target_us;
+    return host_alarm_armed(0, &target_us) ? target_us : 0;
+}
+
+/* Every command is answered once the outputs and the LED are in their final state; those that do not apply are
+ * refused, and the rest of the schedule follows the commands. */
+static void test_commands(void)
+{
+    timer_status status;
+    uint64_t now_us = time_us_64();
+    const char *reply = post("/api/timer/start", "{\"picture\":3,\"exposure\":10,\"delay\":5}\r\n");
+    CHECK(strstr(reply, "\"result\":\"OK\",\"frames\":3,\"duration\":40") != NULL);
+    timer_get_status(&status);
+    CHECK(status.running);
+    CHECK_EQ(status.phase, TIMER_PHASE_WAITING);
+    CHECK_EQ(status.started_us, now_us + SHUTTER_START_LEAD_US);
+    CHECK_EQ(alarm_target(), status.started_us);
+    uint64_t start_us = status.started_us;
+
+    host_time_run_until(start_us + 3 * SECOND_US);
+    CHECK(wait_phase(TIMER_PHASE_EXPOSING, 1, &status));
+    CHECK_EQ(status.phase_deadline_us, start_us + 10 * SECOND_US);
+    CHECK(gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(cyw43_arch_gpio_get(SHUTTER_LED_PIN));
+
+    // Refused while a sequence runs: a second start, and the settings, whose flash write would stall the shutter
+    CHECK(!strcmp(post("/api/timer/start", "{\"picture\":1,\"exposure\":1,\"delay\":1}\r\n"), "NOT OK"));
+    CHECK(!strcmp(post("/api/timer/settings", "{\"picture\":1,\"exposure\":1,\"delay\":1}\r\n"), "Sequence running"));
+
+    CHECK(!strcmp(post("/api/timer/pause", ""), "OK"));
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(!cyw43_arch_gpio_get(SHUTTER_LED_PIN));
+    timer_get_status(&status);
+    CHECK_EQ(status.phase, TIMER_PHASE_PAUSED);
+    CHECK_EQ(alarm_target(), 0);
+    CHECK(!strcmp(post("/api/timer/pause", ""), "NOT OK"));
+
+    // The exposure cut short is taken again in full
+    host_time_run_until(start_us + 60 * SECOND_US);
+    uint64_t resumed_us = time_us_64() + SHUTTER_START_LEAD_US;
+    CHECK(!strcmp(post("/api/timer/resume", ""), "OK"));
+    timer_get_status(&status);
+    CHECK_EQ(status.phase, TIMER_PHASE_WAITING);
+    CHECK_EQ(status.phase_deadline_us, resumed_us);
+    CHECK_EQ(alarm_target(), resumed_us);
+    CHECK(!strcmp(post("/api/timer/resume", ""), "NOT OK"));
+    host_time_run_until(resumed_us + SECOND_US);
+    CHECK(wait_phase(TIMER_PHASE_EXPOSING, 1, &status));
+
+    // Skipping closes the exposure at once and arms the alarm for the next frame, still on its schedule
+    CHECK(!strcmp(post("/api/timer/skip", ""), "OK"));
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(wait_phase(TIMER_PHASE_WAITING, 1, &status));
+    CHECK(!cyw43_arch_gpio_get(SHUTTER_LED_PIN));
+    CHECK_EQ(status.phase_deadline_us, resumed_us + 15 * SECOND_US);
+    CHECK_EQ(alarm_target(), resumed_us + 15 * SECOND_US);
+
+    CHECK(!strcmp(post("/api/timer/extend", "{\"delay\":3}\r\n"), "OK"));
+    timer_get_status(&status);
+    CHECK_EQ(status.phase_deadline_us, resumed_us + 18 * SECOND_US);
+    CHECK_EQ(alarm_target(), resumed_us + 18 * SECOND_US);
+    host_time_run_until(resumed_us + 18 * SECOND_US);
+    CHECK(wait_phase(TIMER_PHASE_EXPOSING, 2, &status));
+
+    CHECK(!strcmp(post("/api/timer/stop", ""), "OK"));
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+    CHECK(!cyw43_arch_gpio_get(SHUTTER_LED_PIN));
+    timer_get_status(&status);
+    CHECK(!status.running);
+    CHECK(status.stopped);
+    CHECK_EQ(status.phase, TIMER_PHASE_IDLE);
+    CHECK_EQ(alarm_target(), 0);
+    CHECK(!strcmp(post("/api/timer/stop", ""), "NOT OK"));
+    CHECK(!strcmp(post("/api/timer/skip", ""), "NOT OK"));
+}
+
+// A sequence left alone ends with its last exposure, as reported by the engine
+static void test_end(void)
+{
+    timer_status status;
+    CHECK(!strcmp(post("/api/timer/sequence", "{\"step\":\"expose\",\"time\":1,\"count\":2,\"gap\":1}\r\n"), "OK"));
+    timer_get_status(&status);
+    CHECK(status.running);
+    CHECK_EQ(status.frames, 2);
+
+    host_time_run_until(status.started_us + status.duration_us);
+    CHECK(wait_phase(TIMER_PHASE_IDLE, 2, &status));
+    CHECK(!status.running);
+    CHECK(!status.stopped);
+    CHECK_EQ(status.ended_us, time_us_64());
+    CHECK_EQ(status.max_late_us, 0);
+    CHECK(!gpio_get_out_level(SHUTTER_GPIO));
+}
+
+static void *skip_client(void *result)
+{
+    snprintf(result, 16, "%s", post("/api/timer/skip", ""));
+    return NULL;
+}
+
+/* Commands sent at the same time are run one after the other: each skip drops one frame, the one after the last
+ * frame is refused */
+static void test_concurrent_commands(void)
+{
+    timer_status status;
+    CHECK(!strcmp(post("/api/timer/sequence", "{\"step\":\"expose\",\"time\":10,\"count\":3,\"gap\":5}\r\n"), "OK"));
+
+    static char results[SKIP_CLIENTS][16];
+    pthread_t clients[SKIP_CLIENTS];
+    for (int i = 0; i < SKIP_CLIENTS; i++) {
+        pthread_create(&clients[i], NULL, skip_client, results[i]);
+    }
+    int ok = 0, refused = 0;
+    for (int i = 0; i < SKIP_CLIENTS; i++) {
+        pthread_join(clients[i], NULL);
+        ok += !strcmp(results[i], "OK");
+        refused += !strcmp(results[i], "NOT OK");
+    }
+    CHECK_EQ(ok, 3);
+    CHECK_EQ(refused, SKIP_CLIENTS - 3);
+
+    CHECK(wait_phase(TIMER_PHASE_IDLE, 3, &status));
+    CHECK(!status.running);
+    CHECK(!status.stopped);
+    CHECK_EQ(alarm_target(), 0);
+}
+
+// Sends a command over the control channel 's' and returns the text of the reply, held until the next call
+static const char *ws_command(int s, const char *command)
+{
+    static char reply[256];
+    static const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    uint8_t frame[WEBSOCKET_HEADER_MAX_SIZE + 128];
+    int len = strlen(command);
+    int header_size = websocket_encode_header(frame, WEBSOCKET_TEXT, len, mask);
+    memcpy(frame + header_size, command, len);
+    websocket_mask(frame + header_size, len, mask, 0);
+    send(s, frame, header_size + len, 0);
+
+    // Server frames are unmasked, and the replies shorter than 64 KB
+    uint8_t header[4];
+    if (recv(s, header, 2, MSG_WAITALL) != 2 || (header[0] & 0x0F) != WEBSOCKET_TEXT) {
+        return "";
+    }
+    int size = header[1] & 0x7F;
+    if (size == 126) {
+        if (recv(s, header + 2, 2, MSG_WAITALL) != 2) {
+            return "";
+        }
+        size = (header[2] << 8) | header[3];
+    }
+    if (size >= (int)sizeof(reply) || recv(s, reply, size, MSG_WAITALL) != size) {
+        return "";
+    }
+    reply[size] = 0;
+    return reply;
+}
+
+// The control channel answers a start with the estimate the HTTP start replies with
+static void test_websocket_start(void)
+{
+    static const char handshake[] = "GET /api/timer/ws HTTP/1.1\r\nHost: pico\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    int s = http_host_connect();
+    CHECK(s >= 0);
+    send(s, handshake, sizeof(handshake) - 1, 0);
+    char reply[512] = "";
+    int len = 0;
+    while (len < (int)sizeof(reply) - 1 && !strstr(reply, "\r\n\r\n")) {
+        // One byte at a time, so that the frames after the handshake are left in the socket
+        if (recv(s, reply + len, 1, 0) != 1) {
+            break;
+        }
+        reply[++len] = 0;
+    }
+    CHECK(!strncmp(reply, "HTTP/1.1 101", 12));
+
+    timer_status status;
+    const char *started = ws_command(s, "start {\"picture\":3,\"exposure\":10,\"delay\":5}");
+    // The virtual clock stands still, the first frame is the start lead away
+    CHECK(!strcmp(started, "{\"command\":\"start\",\"result\":\"OK\",\"frames\":3,\"duration\":40.00,\"start_in\":0.001}"));
+    timer_get_status(&status);
+    CHECK(status.running);
+
+    CHECK(!strcmp(ws_command(s, "start {\"picture\":1,\"exposure\":1,\"delay\":1}"), "{\"command\":\"start\",\"result\":\"NOT OK\"}"));
+    CHECK(!strcmp(ws_command(s, "stop"), "{\"command\":\"stop\",\"result\":\"OK\"}"));
+    close(s);
+}
+
+int main(void)
+{
+    static const http_route routes[] = {
+        { "/api/timer/extend", { [HTTP_POST] = do_handle_timer_extend }, NULL, true },
+        { "/api/timer/pause", { [HTTP_POST] = do_handle_timer_pause }, NULL, true },
+        { "/api/timer/resume", { [HTTP_POST] = do_handle_timer_resume }, NULL, true },
+        { "/api/timer/sequence", { [HTTP_POST] = do_handle_timer_sequence } },
+        { "/api/timer/settings", { [HTTP_POST] = do_handle_timer_settings_post } },
+        { "/api/timer/skip", { [HTTP_POST] = do_handle_timer_skip }, NULL, true },
+        { "/api/timer/start", { [HTTP_POST] = do_handle_timer_start }, NULL, true },
+        { "/api/timer/stop", { [HTTP_POST] = do_handle_timer_stop }, NULL, true },
+        { "/api/timer/ws", { [HTTP_GET] = do_handle_timer_websocket } },
+    };
+
+    host_time_run_until(SECOND_US);
+    timer_init();
+    if (!http_host_start_routes(routes, sizeof(routes) / sizeof(routes[0]), NULL, NULL)) {
+        return 1;
+    }
+
+    RUN_TEST(test_commands);
+    RUN_TEST(test_end);
+    RUN_TEST(test_concurrent_commands);
+    RUN_TEST(test_websocket_start);
+    return test_failures();
+}
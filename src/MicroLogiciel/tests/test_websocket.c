@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include "test.h"
+#include "websocket.h"
+
+/* Handshake of RFC 6455 section 1.3, and keys whose SHA-1 input fits one block, needs a second one for the padding
+ * only, or spans two */
+static void test_accept_key(void)
+{
+    static const struct
+    {
+        const char *key;
+        const char *accept;
+    } cases[] = {
+        { "dGhlIHNhbXBsZSBub25jZQ==", "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=" },
+        { "", "Kfh9QIsMVZcl6xEPYxPHzW8SZ8w=" },
+        { "0123456789abcdef0123456789ABCDEF", "wUQoNek84crQLP990p/BZXrUIrk=" },
+    };
+
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        char accept[WEBSOCKET_ACCEPT_SIZE];
+        CHECK(websocket_accept_key(cases[i].key, accept));
+        CHECK(!strcmp(accept, cases[i].accept));
+    }
+
+    char accept[WEBSOCKET_ACCEPT_SIZE];
+    CHECK(!websocket_accept_key("0123456789abcdef0123456789ABCDEF!", accept));
+}
+
+static void test_header_lengths(void)
+{
+    uint8_t header[WEBSOCKET_HEADER_MAX_SIZE];
+
+    CHECK_EQ(websocket_encode_header(header, WEBSOCKET_TEXT, 125, NULL), 2);
+    CHECK_EQ(header[0], 0x81);
+    CHECK_EQ(header[1], 125);
+
+    CHECK_EQ(websocket_encode_header(header, WEBSOCKET_BINARY, 126, NULL), 4);
+    CHECK_EQ(header[0], 0x82);
+    CHECK_EQ(header[1], 126);
+    CHECK_EQ((header[2] << 8) | header[3], 126);
+
+    CHECK_EQ(websocket_encode_header(header, WEBSOCKET_TEXT, 0xFFFF, NULL), 4);
+    CHECK_EQ((header[2] << 8) | header[3], 0xFFFF);
+
+    CHECK_EQ(websocket_encode_header(header, WEBSOCKET_TEXT, 0x10000, NULL), 10);
+    CHECK_EQ(header[1], 127);
+    CHECK_EQ(header[7], 0x01);
+    CHECK_EQ(header[8], 0);
+    CHECK_EQ(header[9], 0);
+
+    CHECK_EQ(websocket_encode_header(header, WEBSOCKET_PING, 0, NULL), 2);
+    CHECK_EQ(header[0], 0x89);
+    CHECK_EQ(header[1], 0);
+}
+
+// Single-frame masked text message of RFC 6455 section 5.7
+static void test_masked_frame(void)
+{
+    static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    static const uint8_t expected[] = { 0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58 };
+    uint8_t frame[WEBSOCKET_HEADER_MAX_SIZE + 5];
+
+    int size = websocket_encode_header(frame, WEBSOCKET_TEXT, 5, mask);
+    CHECK_EQ(size, 6);
+    memcpy(frame + size, "Hello", 5);
+    websocket_mask(frame + size, 5, mask, 0);
+    CHECK(!memcmp(frame, expected, sizeof(expected)));
+
+    // Unmasking in pieces, as a payload received in several segments is
+    websocket_mask(frame + size, 3, mask, 0);
+    websocket_mask(frame + size + 3, 2, mask, 3);
+    CHECK(!memcmp(frame + size, "Hello", 5));
+}
+
+int main(void)
+{
+    RUN_TEST(test_accept_key);
+    RUN_TEST(test_header_lengths);
+    RUN_TEST(test_masked_frame);
+    return test_failures();
+}
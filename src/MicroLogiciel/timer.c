@@ -6,12 +6,15 @@
 #include <pico/stdlib.h>
 
 #include <hardware/flash.h>
+#include <hardware/sync.h>
 #include <hardware/watchdog.h>
 
 #include "json_parser.h"
+#include "clock_sync.h"
 #include "debug_printf.h"
-
-static char buffer_timer_data[100];
+#include "edge_log.h"
+#include "sequence.h"
+#include "shutter.h"
 
 const union
 {
@@ -20,20 +23,158 @@ const union
 } __attribute__((aligned(FLASH_SECTOR_SIZE))) s_TimerSettings = {
     .timer_data = {
         .picture_number = 3,
-        .exposure_time = 2000,
-        .delay_time = 1000,
+        .exposure_us = 2000000,
+        .delay_us = 1000000,
     }
 };
 
-SemaphoreHandle_t s_StartTimerSemaphore = NULL;
-SemaphoreHandle_t s_StopTimerSemaphore = NULL;
-SemaphoreHandle_t s_UpdateTimerSemaphore = NULL;
+typedef enum
+{
+    TIMER_COMMAND_START,
+    TIMER_COMMAND_STOP,
+    TIMER_COMMAND_PAUSE,
+    TIMER_COMMAND_RESUME,
+    TIMER_COMMAND_SKIP,
+    TIMER_COMMAND_EXTEND,
+    TIMER_COMMAND_SAVE_SETTINGS,
+    TIMER_COMMAND_WRITE_FLASH,
+} timer_command_type;
+
+typedef struct
+{
+    const char *result;     // NULL for success
+    volatile bool done;
+} timer_reply;
+
+typedef struct
+{
+    timer_command_type type;
+    union
+    {
+        struct
+        {
+            const sequence_step *steps;
+            int count;
+            uint64_t at_us;     // Since boot, 0 for right away
+        } start;
+        uint64_t extend_us;
+        const timer_settings *settings;
+        struct
+        {
+            void (*write)(const void *data);
+            const void *data;
+        } flash;
+    };
+    TaskHandle_t caller;
+    timer_reply *reply;     // On the caller stack, it waits for the reply
+} timer_command;
+
+// The sequence being run. Only compiled by the timer task while no sequence runs, then read by the engine
+static sequence_event s_ProgramEvents[TIMER_SEQUENCE_MAX_EVENTS];
+static sequence_program s_Program;
+
+// Maps the clock of the last client to synchronise onto the time since boot, updated by the HTTP workers
+static clock_sync s_ClockSync;
+static SemaphoreHandle_t s_ClockSyncLock = NULL;
+
+// Buffers of the HTTP handlers too large for the worker stacks, each held under its lock while used. The steps are
+// held while their body is received, the JSON buffers only while formatting.
+static sequence_step s_SequenceSteps[TIMER_SEQUENCE_MAX_STEPS];
+static SemaphoreHandle_t s_SequenceStepsLock = NULL;
+static struct
+{
+    char settings[TIMER_SETTINGS_JSON_SIZE];
+    char status[TIMER_STATUS_JSON_SIZE];
+} s_Json;
+static SemaphoreHandle_t s_JsonLock = NULL;
+
+// Counts the free /api/timer/ws slots
+static SemaphoreHandle_t s_TimerWebSocketSlots = NULL;
+
+static http_event_source s_TimerEvents = NULL;
+
+// Edges reported by the shutter engine to the timer task
+static QueueHandle_t s_ShutterEvents = NULL;
+
+// Everything that changes the sequence goes through the timer task, one command at a time
+static QueueHandle_t s_TimerCommands = NULL;
+static QueueSetHandle_t s_TimerQueues = NULL;
+
+/* Live state of the sequence, written by the timer task only and read from
+ * either core without locking: 'version' is odd while the writer is updating 'status', readers retry until they
+ * copy it between two identical even versions. */
+static struct
+{
+    volatile uint32_t version;
+    timer_status status;
+} s_Status;
+
+static const char *const s_PhaseNames[] = { "idle", "waiting", "exposing", "paused" };
+
+static JsonStatus parse_timer_line(const char *line, timer_settings *dest)
+{
+    debug_printf("\trecieve JSON: %s\n", line);
+    JsonStatus status;
+    
+    // picture (int)
+    status = getInteger(line, "picture", &dest->picture_number);
+    if (status != JSON_OK) {
+        return status;
+    }
+    
+    // exposure (seconds)
+    status = getMicroseconds(line, "exposure", &dest->exposure_us);
+    if (status != JSON_OK) {
+        return status;
+    }
+    
+    // delay (seconds)
+    return getMicroseconds(line, "delay", &dest->delay_us);
+}
 
-static TaskHandle_t s_TimerTaskHandle = NULL;
+/* Optional keys of a start, after those of parse_timer_line:
+ *   "at" (seconds on the clock synchronised through /api/clock/sync),
+ *   "ramp" (none, linear or log), "exposure_end" and "delay_end" (seconds, the start values by default) */
+static JsonStatus parse_start_options(const char *line, const timer_settings *settings, timer_start_options *dest)
+{
+    dest->at_us = 0;
+    JsonStatus status = getMicroseconds(line, "at", &dest->at_us);
+    if (status != JSON_OK && status != JSON_MISSING_KEY) {
+        return status;
+    }
+    
+    char curve[8];
+    status = getString(line, "ramp", curve, sizeof(curve));
+    if (status == JSON_MISSING_KEY || (status == JSON_OK && !strcmp(curve, "none"))) {
+        dest->ramp = false;
+        return JSON_OK;
+    }
+    if (status != JSON_OK) {
+        return status;
+    }
+    
+    if (!strcmp(curve, "linear")) {
+        dest->curve = SEQUENCE_RAMP_LINEAR;
+    } else if (!strcmp(curve, "log")) {
+        dest->curve = SEQUENCE_RAMP_LOG;
+    } else {
+        return JSON_INVALID_STRING;
+    }
+    dest->ramp = true;
+    
+    dest->exposure_end_us = settings->exposure_us;
+    status = getMicroseconds(line, "exposure_end", &dest->exposure_end_us);
+    if (status != JSON_OK && status != JSON_MISSING_KEY) {
+        return status;
+    }
+    dest->delay_end_us = settings->delay_us;
+    status = getMicroseconds(line, "delay_end", &dest->delay_end_us);
+    return status == JSON_MISSING_KEY ? JSON_OK : status;
+}
 
-static JsonStatus parse_timer(http_connection conn, timer_settings *dest)
+// 'options' may be NULL when only the settings are expected
+static JsonStatus parse_timer(http_connection conn, timer_settings *dest, timer_start_options *options)
 {
-    char buffer[128];
     int count = 0;
     
     debug_printf("\tparse_timer:\n");
@@ -42,23 +183,10 @@ static JsonStatus parse_timer(http_connection conn, timer_settings *dest)
         if (!line)
             break;
         count++;
-        debug_printf("\trecieve JSON: %s\n", line);
-        JsonStatus status;
-        
-        // picture (int)
-        status = getInteger(line, "picture", &dest->picture_number);
-        if (status != JSON_OK) {
-            return status;
+        JsonStatus status = parse_timer_line(line, dest);
+        if (status == JSON_OK && options) {
+            status = parse_start_options(line, dest, options);
         }
-        
-        // exposure (float)
-        status = getFloatInt(line, "exposure", &dest->exposure_time);
-        if (status != JSON_OK) {
-            return status;
-        }
-        
-        // delay (float)
-        status = getFloatInt(line, "delay", &dest->delay_time);
         if (status != JSON_OK) {
             return status;
         }
@@ -70,13 +198,108 @@ static JsonStatus parse_timer(http_connection conn, timer_settings *dest)
     return JSON_OK;
 }
 
+/* One step per line:
+ *   {"step":"expose","time":30,"count":10,"gap":2,"lockup":2,"focus":0.5}
+ * "step" is expose, bracket (with an integer "factor"), dark, pause (for "time") or ramp (from "time" and "gap" to
+ * "time_end" and "gap_end", with "curve" linear or log). Times are in seconds and everything but "step" and "time" is
+ * optional. */
+static JsonStatus parse_sequence_step(const char *line, sequence_step *dest)
+{
+    char type[12]; // getString() reads the value quotes included: "bracket" and "linear" take 10 bytes
+    JsonStatus status = getString(line, "step", type, sizeof(type));
+    if (status != JSON_OK) {
+        return status;
+    }
+    
+    if (!strcmp(type, "expose")) {
+        dest->type = SEQUENCE_STEP_EXPOSE;
+    } else if (!strcmp(type, "bracket")) {
+        dest->type = SEQUENCE_STEP_BRACKET;
+    } else if (!strcmp(type, "dark")) {
+        dest->type = SEQUENCE_STEP_DARK;
+    } else if (!strcmp(type, "pause")) {
+        dest->type = SEQUENCE_STEP_PAUSE;
+    } else if (!strcmp(type, "ramp")) {
+        dest->type = SEQUENCE_STEP_RAMP;
+    } else {
+        return JSON_INVALID_STRING;
+    }
+    
+    status = getMicroseconds(line, "time", &dest->exposure_us);
+    if (status != JSON_OK) {
+        return status;
+    }
+    
+    struct
+    {
+        const char *key;
+        uint32_t *value;
+    } integers[] = {
+        { "count", &dest->count },
+        { "factor", &dest->factor },
+    };
+    struct
+    {
+        const char *key;
+        uint64_t *value;
+    } durations[] = {
+        { "gap", &dest->gap_us },
+        { "lockup", &dest->lockup_us },
+        { "focus", &dest->focus_us },
+        { "time_end", &dest->exposure_end_us },
+        { "gap_end", &dest->gap_end_us },
+    };
+    
+    dest->count = 1;
+    dest->factor = 2;
+    dest->gap_us = dest->lockup_us = dest->focus_us = 0;
+    dest->exposure_end_us = dest->gap_end_us = UINT64_MAX; // Default to the start values, once those are known
+    for (int i = 0; i < sizeof(integers) / sizeof(integers[0]); i++) {
+        status = getInteger(line, integers[i].key, integers[i].value);
+        if (status != JSON_OK && status != JSON_MISSING_KEY) {
+            return status;
+        }
+    }
+    if (!dest->factor) {
+        return JSON_INVALID_INTEGER; // Would close every bracketed exposure after the first one at once
+    }
+    for (int i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+        status = getMicroseconds(line, durations[i].key, durations[i].value);
+        if (status != JSON_OK && status != JSON_MISSING_KEY) {
+            return status;
+        }
+    }
+    if (dest->exposure_end_us == UINT64_MAX) {
+        dest->exposure_end_us = dest->exposure_us;
+    }
+    if (dest->gap_end_us == UINT64_MAX) {
+        dest->gap_end_us = dest->gap_us;
+    }
+    
+    dest->curve = SEQUENCE_RAMP_LINEAR;
+    status = getString(line, "curve", type, sizeof(type));
+    if (status == JSON_MISSING_KEY) {
+        return JSON_OK;
+    }
+    if (status != JSON_OK) {
+        return status;
+    }
+    if (!strcmp(type, "log")) {
+        dest->curve = SEQUENCE_RAMP_LOG;
+    } else if (strcmp(type, "linear")) {
+        return JSON_INVALID_STRING;
+    }
+    return JSON_OK;
+}
+
 static char *format_timer_settings(char *buffer, timer_settings *timer_data)
 {
     debug_printf("\tformat_timer_settings:");
-    int n = sprintf(buffer, "{\"picture\":%d,\"exposure\":%.2f,\"delay\":%.2f}",
-                    timer_data->picture_number,
-                    (float)(timer_data->exposure_time)/1000,
-                    (float)(timer_data->delay_time)/1000);
+    char exposure[24], delay[24];
+    formatMicroseconds(exposure, sizeof(exposure), timer_data->exposure_us);
+    formatMicroseconds(delay, sizeof(delay), timer_data->delay_us);
+    int n = sprintf(buffer, "{\"picture\":%d,\"exposure\":%s,\"delay\":%s}",
+                    timer_data->picture_number, exposure, delay);
     if (!n){
         debug_printf("\tUnable to format data :'(\n");
         return "Unable to format data";
@@ -86,6 +309,59 @@ static char *format_timer_settings(char *buffer, timer_settings *timer_data)
     return NULL;
 }
 
+static void write_status(const timer_status *status)
+{
+    // The writer cannot be preempted halfway, so readers never spin for longer than the copy
+    uint32_t save = save_and_disable_interrupts();
+    s_Status.version++;
+    __dmb();
+    s_Status.status = *status;
+    __dmb();
+    s_Status.version++;
+    restore_interrupts(save);
+}
+
+void timer_get_status(timer_status *dest)
+{
+    uint32_t version;
+    do {
+        version = s_Status.version;
+        __dmb();
+        *dest = s_Status.status;
+        __dmb();
+    } while ((version & 1) || version != s_Status.version);
+}
+
+static int format_timer_status(char *buffer, int size, const timer_status *status)
+{
+    uint64_t now_us = time_us_64();
+    uint64_t end_us = status->running ? now_us : status->ended_us;
+    int32_t next_edge_ms = (status->running && status->phase_deadline_us > now_us) ? (int32_t)((status->phase_deadline_us - now_us) / 1000) : 0;
+    return snprintf(buffer, size, "{\"sequence\":%lu,\"running\":%s,\"phase\":\"%s\",\"frame\":%lu,\"total\":%lu,\"dark\":%s,"
+                    "\"stopped\":%s,\"elapsed_ms\":%lu,\"duration_ms\":%lu,\"next_edge_ms\":%ld,\"max_late_us\":%ld}",
+                    (unsigned long)status->sequence_id,
+                    status->running ? "true" : "false",
+                    s_PhaseNames[status->phase],
+                    (unsigned long)status->frame,
+                    (unsigned long)status->frames,
+                    status->dark ? "true" : "false",
+                    status->stopped ? "true" : "false",
+                    (unsigned long)(end_us > status->started_us ? (end_us - status->started_us) / 1000 : 0), // 0 until a scheduled start
+                    (unsigned long)(status->duration_us / 1000),
+                    (long)next_edge_ms,
+                    (long)status->max_late_us);
+}
+
+// Only called by the timer task
+static void publish_status(const char *event)
+{
+    static char json[TIMER_STATUS_JSON_SIZE];
+    timer_status status;
+    timer_get_status(&status);
+    format_timer_status(json, sizeof(json), &status);
+    http_server_publish_event(s_TimerEvents, event, "%s", json);
+}
+
 const timer_settings *get_timer_settings()
 {
     return &s_TimerSettings.timer_data;
@@ -99,128 +375,758 @@ void write_timer_settings(const timer_settings *new_settings)
     portEXIT_CRITICAL();
 }
 
+static void timer_task(void *arg);
+
+void timer_init(void)
+{
+    s_TimerEvents = http_server_create_event_source(TIMER_EVENTS_MAX_SUBSCRIBERS, TIMER_STATUS_JSON_SIZE + 32);
+    s_ClockSyncLock = xSemaphoreCreateMutex();
+    s_SequenceStepsLock = xSemaphoreCreateMutex();
+    s_JsonLock = xSemaphoreCreateMutex();
+    clock_sync_reset(&s_ClockSync);
+    s_TimerWebSocketSlots = xSemaphoreCreateCounting(TIMER_WEBSOCKET_MAX_CLIENTS, TIMER_WEBSOCKET_MAX_CLIENTS);
+    s_ShutterEvents = xQueueCreate(TIMER_SHUTTER_EVENT_QUEUE_SIZE, sizeof(shutter_event));
+    s_TimerCommands = xQueueCreate(TIMER_COMMAND_QUEUE_SIZE, sizeof(timer_command));
+    s_TimerQueues = xQueueCreateSet(TIMER_SHUTTER_EVENT_QUEUE_SIZE + TIMER_COMMAND_QUEUE_SIZE);
+    xQueueAddToSet(s_ShutterEvents, s_TimerQueues);
+    xQueueAddToSet(s_TimerCommands, s_TimerQueues);
+    shutter_init(s_ShutterEvents);
+    xTaskCreate(timer_task, "Timer", TIMER_TASK_STACK_SIZE, NULL, TIMER_TASK_PRIORITY, NULL);
+}
+
+static void finish_sequence(timer_status *status, bool stopped)
+{
+    cyw43_arch_gpio_put(SHUTTER_LED_PIN, 0);
+    status->running = false;
+    status->phase = TIMER_PHASE_IDLE;
+    status->stopped = stopped;
+    status->phase_deadline_us = 0;
+    status->ended_us = time_us_64();
+    write_status(status);
+    publish_status("sequence-done");
+    debug_printf("\tSequence %d done\n", status->sequence_id);
+}
+
+static void handle_shutter_event(const shutter_event *event, timer_status *status)
+{
+    if (!status->running) {
+        return; // Reported before a stop that the timer task already handled
+    }
+    
+    if (event->late_us > status->max_late_us) {
+        status->max_late_us = event->late_us;
+    }
+    
+    if (event->type == SHUTTER_EVENT_DONE) {
+        finish_sequence(status, false);
+        return;
+    }
+    
+    status->frame = event->frame;
+    status->dark = event->dark;
+    status->phase_deadline_us = event->next_us;
+    if (event->type == SHUTTER_EVENT_OPENED) {
+        debug_printf("\t- frame %d/%d opened, %d us late\n", event->frame, status->frames, event->late_us);
+        cyw43_arch_gpio_put(SHUTTER_LED_PIN, 1);
+        status->phase = TIMER_PHASE_EXPOSING;
+        write_status(status);
+        publish_status("frame-started");
+    } else {
+        cyw43_arch_gpio_put(SHUTTER_LED_PIN, 0);
+        status->phase = TIMER_PHASE_WAITING;
+        write_status(status);
+        publish_status(event->type == SHUTTER_EVENT_SKIPPED ? "frame-skipped" : "frame-ended");
+    }
+}
+
+// Compiles and runs a sequence, from 'at_us' if not 0. Returns NULL once started, or why it could not be.
+static const char *start_sequence(const sequence_step *steps, int count, uint64_t at_us, timer_status *status)
+{
+    if (status->running) {
+        debug_printf("A sequence is already running\n");
+        return "NOT OK";
+    }
+    
+    uint64_t now_us = time_us_64();
+    uint64_t start_us = now_us + SHUTTER_START_LEAD_US;
+    if (at_us) {
+        if (at_us < start_us) {
+            return "Start time passed";
+        }
+        if (at_us - now_us > TIMER_START_MAX_AHEAD_US) {
+            return "Start time too far";
+        }
+        start_us = at_us;
+    }
+    
+    sequence_begin(&s_Program, s_ProgramEvents, TIMER_SEQUENCE_MAX_EVENTS);
+    for (int i = 0; i < count; i++) {
+        if (!sequence_add_step(&s_Program, &steps[i])) {
+            return "Invalid sequence";
+        }
+    }
+    if (!s_Program.count) {
+        return "Empty sequence";
+    }
+    
+    char duration[24];
+    formatMicroseconds(duration, sizeof(duration), s_Program.duration_us);
+    debug_printf("sequence: %d frames, %d events, %s s, starting in %llu us\n", s_Program.frames, s_Program.count, duration, start_us - now_us);
+    *status = (timer_status){
+        .running = true,
+        .sequence_id = status->sequence_id + 1,
+        .phase = TIMER_PHASE_WAITING,
+        .frames = s_Program.frames,
+        .started_us = start_us,
+        .duration_us = s_Program.duration_us,
+        .phase_deadline_us = start_us + s_Program.events[0].delay_us,
+    };
+    if (!shutter_start(s_Program.events, s_Program.count, start_us)) {
+        status->running = false;
+        status->phase = TIMER_PHASE_IDLE;
+        return "NOT OK";
+    }
+    write_status(status);
+    return NULL;
+}
+
+// Every command returns once the outputs are in their final state, the reply can only follow
+static const char *run_command(const timer_command *command, timer_status *status)
+{
+    uint64_t next_us;
+    switch (command->type) {
+    case TIMER_COMMAND_START:
+        return start_sequence(command->start.steps, command->start.count, command->start.at_us, status);
+        
+    case TIMER_COMMAND_STOP:
+        if (!status->running) {
+            return "NOT OK";
+        }
+        finish_sequence(status, shutter_stop());
+        return NULL;
+        
+    case TIMER_COMMAND_PAUSE:
+        if (!shutter_pause()) {
+            return "NOT OK";
+        }
+        cyw43_arch_gpio_put(SHUTTER_LED_PIN, 0);
+        status->phase = TIMER_PHASE_PAUSED;
+        status->phase_deadline_us = 0;
+        write_status(status);
+        publish_status("paused");
+        return NULL;
+        
+    case TIMER_COMMAND_RESUME:
+        if (!shutter_resume(&next_us)) {
+            return "NOT OK";
+        }
+        status->phase = TIMER_PHASE_WAITING;
+        status->phase_deadline_us = next_us;
+        write_status(status);
+        publish_status("resumed");
+        return NULL;
+        
+    case TIMER_COMMAND_SKIP:
+        // Reported by the engine as a frame-ended or frame-skipped
+        return shutter_skip() ? NULL : "NOT OK";
+        
+    case TIMER_COMMAND_EXTEND:
+        if (!shutter_extend(command->extend_us)) {
+            return "NOT OK";
+        }
+        if (status->phase == TIMER_PHASE_WAITING) {
+            status->phase_deadline_us += command->extend_us;
+            write_status(status);
+        }
+        return NULL;
+        
+    case TIMER_COMMAND_SAVE_SETTINGS:
+        // Erasing the flash stalls both cores, and so the shutter interrupt
+        if (status->running) {
+            return "Sequence running";
+        }
+        debug_printf("/!\\--- write_timer_settings() ---/!\\... ");
+        write_timer_settings(command->settings);
+        debug_printf("Done\n");
+        return NULL;
+        
+    case TIMER_COMMAND_WRITE_FLASH:
+        if (status->running) {
+            return "Sequence running";
+        }
+        command->flash.write(command->flash.data);
+        return NULL;
+    }
+    return "Unknown command";
+}
+
+// Owns the sequence: runs the commands one by one and supervises the shutter engine, mirroring the shutter on the LED
+// and publishing the progress
 static void timer_task(void *arg)
 {
-    timer_settings *param = arg;
-    uint32_t nbPicture = param->picture_number;
-    uint32_t expTime = param->exposure_time;
-    uint32_t delayTime = param->delay_time;
-    debug_printf("param: {\"picture\":%d,\"exposure\":%.2f,\"delay\":%.2f}\n", nbPicture, (float)(expTime)/1000, (float)(delayTime)/1000);
-    TickType_t xLasteWakeTime = xTaskGetTickCount();
-    int i=1;
-    for (;i<nbPicture;i++) {
-        debug_printf("\t- loop %d/%d - %d\n", i, nbPicture, xTaskGetTickCount());
-        cyw43_arch_gpio_put(SHUTTER_PIN, 1);
-        vTaskDelayUntil(&xLasteWakeTime, pdMS_TO_TICKS(expTime));
-        cyw43_arch_gpio_put(SHUTTER_PIN, 0);
-        vTaskDelayUntil(&xLasteWakeTime, pdMS_TO_TICKS(delayTime));
-    }
-    // Last exposure outside the loop to skip the 'delayTime'
-    debug_printf("\t- loop %d/%d - %d\n", i, nbPicture, xTaskGetTickCount());
-    cyw43_arch_gpio_put(SHUTTER_PIN, 1);
-    vTaskDelayUntil(&xLasteWakeTime, pdMS_TO_TICKS(expTime));
-    cyw43_arch_gpio_put(SHUTTER_PIN, 0);
-    
-    debug_printf("\tEnd of task!\n");
-    s_TimerTaskHandle = NULL;
-    vTaskDelete(NULL);
-}
-
-bool do_handle_timer_api_call(http_connection conn, enum http_request_type type, char *path, void *context)
-{
-    static timer_settings timer_data;
-    timer_data = *get_timer_settings();
-    if (!strcmp(path, "start")) {
-        debug_printf("start\n");
-        if (xSemaphoreTake(s_StartTimerSemaphore, 0) == pdTRUE && s_TimerTaskHandle == NULL){
-            JsonStatus status = parse_timer(conn, &timer_data);
-            debug_printf("\tstatus: %s\n", JSON_status_message(status));
-            if (status != JSON_OK) {
-                char *err = JSON_status_message(status);
-                debug_printf("Error: %s\n", err);
-                xSemaphoreGive(s_StartTimerSemaphore);
-                http_server_send_reply(conn, "200 OK", "text/plain", err, "close", -1);
-                return true;
+    timer_status status = { .phase = TIMER_PHASE_IDLE };
+    for (;;) {
+        QueueSetMemberHandle_t ready = xQueueSelectFromSet(s_TimerQueues, pdMS_TO_TICKS(TIMER_SUPERVISION_PERIOD_MS));
+        if (ready == s_TimerCommands) {
+            timer_command command;
+            if (xQueueReceive(s_TimerCommands, &command, 0) == pdTRUE) {
+                command.reply->result = run_command(&command, &status);
+                command.reply->done = true;
+                xTaskNotifyGive(command.caller);
             }
-            xTaskCreate(timer_task, "Timer", configMINIMAL_STACK_SIZE, &timer_data, TIMER_TASK_PRIORITY, &s_TimerTaskHandle);
-            xSemaphoreGive(s_StartTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "OK", "close", -1);
-            return true;
-        } else {
-            debug_printf("Timer task is already running\n");
-            xSemaphoreGive(s_StartTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "NOT OK", "close", -1);
-            return false;
-        }
-    }
-    else if (!strcmp(path, "stop")) {
-        debug_printf("stop\n");
-        if (xSemaphoreTake(s_StopTimerSemaphore, 0) == pdTRUE && s_TimerTaskHandle != NULL) {
-            vTaskDelete(s_TimerTaskHandle);
-            s_TimerTaskHandle = NULL;
-            xSemaphoreGive(s_StopTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "OK", "close", -1);
-            cyw43_arch_gpio_put(SHUTTER_PIN, 0);
-            return true;
-        } else {
-            debug_printf("No Timer task is running\n");
-            xSemaphoreGive(s_StopTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "NOT OK", "close", -1);
-            return false;
-        }
-    }
-    else if (!strcmp(path, "update")) {
-        debug_printf("update\n");
-        if (xSemaphoreTake(s_UpdateTimerSemaphore, 0) == pdTRUE) {
-            char *err = format_timer_settings(buffer_timer_data, &timer_data);
-            if (err) {
-                debug_printf("\tError: %s\n", err);
-                http_server_send_reply(conn, "200 OK", "text/plain", err, "close", -1);
-                return true;
+        } else if (ready == s_ShutterEvents) {
+            shutter_event event;
+            if (xQueueReceive(s_ShutterEvents, &event, 0) == pdTRUE) {
+                handle_shutter_event(&event, &status);
             }
-            xSemaphoreGive(s_UpdateTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "application/json", buffer_timer_data, "close", -1);
-            return true;
+        } else if (status.running && !shutter_is_running()) {
+            debug_printf("Lost the end of the sequence, the event queue overflowed\n");
+            finish_sequence(&status, false);
+        }
+    }
+}
+
+// Runs a command on the timer task and waits until it has taken effect
+static const char *send_command(timer_command *command)
+{
+    timer_reply reply = { .done = false };
+    command->caller = xTaskGetCurrentTaskHandle();
+    command->reply = &reply;
+    if (xQueueSend(s_TimerCommands, command, pdMS_TO_TICKS(TIMER_COMMAND_QUEUE_TIMEOUT_MS)) != pdTRUE) {
+        return "Busy";
+    }
+    
+    // Another notification may be pending on this task: only the flag tells the reply is there
+    while (!reply.done) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    return reply.result;
+}
+
+const char *timer_write_flash(void (*write)(const void *data), const void *data)
+{
+    timer_command command = { .type = TIMER_COMMAND_WRITE_FLASH, .flash = { .write = write, .data = data } };
+    return send_command(&command);
+}
+
+static const char *start_sequence_command(const sequence_step *steps, int count, uint64_t at_us)
+{
+    timer_command command = { .type = TIMER_COMMAND_START, .start = { .steps = steps, .count = count, .at_us = at_us } };
+    return send_command(&command);
+}
+
+// Converts a start time given on the synchronised clock to the time since boot
+static const char *synchronised_start_time(uint64_t at_us, uint64_t *local_us)
+{
+    const char *err = NULL;
+    xSemaphoreTake(s_ClockSyncLock, portMAX_DELAY);
+    if (clock_sync_valid(&s_ClockSync)) {
+        *local_us = clock_sync_to_local(&s_ClockSync, at_us);
+        debug_printf("start at %llu us, +/- %lu us\n", *local_us, (unsigned long)clock_sync_uncertainty_us(&s_ClockSync));
+    } else {
+        err = "Clock not synchronised";
+    }
+    xSemaphoreGive(s_ClockSyncLock);
+    return err;
+}
+
+// Shared by the HTTP and WebSocket endpoints, 'options' may be NULL. Returns NULL once started, or why it could not be.
+static const char *start_timer(const timer_settings *settings, const timer_start_options *options)
+{
+    sequence_step step = {
+        .type = SEQUENCE_STEP_EXPOSE,
+        .count = settings->picture_number,
+        .exposure_us = settings->exposure_us,
+        .gap_us = settings->delay_us,
+    };
+    if (options && options->ramp) {
+        // Every frame is computed once by the sequence compiler, the engine only walks the resulting events
+        step.type = SEQUENCE_STEP_RAMP;
+        step.curve = options->curve;
+        step.exposure_end_us = options->exposure_end_us;
+        step.gap_end_us = options->delay_end_us;
+    }
+    
+    uint64_t at_us = 0;
+    if (options && options->at_us) {
+        const char *err = synchronised_start_time(options->at_us, &at_us);
+        if (err) {
+            return err;
+        }
+    }
+    return start_sequence_command(&step, 1, at_us);
+}
+
+/* The JSON members describing the sequence just started, as both start endpoints reply them: frame count, duration
+ * and time left before the first frame, and the uncertainty of a scheduled start. */
+static void format_started(char *buf, int size, const timer_start_options *options)
+{
+    // The status was written by the timer task before it answered, it holds the sequence just started
+    timer_status started;
+    char duration[24], start_in[24];
+    uint32_t uncertainty_us = 0;
+    uint64_t now_us = time_us_64();
+    timer_get_status(&started);
+    formatMicroseconds(duration, sizeof(duration), started.duration_us);
+    formatMicroseconds(start_in, sizeof(start_in), started.started_us > now_us ? started.started_us - now_us : 0);
+    int n = snprintf(buf, size, "\"frames\":%lu,\"duration\":%s,\"start_in\":%s", (unsigned long)started.frames, duration, start_in);
+    if (options->at_us) {
+        xSemaphoreTake(s_ClockSyncLock, portMAX_DELAY);
+        uncertainty_us = clock_sync_uncertainty_us(&s_ClockSync);
+        xSemaphoreGive(s_ClockSyncLock);
+        snprintf(buf + n, size - n, ",\"uncertainty_us\":%lu", (unsigned long)uncertainty_us);
+    }
+}
+
+// Returns "OK" or why the command failed
+static const char *timer_control(timer_command_type type, uint64_t extend_us)
+{
+    timer_command command = { .type = type, .extend_us = extend_us };
+    const char *err = send_command(&command);
+    return err ? err : "OK";
+}
+
+/* Control channel on /api/timer/ws, one command per message:
+ *   "start {json settings}", "stop", "pause", "resume", "skip", "extend {"delay":seconds}" or "settings"
+ * Each command is answered with {"command":...,"result":...}, and a successful start also with the members the HTTP
+ * start replies with. */
+static void timer_websocket_handler(http_websocket ws, char *message, int len, void *context)
+{
+    char reply[64 + TIMER_STARTED_JSON_SIZE];
+    const char *command = message;
+    const char *result;
+    
+    char *args = strchr(message, ' ');
+    if (args) {
+        *args++ = 0;
+    }
+    
+    if (!strcmp(command, "start")) {
+        timer_settings settings = *get_timer_settings();
+        timer_start_options options;
+        JsonStatus status = args ? parse_timer_line(args, &settings) : JSON_KO;
+        if (status == JSON_OK) {
+            status = parse_start_options(args, &settings, &options);
+        }
+        if (status != JSON_OK) {
+            result = JSON_status_message(status);
         } else {
-            debug_printf("Timer is updating webapp infos...\n");
-            xSemaphoreGive(s_UpdateTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "NOT OK", "close", -1);
-            return false;
-        }
-    } else if (!strcmp(path, "settings")) {
-        debug_printf("settings ");
-        if (xSemaphoreTake(s_UpdateTimerSemaphore, 0) == pdTRUE) {
-            if (type == HTTP_POST) {
-                debug_printf("[POST]\n");
-                JsonStatus status = parse_timer(conn, &timer_data);
-                debug_printf("\tstatus: %s\n", JSON_status_message(status));
-                if (status != JSON_OK) {
-                    char *err = JSON_status_message(status);
-                    debug_printf("Error: %s\n", err);
-                    http_server_send_reply(conn, "200 OK", "text/plain", err, "close", -1);
-                    return true;
-                } else {
-                    debug_printf("/!\\--- write_timer_settings() ---/!\\... ");
-                    write_timer_settings(&timer_data);
-                    debug_printf("Done\n");
-                    xSemaphoreGive(s_UpdateTimerSemaphore);
-                    http_server_send_reply(conn, "200 OK", "text/plain", "OK", "close", -1);
-                    watchdog_reboot(0, SRAM_END, 500);
-                }
-                return false;
+            const char *err = start_timer(&settings, &options);
+            if (!err) {
+                char started[TIMER_STARTED_JSON_SIZE];
+                format_started(started, sizeof(started), &options);
+                int n = snprintf(reply, sizeof(reply), "{\"command\":\"start\",\"result\":\"OK\",%s}", started);
+                http_server_send_websocket_text(ws, reply, n);
+                return;
+            }
+            result = err;
+        }
+        command = "start";
+    } else if (!strcmp(command, "stop")) {
+        result = timer_control(TIMER_COMMAND_STOP, 0);
+        command = "stop";
+    } else if (!strcmp(command, "pause")) {
+        result = timer_control(TIMER_COMMAND_PAUSE, 0);
+        command = "pause";
+    } else if (!strcmp(command, "resume")) {
+        result = timer_control(TIMER_COMMAND_RESUME, 0);
+        command = "resume";
+    } else if (!strcmp(command, "skip")) {
+        result = timer_control(TIMER_COMMAND_SKIP, 0);
+        command = "skip";
+    } else if (!strcmp(command, "extend")) {
+        uint64_t delay_us;
+        JsonStatus status = args ? getMicroseconds(args, "delay", &delay_us) : JSON_KO;
+        result = (status == JSON_OK) ? timer_control(TIMER_COMMAND_EXTEND, delay_us) : JSON_status_message(status);
+        command = "extend";
+    } else if (!strcmp(command, "settings")) {
+        timer_settings settings = *get_timer_settings();
+        xSemaphoreTake(s_JsonLock, portMAX_DELAY);
+        char *err = format_timer_settings(s_Json.settings, &settings);
+        int n = snprintf(reply, sizeof(reply), err ? "{\"command\":\"settings\",\"result\":\"%s\"}" : "{\"command\":\"settings\",\"result\":%s}", err ? err : s_Json.settings);
+        xSemaphoreGive(s_JsonLock);
+        http_server_send_websocket_text(ws, reply, n);
+        return;
+    } else {
+        result = "Unknown command";
+        command = "";
+    }
+    
+    int n = snprintf(reply, sizeof(reply), "{\"command\":\"%s\",\"result\":\"%s\"}", command, result);
+    http_server_send_websocket_text(ws, reply, n);
+}
+
+bool do_handle_timer_start(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    timer_settings timer_data = *get_timer_settings();
+    timer_start_options options = { .ramp = false };
+    debug_printf("start\n");
+    JsonStatus status = parse_timer(conn, &timer_data, &options);
+    debug_printf("\tstatus: %s\n", JSON_status_message(status));
+    if (status != JSON_OK) {
+        char *err = JSON_status_message(status);
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
+    }
+    const char *err = start_timer(&timer_data, &options);
+    if (err) {
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
+    }
+    
+    char started[TIMER_STARTED_JSON_SIZE];
+    format_started(started, sizeof(started), &options);
+    
+    // Streamed through the connection buffer, which flushes instead of truncating
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", "application/json");
+    http_server_write_reply(reply, "{\"result\":\"OK\",%s", started);
+    http_server_end_write_reply(reply, "}");
+    return true;
+}
+
+// A duration or a time in seconds from a "key=value" of the query string
+static JsonStatus get_query_microseconds(http_connection conn, const char *key, uint64_t *dest)
+{
+    size_t key_len = strlen(key);
+    for (const char *param = http_server_get_query(conn); param; param = strchr(param, '&') ? strchr(param, '&') + 1 : NULL) {
+        if (strncmp(param, key, key_len) || param[key_len] != '=') {
+            continue;
+        }
+        char value[24];
+        size_t len = strcspn(param + key_len + 1, "&");
+        if (len >= sizeof(value)) {
+            return JSON_INVALID_FLOAT;
+        }
+        memcpy(value, param + key_len + 1, len);
+        value[len] = 0;
+        return parseMicroseconds(value, dest);
+    }
+    return JSON_MISSING_KEY;
+}
+
+/* Steps as described at parse_sequence_step(), with an optional start time on the synchronised clock: /api/timer/sequence?at=seconds */
+bool do_handle_timer_sequence(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    sequence_step *steps = s_SequenceSteps;
+    int count = 0;
+    const char *err = NULL;
+    uint64_t at_us = 0;
+    debug_printf("sequence\n");
+    
+    // Concurrent uploads would be refused anyway, as the first one starts the sequence
+    bool locked = xSemaphoreTake(s_SequenceStepsLock, pdMS_TO_TICKS(TIMER_COMMAND_QUEUE_TIMEOUT_MS)) == pdTRUE;
+    JsonStatus at_status = get_query_microseconds(conn, "at", &at_us);
+    if (!locked) {
+        err = "Busy";
+    } else if (at_status == JSON_OK) {
+        err = synchronised_start_time(at_us, &at_us);
+    } else if (at_status != JSON_MISSING_KEY) {
+        err = JSON_status_message(at_status);
+    }
+    
+    for (;;) {
+        char *line = http_server_read_post_line(conn);
+        if (!line)
+            break;
+        if (err)
+            continue; // The rest of the body is drained by the reply
+        if (count == TIMER_SEQUENCE_MAX_STEPS) {
+            err = "Too many steps";
+            continue;
+        }
+        JsonStatus status = parse_sequence_step(line, &steps[count++]);
+        if (status != JSON_OK) {
+            err = JSON_status_message(status);
+        }
+    }
+    
+    if (!err) {
+        err = start_sequence_command(steps, count, at_us);
+    }
+    if (locked) {
+        xSemaphoreGive(s_SequenceStepsLock);
+    }
+    if (err) {
+        debug_printf("Error: %s\n", err);
+    }
+    http_server_send_reply(conn, "200 OK", "text/plain", err ? err : "OK", -1);
+    return true;
+}
+
+/* The control endpoints answer once the shutter line has reached its final state */
+bool do_handle_timer_stop(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("stop\n");
+    http_server_send_reply(conn, "200 OK", "text/plain", timer_control(TIMER_COMMAND_STOP, 0), -1);
+    return true;
+}
+
+bool do_handle_timer_pause(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("pause\n");
+    http_server_send_reply(conn, "200 OK", "text/plain", timer_control(TIMER_COMMAND_PAUSE, 0), -1);
+    return true;
+}
+
+bool do_handle_timer_resume(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("resume\n");
+    http_server_send_reply(conn, "200 OK", "text/plain", timer_control(TIMER_COMMAND_RESUME, 0), -1);
+    return true;
+}
+
+bool do_handle_timer_skip(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("skip\n");
+    http_server_send_reply(conn, "200 OK", "text/plain", timer_control(TIMER_COMMAND_SKIP, 0), -1);
+    return true;
+}
+
+// Body: {"delay":seconds}
+bool do_handle_timer_extend(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    uint64_t delay_us = 0;
+    JsonStatus status = JSON_KO;
+    debug_printf("extend\n");
+    for (;;) {
+        char *line = http_server_read_post_line(conn);
+        if (!line)
+            break;
+        status = getMicroseconds(line, "delay", &delay_us);
+    }
+    http_server_send_reply(conn, "200 OK", "text/plain", status == JSON_OK ? timer_control(TIMER_COMMAND_EXTEND, delay_us) : JSON_status_message(status), -1);
+    return true;
+}
+
+/* Settings along with the live status. Reads neither take nor wait for anything: the settings are in flash, the
+ * status comes from the snapshot written by the timer task. */
+bool do_handle_timer_update(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    timer_settings timer_data = *get_timer_settings();
+    timer_status status;
+    debug_printf("update\n");
+    
+    xSemaphoreTake(s_JsonLock, portMAX_DELAY);
+    char *err = format_timer_settings(s_Json.settings, &timer_data);
+    if (err) {
+        xSemaphoreGive(s_JsonLock);
+        debug_printf("\tError: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
+    }
+    
+    timer_get_status(&status);
+    format_timer_status(s_Json.status, sizeof(s_Json.status), &status);
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", "application/json");
+    // The settings object is extended with the status. The reply fits the connection buffer, nothing is sent before
+    // the lock is released.
+    http_server_write_reply(reply, "%.*s,\"status\":%s}", (int)strlen(s_Json.settings) - 1, s_Json.settings, s_Json.status);
+    xSemaphoreGive(s_JsonLock);
+    http_server_end_write_reply(reply, NULL);
+    return true;
+}
+
+bool do_handle_timer_events(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("events\n");
+    http_server_subscribe_events(conn, s_TimerEvents);
+    return true;
+}
+
+/* Timing error of the shutter transitions in the current or last session, as JSON or, with ?format=csv, as one line
+ * per transition kept in the ring */
+bool do_handle_timer_stats(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    edge_log_summary summary;
+    edge_record records[TIMER_STATS_RECORDS_PER_READ];
+    const char *query = http_server_get_query(conn);
+    bool csv = query && strstr(query, "format=csv");
+    debug_printf("stats\n");
+    
+    edge_log_get_summary(&summary);
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", csv ? "text/csv" : "application/json");
+    if (csv) {
+        http_server_write_reply(reply, "index,frame,open,scheduled_us,late_us\r\n");
+    } else {
+        http_server_write_reply(reply, "{\"session\":%lu,\"edges\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu,\"histogram\":[",
+                                (unsigned long)summary.session, (unsigned long)summary.edges,
+                                (unsigned long)summary.p50_us, (unsigned long)summary.p99_us, (unsigned long)summary.max_us);
+        for (int i = 0; i < EDGE_LOG_BUCKETS; i++) {
+            http_server_write_reply(reply, i ? ",%lu" : "%lu", (unsigned long)summary.histogram[i]);
+        }
+        http_server_write_reply(reply, "],\"recent\":[");
+    }
+    
+    uint32_t from = 0, first;
+    int count;
+    bool separator = false;
+    while ((count = edge_log_read(from, records, TIMER_STATS_RECORDS_PER_READ, &first)) > 0) {
+        for (int i = 0; i < count; i++) {
+            const edge_record *r = &records[i];
+            if (csv) {
+                http_server_write_reply(reply, "%lu,%u,%d,%llu,%ld\r\n", (unsigned long)(first + i), r->frame, r->open,
+                                        (unsigned long long)r->scheduled_us, (long)r->late_us);
             } else {
-                debug_printf("[GET]\n");
-                format_timer_settings(buffer_timer_data, &timer_data);
-                xSemaphoreGive(s_UpdateTimerSemaphore);
-                http_server_send_reply(conn, "200 OK", "text/json", buffer_timer_data, "close", -1);
-                return true;
+                http_server_write_reply(reply, "%s{\"index\":%lu,\"frame\":%u,\"open\":%s,\"scheduled_us\":%llu,\"late_us\":%ld}",
+                                        separator ? "," : "", (unsigned long)(first + i), r->frame, r->open ? "true" : "false",
+                                        (unsigned long long)r->scheduled_us, (long)r->late_us);
             }
+            separator = true;
+        }
+        from = first + count;
+    }
+    
+    http_server_end_write_reply(reply, csv ? NULL : "]}");
+    return true;
+}
+
+bool do_handle_timer_websocket(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    debug_printf("ws\n");
+    if (xSemaphoreTake(s_TimerWebSocketSlots, 0) != pdTRUE) {
+        http_server_send_reply(conn, "503 Service Unavailable", "text/plain", "Too many control connections", -1);
+        return true;
+    }
+    http_server_accept_websocket(conn, timer_websocket_handler, NULL);
+    xSemaphoreGive(s_TimerWebSocketSlots);
+    return true;
+}
+
+bool do_handle_timer_settings_get(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    timer_settings timer_data = *get_timer_settings();
+    debug_printf("settings [GET]\n");
+    xSemaphoreTake(s_JsonLock, portMAX_DELAY);
+    char *err = format_timer_settings(s_Json.settings, &timer_data);
+    http_write_handle reply = http_server_begin_write_reply(conn, "200 OK", err ? "text/plain" : "text/json");
+    http_server_write_reply(reply, "%s", err ? err : s_Json.settings);
+    xSemaphoreGive(s_JsonLock);
+    http_server_end_write_reply(reply, NULL);
+    return true;
+}
+
+// The settings are written by the timer task, which serialises the writers and refuses while a sequence runs
+bool do_handle_timer_settings_post(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    timer_settings timer_data = *get_timer_settings();
+    debug_printf("settings [POST]\n");
+    
+    JsonStatus status = parse_timer(conn, &timer_data, NULL);
+    debug_printf("\tstatus: %s\n", JSON_status_message(status));
+    if (status != JSON_OK) {
+        char *err = JSON_status_message(status);
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
+    }
+    
+    timer_command command = { .type = TIMER_COMMAND_SAVE_SETTINGS, .settings = &timer_data };
+    const char *err = send_command(&command);
+    if (err) {
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
+    }
+    
+    xSemaphoreTake(s_JsonLock, portMAX_DELAY);
+    if (!format_timer_settings(s_Json.settings, &timer_data)) {
+        http_server_publish_event(s_TimerEvents, "settings-changed", "%s", s_Json.settings);
+    }
+    xSemaphoreGive(s_JsonLock);
+    http_server_send_reply(conn, "200 OK", "text/plain", "OK", -1);
+    watchdog_reboot(0, SRAM_END, 500);
+    return true;
+}
+
+// Current estimate, taken under s_ClockSyncLock
+static int format_clock_sync(char *buffer, int size)
+{
+    if (!clock_sync_valid(&s_ClockSync)) {
+        return snprintf(buffer, size, "{\"synchronised\":false}");
+    }
+    
+    uint64_t now_us = time_us_64();
+    char remote_now[24];
+    formatMicroseconds(remote_now, sizeof(remote_now), now_us - clock_sync_offset_at(&s_ClockSync, now_us));
+    return snprintf(buffer, size, "{\"synchronised\":true,\"samples\":%d,\"now\":%s,\"drift_ppb\":%ld,\"round_trip_us\":%lu,"
+                    "\"residual_us\":%lu,\"uncertainty_us\":%lu}",
+                    s_ClockSync.count,
+                    remote_now,
+                    (long)s_ClockSync.drift_ppb,
+                    (unsigned long)s_ClockSync.round_trip_us,
+                    (unsigned long)s_ClockSync.residual_us,
+                    (unsigned long)clock_sync_uncertainty_us(&s_ClockSync));
+}
+
+/* NTP-like exchange, in seconds with up to 6 decimals:
+ *   GET /api/clock/sync?t0=<client time> answers {"t0":...,"t1":<received>,"t2":<replied>} on the time since boot,
+ *   the client then posts {"t0":...,"t1":...,"t2":...,"t3":<reply received>} to add the sample to the estimate.
+ * Without 't0', GET reports the estimate as the POST does. */
+bool do_handle_clock_sync_get(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    uint64_t t1 = time_us_64();
+    uint64_t t0;
+    char reply[192];
+    
+    JsonStatus status = get_query_microseconds(conn, "t0", &t0);
+    if (status == JSON_MISSING_KEY) {
+        xSemaphoreTake(s_ClockSyncLock, portMAX_DELAY);
+        format_clock_sync(reply, sizeof(reply));
+        xSemaphoreGive(s_ClockSyncLock);
+        http_server_send_reply(conn, "200 OK", "application/json", reply, -1);
+        return true;
+    }
+    if (status != JSON_OK) {
+        http_server_send_reply(conn, "200 OK", "text/plain", JSON_status_message(status), -1);
+        return true;
+    }
+    
+    char t0_text[24], t1_text[24], t2_text[24];
+    formatMicroseconds(t0_text, sizeof(t0_text), t0);
+    formatMicroseconds(t1_text, sizeof(t1_text), t1);
+    formatMicroseconds(t2_text, sizeof(t2_text), time_us_64());
+    snprintf(reply, sizeof(reply), "{\"t0\":%s,\"t1\":%s,\"t2\":%s}", t0_text, t1_text, t2_text);
+    http_server_send_reply(conn, "200 OK", "application/json", reply, -1);
+    return true;
+}
+
+bool do_handle_clock_sync_post(http_connection conn, enum http_request_type type, char *path, void *context)
+{
+    static const char *const keys[] = { "t0", "t1", "t2", "t3" };
+    uint64_t t[4];
+    const char *err = "No data received";
+    char reply[192];
+    debug_printf("clock sync\n");
+    
+    for (;;) {
+        char *line = http_server_read_post_line(conn);
+        if (!line)
+            break;
+        err = NULL;
+        for (int i = 0; i < 4 && !err; i++) {
+            JsonStatus status = getMicroseconds(line, keys[i], &t[i]);
+            if (status != JSON_OK) {
+                err = JSON_status_message(status);
+            }
+        }
+    }
+    
+    if (!err) {
+        xSemaphoreTake(s_ClockSyncLock, portMAX_DELAY);
+        if (clock_sync_add(&s_ClockSync, t[0], t[1], t[2], t[3])) {
+            format_clock_sync(reply, sizeof(reply));
         } else {
-            debug_printf("Timer is updating settings...\n");
-            xSemaphoreGive(s_UpdateTimerSemaphore);
-            http_server_send_reply(conn, "200 OK", "text/plain", "NOT OK", "close", -1);
-            return false;
+            err = "Inconsistent timestamps";
         }
+        xSemaphoreGive(s_ClockSyncLock);
+    }
+    
+    if (err) {
+        debug_printf("Error: %s\n", err);
+        http_server_send_reply(conn, "200 OK", "text/plain", err, -1);
+        return true;
     }
-    return false;
+    http_server_send_reply(conn, "200 OK", "application/json", reply, -1);
+    return true;
 }
@@ -2,32 +2,109 @@
 #define TIMER_H
 
 #include <FreeRTOS.h>
+#include <queue.h>
 #include <semphr.h>
 #include <task.h>
 
 #include "json_parser.h"
 #include "httpserver.h"
+#include "sequence.h"
 
-#define SHUTTER_PIN CYW43_WL_GPIO_LED_PIN // FIXME: replace by physical PIN
+#define SHUTTER_LED_PIN CYW43_WL_GPIO_LED_PIN // Mirrors the shutter state (SHUTTER_GPIO, see shutter.h) for the user
+#define TIMER_SHUTTER_EVENT_QUEUE_SIZE 16
+#define TIMER_COMMAND_QUEUE_SIZE 4
+#define TIMER_COMMAND_QUEUE_TIMEOUT_MS 100 // A command that cannot be queued by then is answered "Busy"
+#define TIMER_SUPERVISION_PERIOD_MS 500 // The timer task checks the engine at least this often
 #define TIMER_TASK_PRIORITY (tskIDLE_PRIORITY + 2UL)
+#define TIMER_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE * 2) // In words: the task compiles the sequences and formats the progress events
+#define TIMER_EVENTS_MAX_SUBSCRIBERS 2 // Pages receiving live progress on /api/timer/events
+#define TIMER_SEQUENCE_MAX_EVENTS 512 // Compiled sequence, 8 bytes per event: a plain exposure takes 2, up to 5 with focus and mirror lock-up
+#define TIMER_SEQUENCE_MAX_STEPS 8 // Lines accepted by /api/timer/sequence, parsed into static storage one request at a time
+#define TIMER_STATS_RECORDS_PER_READ 8 // Transitions copied at a time by /api/timer/stats, on the HTTP worker stack
+#define TIMER_STATUS_JSON_SIZE 256 // Status as formatted for /api/timer/update and the progress events
+#define TIMER_SETTINGS_JSON_SIZE 100
+#define TIMER_STARTED_JSON_SIZE 128 // Frames, duration, time to the first frame and uncertainty, as the start replies carry them
+#define TIMER_WEBSOCKET_MAX_CLIENTS 1 // Each control connection holds an HTTP worker for as long as it stays open
+#define TIMER_START_MAX_AHEAD_US (7ULL * 24 * 3600 * 1000000) // Scheduled starts further away are refused as a likely clock mistake
 
 typedef struct
 {
     uint32_t picture_number;
-    uint32_t exposure_time;
-    uint32_t delay_time;
+    uint64_t exposure_us;
+    uint64_t delay_us;
 } timer_settings;
 
-static JsonStatus parse_timer(http_connection conn, timer_settings *dest);
+/* Optional parts of a start */
+typedef struct
+{
+    bool ramp;                  // Exposure and delay go from the settings to their '_end' value over the pictures
+    sequence_ramp_curve curve;
+    uint64_t exposure_end_us;
+    uint64_t delay_end_us;
+    uint64_t at_us;             // Start time on the clock synchronised through /api/clock/sync, 0 for right away
+} timer_start_options;
+
+typedef enum
+{
+    TIMER_PHASE_IDLE,
+    TIMER_PHASE_WAITING,    // Between exposures, or before the first one
+    TIMER_PHASE_EXPOSING,
+    TIMER_PHASE_PAUSED,
+} timer_phase;
+
+typedef struct
+{
+    bool running;
+    bool dark;                  // The current or last exposure is a dark frame
+    bool stopped;               // The last sequence was cut short
+    timer_phase phase;
+    uint32_t sequence_id;       // Incremented by every start
+    uint32_t frame;             // Current or last exposure, 1-based
+    uint32_t frames;
+    int32_t max_late_us;        // Worst edge lateness reported by the shutter engine so far
+    uint64_t started_us;        // Since boot
+    uint64_t duration_us;       // Scheduled length of the sequence, from its start to the end of its last exposure
+    uint64_t ended_us;
+    uint64_t phase_deadline_us; // Scheduled time of the next output change, 0 when idle
+} timer_status;
+
+static JsonStatus parse_timer_line(const char *line, timer_settings *dest);
+
+static JsonStatus parse_timer(http_connection conn, timer_settings *dest, timer_start_options *options);
 
 static char *format_timer_settings(char *buffer, timer_settings *timerData);
 
+void timer_init(void);
+
+/* Consistent copy of the live status, without locking: can be called from any task on either core. */
+void timer_get_status(timer_status *dest);
+
 const timer_settings *get_timer_settings();
 
 void write_timer_settings(const timer_settings *new_settings);
 
-static void timer_task(void *arg);
+/* Runs 'write' with 'data' on the timer task, which refuses it while a sequence runs: erasing the flash stalls both
+ * cores, and so the shutter interrupt. Returns NULL once written, or why it was not. */
+const char *timer_write_flash(void (*write)(const void *data), const void *data);
+
+
+/* /api/timer/... endpoints, see the route table in main.c */
+bool do_handle_timer_start(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_sequence(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_stop(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_pause(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_resume(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_skip(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_extend(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_update(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_events(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_stats(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_websocket(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_settings_get(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_timer_settings_post(http_connection conn, enum http_request_type type, char *path, void *context);
 
-bool do_handle_timer_api_call(http_connection conn, enum http_request_type type, char *path, void *context);
+/* /api/clock/sync, maps the clock of a client onto the time since boot for scheduled starts */
+bool do_handle_clock_sync_get(http_connection conn, enum http_request_type type, char *path, void *context);
+bool do_handle_clock_sync_post(http_connection conn, enum http_request_type type, char *path, void *context);
 
 #endif
@@ -0,0 +1,150 @@
+#include "websocket.h"
+
+#include <string.h>
+
+#define SHA1_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+// The message schedule is kept as a ring of its last 16 words, so that the handshake stays light on the worker stack
+static void sha1_block(uint32_t *state, const uint8_t *block)
+{
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        if (i >= 16) {
+            w[i & 15] = SHA1_ROL(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15], 1);
+        }
+        uint32_t tmp = SHA1_ROL(a, 5) + f + e + k + w[i & 15];
+        e = d;
+        d = c;
+        c = SHA1_ROL(b, 30);
+        b = a;
+        a = tmp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// SHA-1 is only used for the handshake, where it is mandated
+static void sha1(const void *data, int len, uint8_t *digest)
+{
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const uint8_t *p = data;
+    int remaining = len;
+    for (; remaining >= 64; remaining -= 64, p += 64) {
+        sha1_block(state, p);
+    }
+
+    // The padding takes one more block, or two when the length does not fit after the end of the data
+    uint8_t tail[64] = { 0 };
+    memcpy(tail, p, remaining);
+    tail[remaining] = 0x80;
+    if (remaining >= 56) {
+        sha1_block(state, tail);
+        memset(tail, 0, sizeof(tail));
+    }
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[63 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha1_block(state, tail);
+
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (uint8_t)(state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static void base64_encode(const uint8_t *data, int len, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < len; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) {
+            v |= data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= data[i + 2];
+        }
+
+        *out++ = alphabet[(v >> 18) & 0x3F];
+        *out++ = alphabet[(v >> 12) & 0x3F];
+        *out++ = (i + 1 < len) ? alphabet[(v >> 6) & 0x3F] : '=';
+        *out++ = (i + 2 < len) ? alphabet[v & 0x3F] : '=';
+    }
+    *out = 0;
+}
+
+bool websocket_accept_key(const char *client_key, char *accept)
+{
+    static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    int client_len = strlen(client_key);
+    if (client_len > WEBSOCKET_KEY_MAX_LEN) {
+        return false;
+    }
+
+    char key[WEBSOCKET_KEY_MAX_LEN + sizeof(guid)];
+    memcpy(key, client_key, client_len);
+    memcpy(key + client_len, guid, sizeof(guid) - 1);
+    uint8_t digest[20];
+    sha1(key, client_len + sizeof(guid) - 1, digest);
+    base64_encode(digest, sizeof(digest), accept);
+    return true;
+}
+
+int websocket_encode_header(uint8_t *header, websocket_opcode opcode, uint64_t len, const uint8_t *mask)
+{
+    int size = 2;
+    header[0] = 0x80 | opcode;
+    if (len < 126) {
+        header[1] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (uint8_t)(len >> 8);
+        header[3] = (uint8_t)len;
+        size = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (uint8_t)(len >> (56 - i * 8));
+        }
+        size = 10;
+    }
+
+    if (mask) {
+        header[1] |= 0x80;
+        memcpy(header + size, mask, 4);
+        size += 4;
+    }
+    return size;
+}
+
+void websocket_mask(void *data, uint64_t len, const uint8_t *mask, uint64_t offset)
+{
+    uint8_t *p = data;
+    for (uint64_t i = 0; i < len; i++) {
+        p[i] ^= mask[(offset + i) & 3];
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WEBSOCKET_KEY_MAX_LEN 32      // Longest Sec-WebSocket-Key accepted, clients send 24 characters
+#define WEBSOCKET_ACCEPT_SIZE 29      // Sec-WebSocket-Accept value and its terminator
+#define WEBSOCKET_HEADER_MAX_SIZE 14  // Frame header with a 64-bit length and a mask
+
+typedef enum
+{
+    WEBSOCKET_CONTINUATION = 0x0,
+    WEBSOCKET_TEXT = 0x1,
+    WEBSOCKET_BINARY = 0x2,
+    WEBSOCKET_CLOSE = 0x8,
+    WEBSOCKET_PING = 0x9,
+    WEBSOCKET_PONG = 0xA,
+} websocket_opcode;
+
+/* RFC 6455 framing helpers, shared by the server and the host tools. They do no I/O. */
+
+/* Computes the Sec-WebSocket-Accept value answering 'client_key'. Returns false if the key is too long. */
+bool websocket_accept_key(const char *client_key, char *accept);
+
+/* Writes the header of a final frame carrying 'len' bytes and returns its size. Server frames are sent unmasked,
+ * 'mask' is NULL for them; client frames must pass the 4 bytes their payload is masked with. */
+int websocket_encode_header(uint8_t *header, websocket_opcode opcode, uint64_t len, const uint8_t *mask);
+
+/* Masks or unmasks a payload in place, 'offset' being the position of 'data' in the frame payload */
+void websocket_mask(void *data, uint64_t len, const uint8_t *mask, uint64_t offset);
+
+#endif
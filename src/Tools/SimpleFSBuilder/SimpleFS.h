@@ -4,6 +4,14 @@ typedef struct
 	uint32_t NameOffset;
 	uint32_t ContentTypeOffset;
 	uint32_t DataOffset;
+
+	/* The fields below are only present if the header EntrySize covers them (FormatVersion >= 3) */
+	uint32_t Flags;				// kSimpleFSEntry* flags
+	uint32_t GzipSize;			// Size of the gzip-compressed copy, if kSimpleFSEntryHasGzip is set
+	uint32_t GzipDataOffset;
+
+	/* Present from FormatVersion 4 */
+	uint32_t ETagOffset;		// Name block offset of the hex content hash used as the entity tag
 } StoredFileEntry;
 
 typedef struct
@@ -12,9 +20,39 @@ typedef struct
 	uint32_t EntryCount;
 	uint32_t NameBlockSize;
 	uint32_t DataBlockSize;
+
+	/* The fields below are only present in images using kSimpleFSIndexedHeaderMagic.
+	 * Older images end the header after DataBlockSize and have no index. */
+	uint32_t FormatVersion;
+	uint32_t EntrySize;			// Stride of the StoredFileEntry table
+	uint32_t IndexOffset;		// Offset of the index from the start of the image, 0 if there is none
+	uint32_t IndexBucketCount;
 } GlobalFSHeader;
 
-enum 
+enum
 {
 	kSimpleFSHeaderMagic = '1SFS',
+	kSimpleFSIndexedHeaderMagic = '2SFS',
+	kSimpleFSFormatVersion = 4,
 };
+
+enum
+{
+	kSimpleFSEntryHasGzip = 0x01,
+};
+
+/* The index is a minimal perfect hash: IndexBucketCount 32-bit seeds.
+ * The entry for a path is at SimpleFSHash(path, seeds[SimpleFSHash(path, 0) % IndexBucketCount]) % EntryCount,
+ * the builder storing the entries in that order. Paths that are not in the image still map to some entry,
+ * so the name of the found entry must always be compared. */
+static inline uint32_t SimpleFSHash(const char *str, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+	while (*str)
+		hash = (hash ^ (uint8_t)*str++) * 16777619u;
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
+}
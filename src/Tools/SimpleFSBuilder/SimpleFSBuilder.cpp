@@ -8,6 +8,10 @@
 #include <string.h>
 #include <map>
 #include <vector>
+#include <algorithm>
+#ifdef SIMPLEFS_HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include "SimpleFS.h"
 
 using namespace std;
@@ -18,6 +22,8 @@ struct TemporaryFileEntry
 	string PathInArchive;
 	string FullPath, Extension;
 	uintmax_t Size;
+	std::vector<char> GzipData;
+	std::string ETag;
 	
 	TemporaryFileEntry(const string &pathInArchive, const path &fullPath, uintmax_t size)
 		: PathInArchive(pathInArchive),
@@ -72,13 +78,115 @@ void WriteIfNotMatches(std::string fn, std::vector<char> &data)
 	fs.write(data.data(), data.size());
 }
 
+// Computes the per-bucket seeds of a minimal perfect hash over the archive paths (see SimpleFS.h)
+// and returns the slot assigned to every entry.
+static std::vector<uint32_t> BuildPerfectHashIndex(const std::vector<const TemporaryFileEntry *> &entries, std::vector<uint32_t> &seeds)
+{
+	size_t count = entries.size();
+	std::vector<std::vector<size_t>> buckets(seeds.size());
+	for (size_t i = 0; i < count; i++)
+		buckets[SimpleFSHash(entries[i]->PathInArchive.c_str(), 0) % seeds.size()].push_back(i);
+
+	std::vector<size_t> order(buckets.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	// Place the largest buckets first, while most slots are still free
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+	std::vector<uint32_t> slots(count);
+	std::vector<bool> taken(count);
+	std::vector<uint32_t> candidate;
+
+	for (size_t b : order)
+	{
+		const auto &bucket = buckets[b];
+		if (bucket.empty())
+			break;
+
+		uint32_t seed;
+		for (seed = 1; seed < (1 << 24); seed++)
+		{
+			candidate.clear();
+			for (size_t i : bucket)
+			{
+				uint32_t slot = SimpleFSHash(entries[i]->PathInArchive.c_str(), seed) % count;
+				if (taken[slot] || std::find(candidate.begin(), candidate.end(), slot) != candidate.end())
+					break;
+				candidate.push_back(slot);
+			}
+
+			if (candidate.size() == bucket.size())
+				break;
+		}
+
+		if (candidate.size() != bucket.size())
+			throw runtime_error("Unable to build the file index");
+
+		seeds[b] = seed;
+		for (size_t i = 0; i < bucket.size(); i++)
+		{
+			slots[bucket[i]] = candidate[i];
+			taken[candidate[i]] = true;
+		}
+	}
+
+	return slots;
+}
+
+static std::vector<char> ReadWholeFile(const std::string &fn, uintmax_t size)
+{
+	std::vector<char> data(size);
+	ifstream ifs(fn, ios::in | ios::binary);
+	ifs.read(data.data(), size);
+	return data;
+}
+
+// 64-bit FNV-1a of the file contents, as 16 hex digits. Any change to the file changes the entity tag.
+static std::string ComputeETag(const std::vector<char> &data)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : data)
+		hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+
+	char tmp[17];
+	snprintf(tmp, sizeof(tmp), "%016llx", (unsigned long long)hash);
+	return tmp;
+}
+
+#ifdef SIMPLEFS_HAVE_ZLIB
+static std::vector<char> GzipCompress(const std::vector<char> &data)
+{
+	z_stream strm = {};
+	// windowBits + 16 produces a gzip wrapper (with a zero timestamp, so the image stays reproducible)
+	if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw runtime_error("Unable to initialize zlib");
+
+	std::vector<char> result(deflateBound(&strm, data.size()));
+	strm.next_in = (Bytef *)data.data();
+	strm.avail_in = data.size();
+	strm.next_out = (Bytef *)result.data();
+	strm.avail_out = result.size();
+
+	int err = deflate(&strm, Z_FINISH);
+	deflateEnd(&strm);
+	if (err != Z_STREAM_END)
+		throw runtime_error("Unable to compress data");
+
+	result.resize(strm.total_out);
+	return result;
+}
+#endif
+
 struct ContentType
 {
 	std::string Value;
 	int Offset;
+	bool Compressible;
 	
 	ContentType(const char *value)
-		: Value(value)
+		: Value(value),
+		Compressible(!strncmp(value, "text/", 5) || !strcmp(value, "image/svg+xml"))
 	{
 	}
 };
@@ -95,7 +203,9 @@ int main(int argc, char *argv[])
 	{
 		std::list<TemporaryFileEntry> entries;
 		BuildFileListRecursively(argv[1], entries, "");
-		GlobalFSHeader hdr = { kSimpleFSHeaderMagic, };
+		GlobalFSHeader hdr = { kSimpleFSIndexedHeaderMagic, };
+		hdr.FormatVersion = kSimpleFSFormatVersion;
+		hdr.EntrySize = sizeof(StoredFileEntry);
 		
 		map<string, ContentType> contentTypes = {
 			{ ".txt", "text/plain" },
@@ -107,17 +217,67 @@ int main(int argc, char *argv[])
 			{ ".svg", "image/svg+xml" },
 		};
 
-		for (const auto &entry : entries)
+		auto findContentType = [&](const TemporaryFileEntry &entry)
 		{
+			auto it = contentTypes.find(entry.Extension);
+			if (it == contentTypes.end())
+				it = contentTypes.find(".html");
+			return it;
+		};
+
+		uintmax_t totalSize = 0, totalSent = 0;
+		for (auto &entry : entries)
+		{
+			auto contents = ReadWholeFile(entry.FullPath, entry.Size);
+			entry.ETag = ComputeETag(contents);
+#ifdef SIMPLEFS_HAVE_ZLIB
+			if (findContentType(entry)->second.Compressible && entry.Size)
+			{
+				// Only keep the compressed copy if it is actually smaller
+				auto compressed = GzipCompress(contents);
+				if (compressed.size() < entry.Size)
+					entry.GzipData = std::move(compressed);
+
+				cout << (entry.PathInArchive.empty() ? "/" : entry.PathInArchive) << ": " << entry.Size << " -> " << (entry.GzipData.empty() ? entry.Size : entry.GzipData.size()) << " bytes";
+				if (!entry.GzipData.empty())
+					cout << " (gzip, -" << (entry.Size - entry.GzipData.size()) * 100 / entry.Size << "%)";
+				cout << endl;
+			}
+#endif
+			totalSize += entry.Size;
+			totalSent += entry.GzipData.empty() ? entry.Size : entry.GzipData.size();
+
 			hdr.EntryCount++;
-			hdr.NameBlockSize += entry.PathInArchive.size() + 1;
-			hdr.DataBlockSize += entry.Size;
+			hdr.NameBlockSize += entry.PathInArchive.size() + 1 + entry.ETag.size() + 1;
+			hdr.DataBlockSize += entry.Size + entry.GzipData.size();
 		}
+
+		if (totalSize != totalSent)
+			cout << "Compressed files save " << (totalSize - totalSent) << " of " << totalSize << " bytes" << endl;
+		cout << "Revalidating all " << hdr.EntryCount << " files on a repeat visit saves " << totalSent << " bytes of content" << endl;
 		
 		for (const auto &kv : contentTypes)
 			hdr.NameBlockSize += kv.second.Value.size() + 1;
+
+		// Entries are stored in the order given by the perfect hash, so the index only holds the bucket seeds
+		std::vector<const TemporaryFileEntry *> orderedEntries(hdr.EntryCount);
+		std::vector<uint32_t> seeds;
+		if (hdr.EntryCount)
+		{
+			std::vector<const TemporaryFileEntry *> unordered;
+			for (const auto &entry : entries)
+				unordered.push_back(&entry);
+
+			seeds.resize((hdr.EntryCount + 1) / 2);
+			auto slots = BuildPerfectHashIndex(unordered, seeds);
+			for (size_t j = 0; j < unordered.size(); j++)
+				orderedEntries[slots[j]] = unordered[j];
+
+			hdr.IndexBucketCount = seeds.size();
+			hdr.IndexOffset = (sizeof(GlobalFSHeader) + hdr.EntryCount * sizeof(StoredFileEntry) + hdr.NameBlockSize + hdr.DataBlockSize + 3) & ~3;
+		}
 	
-		std::vector<char> buffer(sizeof(GlobalFSHeader) + hdr.EntryCount * sizeof(StoredFileEntry) + hdr.NameBlockSize + hdr.DataBlockSize);
+		std::vector<char> buffer(hdr.IndexOffset ? hdr.IndexOffset + seeds.size() * sizeof(uint32_t) : sizeof(GlobalFSHeader) + hdr.EntryCount * sizeof(StoredFileEntry) + hdr.NameBlockSize + hdr.DataBlockSize);
 	
 		*((GlobalFSHeader *)buffer.data()) = hdr;
 		StoredFileEntry *storedEntries = (StoredFileEntry *)(buffer.data() + sizeof(GlobalFSHeader));
@@ -133,27 +293,35 @@ int main(int argc, char *argv[])
 			nameOff += kv.second.Value.size() + 1;
 		}
 	
-		for (const auto &entry : entries)
+		for (const auto *pEntry : orderedEntries)
 		{
+			const auto &entry = *pEntry;
 			storedEntries[i].FileSize = entry.Size;
 			storedEntries[i].NameOffset = nameOff;
 			storedEntries[i].DataOffset = dataOff;
+			storedEntries[i].ContentTypeOffset = findContentType(entry)->second.Offset;
 			
-			auto it = contentTypes.find(entry.Extension);
-			if (it == contentTypes.end())
-				it = contentTypes.find(".html");
-			
-			storedEntries[i].ContentTypeOffset = it->second.Offset;
-			
-			i++;
-		
 			ifstream ifs(entry.FullPath, ios::in | ios::binary);
 			ifs.read(data + dataOff, entry.Size);
-		
+			dataOff += entry.Size;
+			
+			if (!entry.GzipData.empty())
+			{
+				storedEntries[i].Flags |= kSimpleFSEntryHasGzip;
+				storedEntries[i].GzipSize = entry.GzipData.size();
+				storedEntries[i].GzipDataOffset = dataOff;
+				memcpy(data + dataOff, entry.GzipData.data(), entry.GzipData.size());
+				dataOff += entry.GzipData.size();
+			}
+			
 			memcpy(names + nameOff, entry.PathInArchive.c_str(), entry.PathInArchive.size() + 1);
-		
 			nameOff += entry.PathInArchive.size() + 1;
-			dataOff += entry.Size;
+
+			storedEntries[i].ETagOffset = nameOff;
+			memcpy(names + nameOff, entry.ETag.c_str(), entry.ETag.size() + 1);
+			nameOff += entry.ETag.size() + 1;
+			
+			i++;
 		}
 	
 		if (nameOff != hdr.NameBlockSize)
@@ -163,6 +331,9 @@ int main(int argc, char *argv[])
 		if (i != hdr.EntryCount)
 			throw runtime_error("Unexpected entry count");
 
+		if (hdr.IndexOffset)
+			memcpy(buffer.data() + hdr.IndexOffset, seeds.data(), seeds.size() * sizeof(uint32_t));
+
 		WriteIfNotMatches(argv[2], buffer);
 		return 0;
 	}
@@ -0,0 +1,448 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <string.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+extern "C"
+{
+#include "websocket.h"
+}
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+// Settings of the sequence started by the latency measurement: long enough to be still running when it is stopped
+static const char LatencyStartSettings[] = "{\"picture\":1, \"exposure\":\"600\", \"delay\":\"1\"}";
+
+class Socket
+{
+	int _Socket = -1;
+
+public:
+	Socket(const std::string &host, const std::string &port)
+	{
+		addrinfo hints = {}, *result;
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result))
+			throw runtime_error("Cannot resolve " + host);
+
+		for (addrinfo *ai = result; ai && _Socket < 0; ai = ai->ai_next)
+		{
+			_Socket = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (_Socket >= 0 && connect(_Socket, ai->ai_addr, ai->ai_addrlen))
+			{
+				close(_Socket);
+				_Socket = -1;
+			}
+		}
+		freeaddrinfo(result);
+		if (_Socket < 0)
+			throw runtime_error("Cannot connect to " + host + ":" + port);
+
+		// Commands are small, they must not wait for more data to fill a segment
+		int one = 1;
+		setsockopt(_Socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	~Socket()
+	{
+		close(_Socket);
+	}
+
+	Socket(const Socket &) = delete;
+	Socket &operator=(const Socket &) = delete;
+
+	void SendAll(const void *data, size_t size)
+	{
+		const char *p = (const char *)data;
+		while (size)
+		{
+			ssize_t done = send(_Socket, p, size, MSG_NOSIGNAL);
+			if (done <= 0)
+				throw runtime_error("Connection lost while sending");
+			p += done;
+			size -= done;
+		}
+	}
+
+	void ReceiveAll(void *data, size_t size)
+	{
+		char *p = (char *)data;
+		while (size)
+		{
+			ssize_t done = recv(_Socket, p, size, 0);
+			if (done <= 0)
+				throw runtime_error("Connection lost while receiving");
+			p += done;
+			size -= done;
+		}
+	}
+
+	// Everything up to the peer closing the connection
+	std::string ReceiveToEnd()
+	{
+		std::string result;
+		char buffer[1024];
+		ssize_t done;
+		while ((done = recv(_Socket, buffer, sizeof(buffer), 0)) > 0)
+			result.append(buffer, done);
+		return result;
+	}
+
+	// Headers of a reply, up to and including the empty line
+	std::string ReceiveHeaders()
+	{
+		std::string result;
+		char c;
+		while (result.size() < 4 || result.compare(result.size() - 4, 4, "\r\n\r\n"))
+		{
+			ReceiveAll(&c, 1);
+			result += c;
+		}
+		return result;
+	}
+};
+
+static std::string Base64(const uint8_t *data, size_t size)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string result;
+	for (size_t i = 0; i < size; i += 3)
+	{
+		uint32_t v = data[i] << 16;
+		if (i + 1 < size)
+			v |= data[i + 1] << 8;
+		if (i + 2 < size)
+			v |= data[i + 2];
+
+		result += alphabet[(v >> 18) & 0x3F];
+		result += alphabet[(v >> 12) & 0x3F];
+		result += (i + 1 < size) ? alphabet[(v >> 6) & 0x3F] : '=';
+		result += (i + 2 < size) ? alphabet[v & 0x3F] : '=';
+	}
+	return result;
+}
+
+// Client end of the /api/timer/ws control channel
+class TimerWebSocket
+{
+	Socket _Socket;
+	std::mt19937 _Random{std::random_device{}()};
+
+	void SendFrame(websocket_opcode opcode, const std::string &payload)
+	{
+		uint8_t mask[4];
+		for (auto &b : mask)
+			b = (uint8_t)_Random();
+
+		std::vector<uint8_t> frame(WEBSOCKET_HEADER_MAX_SIZE + payload.size());
+		int headerSize = websocket_encode_header(frame.data(), opcode, payload.size(), mask);
+		memcpy(frame.data() + headerSize, payload.data(), payload.size());
+		websocket_mask(frame.data() + headerSize, payload.size(), mask, 0);
+		_Socket.SendAll(frame.data(), headerSize + payload.size());
+	}
+
+public:
+	TimerWebSocket(const std::string &host, const std::string &port)
+		: _Socket(host, port)
+	{
+		uint8_t nonce[16];
+		for (auto &b : nonce)
+			b = (uint8_t)_Random();
+		std::string key = Base64(nonce, sizeof(nonce));
+
+		std::string request = "GET /api/timer/ws HTTP/1.1\r\nHost: " + host + "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: " + key + "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+		_Socket.SendAll(request.data(), request.size());
+
+		std::string reply = _Socket.ReceiveHeaders();
+		if (reply.compare(0, 12, "HTTP/1.1 101"))
+			throw runtime_error("WebSocket upgrade refused: " + reply.substr(0, reply.find('\r')));
+
+		char accept[WEBSOCKET_ACCEPT_SIZE];
+		websocket_accept_key(key.c_str(), accept);
+		if (reply.find(std::string("Sec-WebSocket-Accept: ") + accept + "\r\n") == std::string::npos)
+			throw runtime_error("Invalid Sec-WebSocket-Accept in the handshake");
+	}
+
+	void Send(const std::string &message)
+	{
+		SendFrame(WEBSOCKET_TEXT, message);
+	}
+
+	// Next text message, answering the pings of the server meanwhile
+	std::string Receive()
+	{
+		std::string message;
+		for (;;)
+		{
+			uint8_t header[8];
+			_Socket.ReceiveAll(header, 2);
+			int opcode = header[0] & 0x0F;
+			bool final = (header[0] & 0x80) != 0;
+			uint64_t size = header[1] & 0x7F;
+			if (size == 126)
+			{
+				_Socket.ReceiveAll(header, 2);
+				size = (header[0] << 8) | header[1];
+			}
+			else if (size == 127)
+			{
+				_Socket.ReceiveAll(header, 8);
+				size = 0;
+				for (int i = 0; i < 8; i++)
+					size = (size << 8) | header[i];
+			}
+
+			std::string payload(size, 0);
+			_Socket.ReceiveAll(payload.data(), size);
+			if (opcode == WEBSOCKET_PING)
+				SendFrame(WEBSOCKET_PONG, payload);
+			else if (opcode == WEBSOCKET_CLOSE)
+				throw runtime_error("WebSocket closed by the server");
+			else if (opcode == WEBSOCKET_TEXT || opcode == WEBSOCKET_CONTINUATION)
+			{
+				message += payload;
+				if (final)
+					return message;
+			}
+		}
+	}
+
+	std::string Command(const std::string &command)
+	{
+		Send(command);
+		return Receive();
+	}
+};
+
+// The same command as a one-shot POST on its own connection, as the web app sent them before the control channel
+static std::string PostCommand(const std::string &host, const std::string &port, const std::string &command, const std::string &body)
+{
+	Socket socket(host, port);
+	std::string request = "POST /api/timer/" + command + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n"
+		"Content-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+	socket.SendAll(request.data(), request.size());
+	std::string reply = socket.ReceiveToEnd();
+	size_t end = reply.find("\r\n\r\n");
+	return end == std::string::npos ? reply : reply.substr(end + 4);
+}
+
+class LatencyStats
+{
+	std::vector<double> _Samples;
+
+public:
+	void Add(Clock::duration duration)
+	{
+		_Samples.push_back(std::chrono::duration<double, std::milli>(duration).count());
+	}
+
+	void Merge(const LatencyStats &other)
+	{
+		_Samples.insert(_Samples.end(), other._Samples.begin(), other._Samples.end());
+	}
+
+	void Print(const std::string &label)
+	{
+		if (_Samples.empty())
+			return;
+
+		std::sort(_Samples.begin(), _Samples.end());
+		auto percentile = [&](double p) { return _Samples[std::min(_Samples.size() - 1, (size_t)(p * _Samples.size()))]; };
+		printf("%-24s %5zu samples: min %7.2f ms, p50 %7.2f ms, p99 %7.2f ms, max %7.2f ms\n", label.c_str(), _Samples.size(),
+			_Samples.front(), percentile(0.5), percentile(0.99), _Samples.back());
+	}
+};
+
+static bool IsOk(const std::string &reply)
+{
+	return reply == "OK" || reply.find("\"result\":\"OK\"") != std::string::npos;
+}
+
+/* Command-to-acknowledgement time of start and stop, over the control channel and as one-shot POSTs. The timer task
+ * only acknowledges once the shutter engine has driven the outputs (stop) or armed the first edge (start), so the
+ * acknowledgement bounds the command-to-edge latency of the device from above, network return included. */
+static void MeasureLatency(const std::string &host, const std::string &port, int rounds)
+{
+	LatencyStats wsStart, wsStop, httpStart, httpStop;
+	int failures = 0;
+
+	TimerWebSocket ws(host, port);
+	for (int i = 0; i < rounds; i++)
+	{
+		auto start = Clock::now();
+		failures += !IsOk(ws.Command(std::string("start ") + LatencyStartSettings));
+		auto started = Clock::now();
+		failures += !IsOk(ws.Command("stop"));
+		auto stopped = Clock::now();
+		wsStart.Add(started - start);
+		wsStop.Add(stopped - started);
+	}
+
+	for (int i = 0; i < rounds; i++)
+	{
+		auto start = Clock::now();
+		failures += !IsOk(PostCommand(host, port, "start", LatencyStartSettings));
+		auto started = Clock::now();
+		failures += !IsOk(PostCommand(host, port, "stop", ""));
+		auto stopped = Clock::now();
+		httpStart.Add(started - start);
+		httpStop.Add(stopped - started);
+	}
+
+	wsStart.Print("WebSocket start");
+	wsStop.Print("WebSocket stop");
+	httpStart.Print("HTTP POST start");
+	httpStop.Print("HTTP POST stop");
+	if (failures)
+		printf("%d commands were not acknowledged with OK\n", failures);
+}
+
+// One-shot GET on its own connection, returns the status line
+static std::string GetStatus(const std::string &host, const std::string &port, const std::string &path, std::string *body = nullptr)
+{
+	Socket socket(host, port);
+	std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+	socket.SendAll(request.data(), request.size());
+	std::string reply = socket.ReceiveToEnd();
+	size_t end = reply.find("\r\n\r\n");
+	if (body)
+		*body = end == std::string::npos ? "" : reply.substr(end + 4);
+	return reply.substr(0, reply.find('\r'));
+}
+
+static void PrintServerStats(const std::string &host, const std::string &port, const std::string &label)
+{
+	std::string stats;
+	try
+	{
+		GetStatus(host, port, "/api/server/stats", &stats);
+	}
+	catch (std::exception &ex)
+	{
+		stats = ex.what();
+	}
+	printf("%-24s %s\n", label.c_str(), stats.c_str());
+}
+
+/* Requests per second with 'connections' clients each opening a connection per request, as browsers and captive portal
+ * probes do, and the server counters and heap state before and after. The heap figures show whether the connection
+ * handling leaves the heap fragmented: after the load, the free space and the largest free block must be back where
+ * they were. On a large static file, the throughput and the lwIP high-water marks of debug builds compare the
+ * firmware built with HTTP_STATIC_NOCOPY set and cleared, each run right after a reboot. */
+static void MeasureLoad(const std::string &host, const std::string &port, int connections, int seconds, const std::string &path)
+{
+	PrintServerStats(host, port, "Server before:");
+
+	std::atomic<int> ok(0), busy(0), failed(0);
+	std::atomic<long long> received(0);
+	std::vector<LatencyStats> latencies(connections);
+	std::vector<std::thread> threads;
+	auto end = Clock::now() + std::chrono::seconds(seconds);
+	auto start = Clock::now();
+	for (int i = 0; i < connections; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			while (Clock::now() < end)
+			{
+				auto sent = Clock::now();
+				try
+				{
+					std::string body;
+					std::string status = GetStatus(host, port, path, &body);
+					if (status.find(" 200 ") != std::string::npos)
+					{
+						ok++;
+						received += body.size();
+					}
+					else if (status.find(" 503 ") != std::string::npos)
+						busy++;
+					else
+						failed++;
+				}
+				catch (std::exception &)
+				{
+					failed++;
+				}
+				latencies[i].Add(Clock::now() - sent);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	LatencyStats all;
+	for (auto &latency : latencies)
+		all.Merge(latency);
+	printf("%d connections, %.1f s: %.1f requests/s, %d OK, %d busy (503), %d failed\n", connections, elapsed,
+		(ok + busy + failed) / elapsed, ok.load(), busy.load(), failed.load());
+	printf("%.1f KB/s of replies received\n", received / elapsed / 1024);
+	all.Print("Request round trip");
+	PrintServerStats(host, port, "Server after:");
+}
+
+static void Usage()
+{
+	cerr << "Usage: TimerClient <host> [-p port] <command>...     sends commands over /api/timer/ws and prints the replies" << endl;
+	cerr << "       TimerClient <host> [-p port] --latency [rounds]  measures start/stop latency, WebSocket against HTTP POST" << endl;
+	cerr << "       TimerClient <host> [-p port] --load [connections] [seconds] [path]  measures requests/s and heap use" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		Usage();
+		return 1;
+	}
+
+	std::string host = argv[1], port = "80";
+	int arg = 2;
+	if (!strcmp(argv[arg], "-p") && arg + 1 < argc)
+	{
+		port = argv[arg + 1];
+		arg += 2;
+	}
+	if (arg >= argc)
+	{
+		Usage();
+		return 1;
+	}
+
+	try
+	{
+		if (!strcmp(argv[arg], "--latency"))
+			MeasureLatency(host, port, arg + 1 < argc ? atoi(argv[arg + 1]) : 50);
+		else if (!strcmp(argv[arg], "--load"))
+			MeasureLoad(host, port, arg + 1 < argc ? atoi(argv[arg + 1]) : 8, arg + 2 < argc ? atoi(argv[arg + 2]) : 10,
+				arg + 3 < argc ? argv[arg + 3] : "/");
+		else
+		{
+			TimerWebSocket ws(host, port);
+			for (; arg < argc; arg++)
+				cout << ws.Command(argv[arg]) << endl;
+		}
+	}
+	catch (std::exception &ex)
+	{
+		cerr << ex.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}